@@ -1,11 +1,19 @@
 #include <WiFi.h>
-#include <WebServer.h>
+#include <esp_http_server.h>
+#include <lwip/sockets.h>
 #include <SPI.h>
 #include <XPT2046_Touchscreen.h>
 #include <TFT_eSPI.h>
 #include <esp_sleep.h>
+#include <esp_sntp.h>
+#include <esp_pm.h>
+#include <driver/gpio.h>
+#include <soc/gpio_struct.h>
+#include <sys/time.h>
 #include <Preferences.h>
+#include <LittleFS.h>
 #include <ArduinoJson.h>
+#include <atomic>
 
 // --- WiFi credentials ---
 const char* SSID = "setup";
@@ -23,11 +31,121 @@ const char* PASSWORD = "setup";
 #define DEEPSLEEP_PIN_ACT LOW
 
 SPIClass mySpi = SPIClass(VSPI);
-XPT2046_Touchscreen ts(XPT2046_CS, XPT2046_IRQ);
+XPT2046_Touchscreen ts(XPT2046_CS); // IRQ pin is handled by the touch pipeline, not the library
 TFT_eSPI tft = TFT_eSPI();
 
+// --- Metrics ---
+// Fixed-bucket histograms, exported by GET /metrics in Prometheus text
+// format. observe() is a short linear scan and a few adds, cheap enough for
+// every loop iteration and every frame. Each histogram has exactly one
+// writer task, so there is no locking; a scrape may see a sample counted in
+// a bucket but not yet in the sum, which Prometheus tolerates.
+#define HIST_MAX_BUCKETS 12
+#define LOG_HTTP_BODIES 0 // 1: dump raw /config and /settings bodies to Serial
+
+const uint32_t LATENCY_BOUNDS_US[] = {50, 100, 250, 500, 1000, 2500, 5000, 10000, 25000, 50000, 100000, 250000};
+const uint32_t PIXEL_BOUNDS[] = {1024, 4096, 8192, 16384, 32768, 65536, 131072};
+
+struct Histogram {
+  const uint32_t *bounds;                // ascending upper bounds; one more bucket for +Inf
+  uint8_t buckets;
+  uint32_t counts[HIST_MAX_BUCKETS + 1] = {};
+  uint32_t count = 0;
+  uint64_t sum = 0;
+
+  Histogram(const uint32_t *b = LATENCY_BOUNDS_US, uint8_t n = sizeof(LATENCY_BOUNDS_US) / sizeof(uint32_t))
+    : bounds(b), buckets(n) {}
+
+  void observe(uint32_t v) {
+    uint8_t i = 0;
+    while (i < buckets && v > bounds[i]) i++;
+    counts[i]++;
+    count++;
+    sum += v;
+  }
+};
+
+struct Metrics {
+  Histogram touchToDisplayUs;                     // touch IRQ -> first frame pushed for that press
+  Histogram redrawPixels{PIXEL_BOUNDS, sizeof(PIXEL_BOUNDS) / sizeof(uint32_t)};
+  Histogram nvsCommitUs[2];                       // [0] buttons (saveStates), [1] settings
+  Histogram iconDrawUs;                           // icon decode + push, per tile
+  Histogram patchUs;                              // POST /draw, per patch, network time included
+  uint32_t eventsLost = 0;                        // events overwritten before a client read them
+} metrics;
+uint32_t pressStartUs = 0; // IRQ time of the press being handled, 0 = none
+
 // --- Web server ---
-WebServer server(80);
+// esp_http_server: runs in its own task on core 0, keeps connections alive
+// and multiplexes several clients. DeckServer gives the handlers the small
+// WebServer-style API they use (arg, header, send...) for the request being
+// handled; httpd runs handlers one at a time, so that is a plain member.
+#define HTTP_MAX_ROUTES 20
+#define HTTP_MAX_HEADERS 6    // extra response headers per request
+#define HTTP_MAX_BODY 8192    // larger request bodies are truncated (receive() streams past this)
+#define HTTP_MAX_SOCKETS 7    // concurrent connections, stream clients included; see opened()
+#define HTTP_BODY_TIMEOUTS 2  // receive timeouts (recv_wait_timeout, 5 s each) before a body is abandoned
+
+class DeckServer {
+public:
+  struct Route {
+    DeckServer *owner;
+    const char *uri;
+    httpd_method_t method;
+    void (*handler)();
+    Histogram latencyUs;  // handler time, written by the httpd task only
+  };
+
+  void on(const char *uri, httpd_method_t method, void (*handler)());
+  bool begin();
+  bool hasArg(const char *name);
+  String arg(const char *name);
+  bool hasHeader(const char *name);
+  String header(const char *name);
+  void sendHeader(const char *name, const String &value);
+  void send(int code, const char *type = nullptr, const String &body = String());
+  void send_P(int code, const char *type, const char *body, size_t len);
+  size_t contentLength() { return req->content_len; }
+  int receive(char *buf, size_t len); // streams the raw body: bytes read, 0 at the end, < 0 on error
+  void sendChunk(int code, const char *type, const String &data); // empty data ends the response
+  int detach();  // hands the socket over to the caller (SSE); no response is sent
+  void opened(int fd);  // session bookkeeping, from the httpd open/close callbacks
+  void closed(int fd);
+  httpd_handle_t handle() { return hd; }
+  int routeTable(const Route **list) const { *list = routes; return routeCount; }
+
+private:
+  static esp_err_t dispatch(httpd_req_t *r);
+  const String &body();
+  bool findArg(const char *query, const char *name, String *value);
+  bool lookupArg(const char *name, String *value);
+  void respond(int code, const char *type, const char *data, size_t len);
+  void prepare(int code, const char *type);
+
+  // Open sockets and their last request. Detached (stream) sockets are
+  // never evicted: httpd's own LRU purge would pick them first, as they
+  // carry no requests once detached.
+  struct Session {
+    int fd;
+    unsigned long lastMs;
+    bool detached;
+  };
+
+  Route routes[HTTP_MAX_ROUTES];
+  Session sessions[HTTP_MAX_SOCKETS];
+  int routeCount = 0;
+  httpd_handle_t hd = nullptr;
+  httpd_req_t *req = nullptr;
+  String reqBody;
+  size_t bodyLeft = 0;   // body bytes not yet read from the socket
+  int bodyTimeouts = 0;
+  bool bodyRead = false;
+  bool responded = false;
+  bool chunked = false;
+  String hdrNames[HTTP_MAX_HEADERS], hdrValues[HTTP_MAX_HEADERS];
+  int hdrCount = 0;
+};
+DeckServer server;
 
 // --- Touch calibration ---
 const int TOUCH_MIN = 50;
@@ -37,29 +155,249 @@ const int TOUCH_MAX = 3900;
 struct Btn {
   int x, y, size;
   bool state;
-  unsigned long lastToggleMs;
+  unsigned long lastReleaseMs;
+  uint16_t debounceMs;  // presses closer than this to the previous release are ignored
   String label;
 };
-Btn buttons[6]; // Expand to 6 buttons for 2x3 layout
+// --- Layout engine ---
+// Any grid up to MAX_COLS x MAX_ROWS, with up to MAX_PAGES pages. Every page
+// shares the same tile geometry; buttons are numbered page by page
+// (index = page * cols * rows + row * cols + col). Storage is sized for
+// MAX_BUTTONS, so memory stays fixed whatever the layout.
+#define MAX_COLS 5
+#define MAX_ROWS 4
+#define MAX_PAGES 4
+#define MAX_SLOTS (MAX_COLS * MAX_ROWS) // tiles on one page
+#define MAX_BUTTONS 48                  // cols * rows * pages is capped to this
+#define MAX_SCREEN_DIM 320
+#define NAV_BAR_H 22                    // page bar at the bottom when pages > 1
+
+Btn buttons[MAX_BUTTONS];
+
+const uint16_t DEFAULT_DEBOUNCE_MS = 60;
+
+// --- Touch pipeline ---
+// The XPT2046 pulls T_IRQ low while the panel is pressed. An ISR timestamps
+// the falling edge and the pin level tells us when the finger is down, so
+// the controller is only read over SPI while a finger is on the panel.
+// Every sample is the median of TOUCH_OVERSAMPLE readings; a state machine
+// (up -> down -> held -> lifting -> up) turns samples into timestamped
+// press and release events.
+#define TOUCH_OVERSAMPLE 5
+const unsigned long TOUCH_SAMPLE_INTERVAL_MS = 10; // position updates while held
+const unsigned long TOUCH_RELEASE_MS = 25;         // IRQ must stay high this long to count as lifted
+
+enum TouchPhase {
+  TOUCH_UP = 0,       // idle, waiting for the IRQ
+  TOUCH_DOWN = 1,     // IRQ seen, waiting for a valid sample
+  TOUCH_HELD = 2,     // press delivered
+  TOUCH_LIFTING = 3   // IRQ released, confirming the lift
+};
+
+struct TouchState {
+  TouchPhase phase;
+  int x, y;                 // latest filtered position (screen coordinates)
+  int downX, downY;
+  unsigned long downMs;     // IRQ edge time of the current touch
+  uint32_t downUs;          // same, micros(), for latency metrics
+  unsigned long liftMs;
+  unsigned long lastSampleMs;
+  int button;               // button the press landed on, -1 if none/consumed
+} touch = {TOUCH_UP, 0, 0, 0, 0, 0, 0, 0, 0, -1};
 
-const unsigned long toggleDebounceMs = 300;
+struct TouchStats {
+  uint32_t irqs;
+  uint32_t samples;         // oversampled reads
+  uint32_t rejected;        // reads without enough valid readings
+  uint32_t presses;
+  uint32_t releases;
+  uint32_t debounced;       // presses dropped by the per-button debounce
+} touchStats;
+
+volatile bool touchIrqPending = false;
+volatile unsigned long touchIrqMs = 0;
+volatile uint32_t touchIrqUs = 0;
 
 // --- Layout configuration ---
+// Legacy "layout" ids accepted/reported by /settings
 enum LayoutType {
   LAYOUT_2x2 = 0,
-  LAYOUT_3x2 = 1
+  LAYOUT_3x2 = 1,
+  LAYOUT_CUSTOM = -1
+};
+
+struct DeckLayout {
+  uint8_t cols, rows, pages;
+};
+DeckLayout layout = {2, 2, 1};
+int buttonCount = 4;   // cols * rows * pages
+int slotsPerPage = 4;  // cols * rows
+int currentPage = 0;
+
+// Hit-test lookup tables, rebuilt by setupButtonLayout(): screen x -> column
+// and screen y -> row, HIT_GAP in the margins, HIT_NAV inside the page bar.
+// A touch resolves to a button with two table reads and one multiply-add.
+#define HIT_GAP 0xFF
+#define HIT_NAV 0xFE
+const int HIT_PAGE_PREV = -2;
+const int HIT_PAGE_NEXT = -3;
+uint8_t hitCol[MAX_SCREEN_DIM];
+uint8_t hitRow[MAX_SCREEN_DIM];
+
+// --- Deck renderer (damage tracking) ---
+// What is currently on the panel for each tile, so drawButtons() only
+// repaints tiles whose geometry, color or label changed.
+struct TileSnapshot {
+  bool valid;
+  int x, y, size;
+  uint16_t color;
+  String label;
+  uint32_t iconRev;   // icons[].rev of the icon drawn, 0 = none
+};
+TileSnapshot drawnTiles[MAX_SLOTS]; // per on-screen slot, not per button
+bool deckOnScreen = false;     // false once another screen (info, AP, sleep) covered the deck
+uint16_t drawnBackground = 0;
+int drawnPage = -1;            // page shown in the page bar, -1 = bar not drawn
+
+// --- Button face cache ---
+// Pre-rendered tile faces, so a toggle is a single bulk blit instead of
+// fillRect + drawRect + glyph rasterizing. With PSRAM each tile keeps full
+// RGB565 normal and active faces; without it a 1-bit mask (fill vs. white
+// border/label, ~1.3 KB per tile) is pushed with the normal or active color.
+// Faces are keyed on size, label and colors and rebuilt only when one of
+// those changes (layout, /config, /settings). Faces belong to on-screen
+// slots, so only one page worth of sprites is ever allocated.
+struct FaceCache {
+  TFT_eSprite *face[2];  // [0] normal, [1] active; mono mode only uses [0]
+  bool mono;
+  int size;
+  uint16_t normal, active;
+  String label;
+};
+FaceCache faceCache[MAX_SLOTS];
+
+struct RenderStats {
+  uint32_t frames;           // drawButtons() calls that pushed anything
+  uint32_t fullRepaints;
+  uint32_t tilesDrawn;
+  uint32_t lastFramePixels;  // pixels pushed by the most recent frame
+  uint32_t maxFramePixels;
+  uint64_t totalPixels;
+  uint32_t faceBlits;        // tiles pushed from the face cache
+  uint32_t faceRebuilds;
+  uint32_t faceFallbacks;    // tiles drawn directly because a sprite could not be allocated
+} renderStats;
+
+// --- Icons ---
+// Per-button icons live in LittleFS as /icons/<n>.cdi. The format is a
+// small RLE over RGB565: "CDI1", width and height (u16 LE), then packets.
+// A control byte c < 0x80 is followed by c + 1 literal pixels (u16 LE);
+// c >= 0x80 by one pixel repeated (c & 0x7F) + 1 times. Runs may cross
+// line boundaries. An icon is decoded one line at a time into one of two
+// line buffers and pushed with DMA, so the transfer of a line overlaps the
+// decode of the next and no full image is ever held in RAM. A tile with an
+// icon that fits shows the icon in place of its label.
+#define ICON_DIR "/icons"
+#define ICON_MAGIC "CDI1"
+#define ICON_HEADER_LEN 8
+#define ICON_MAX_DIM 128      // per side; larger icons are rejected on upload
+#define ICON_MAX_BYTES 40960  // worst case for 128x128 is ~33 KB
+#define ICON_READ_CHUNK 512   // file read buffer, on the stack of the decoding task
+
+struct IconInfo {
+  uint16_t w, h;       // 0 = no icon
+  uint32_t bytes;      // file size
+  uint32_t rev;        // changes with every upload, so the renderer repaints the tile
+  uint32_t lastUs;     // decode + push time of the latest draw
+  uint32_t lastRead;   // file bytes read by the latest draw
 };
-LayoutType currentLayout = LAYOUT_2x2;
-int buttonCount = 4; // Default 4 buttons
+IconInfo icons[MAX_BUTTONS];
+uint32_t iconRevCounter = 0;
+uint16_t iconLine[2][ICON_MAX_DIM]; // DMA line buffers, panel byte order
+
+struct IconStats {
+  bool mounted;        // LittleFS is usable
+  bool dma;            // initDMA() succeeded; otherwise lines go out with pushPixels()
+  uint32_t draws;
+  uint32_t failures;   // draws abandoned on a short or corrupt file
+  uint32_t uploads;
+  uint32_t rejected;   // uploads refused (size, header or data)
+} iconStats;
+
+// --- Live tile patches (POST /draw) ---
+// For live content on a key (mute state, a meter, album art) the host
+// streams RGB565 rectangles instead of rewriting labels. Each patch is a
+// 9-byte header, then w * h pixels in the .cdi packet format:
+//   button u8 (1-based; 0 = x/y are screen coordinates)
+//   x, y i16 LE (relative to the tile), w, h u16 LE
+// Patches are clipped to their tile and decoded line by line as the body
+// arrives; each line goes to the panel under the deck lock, so a slow
+// client never holds up the UI task for more than one line. Nothing is
+// kept or persisted: the next repaint of the tile restores its face.
+uint16_t patchLine[MAX_SCREEN_DIM]; // panel byte order
+
+struct PatchStats {
+  uint32_t requests;
+  uint32_t patches;
+  uint32_t dropped;    // patches that pushed nothing (tile off screen or clipped away)
+  uint32_t errors;     // bodies that were malformed or ended mid-patch
+  uint64_t pixels;
+  uint64_t bytesIn;
+  uint32_t lastUs;     // latest request, network time included
+  uint32_t maxUs;
+} patchStats;
 
 // --- Screensaver / deep sleep ---
 unsigned long lastInteraction = 0;
 unsigned long SCREENSAVER_TIMEOUT = 900000; // 15 min default, now configurable
+const unsigned long TIMEOUT_MAX_S = 86400;  // upper bound for the configurable timeouts
 bool screensaverActive = false;
 
+// --- Idle power tier ---
+// Between "in use" and deep sleep sits an idle tier, entered after
+// IDLE_TIER_TIMEOUT without a touch. The CPU may drop to POWER_MIN_MHZ and
+// WiFi goes from DTIM modem sleep (WIFI_PS_MIN_MODEM) to WIFI_PS_MAX_MODEM,
+// which only listens every listen interval (3 beacons by default). When the
+// build has power management (CONFIG_PM_ENABLE + tickless idle) the chip
+// also light-sleeps whenever all tasks are blocked; the touch IRQ is armed as
+// a GPIO wake source and the WiFi driver wakes for beacons and traffic.
+// Without PM the tier just switches the CPU clock by hand.
+// A touch IRQ in the idle tier restores full speed from inputTask before the
+// touch is sampled. HTTP traffic does not change the tier (the host polls
+// continuously); it is served at whatever clock PM picks.
+enum PowerTier { POWER_ACTIVE = 0, POWER_IDLE = 1 };
+enum PowerMode {
+  POWER_MODE_MANUAL = 0,      // no PM in the build: setCpuFrequencyMhz() per tier
+  POWER_MODE_DFS = 1,         // esp_pm frequency scaling, no light sleep
+  POWER_MODE_LIGHT_SLEEP = 2  // esp_pm frequency scaling + automatic light sleep
+};
+const unsigned long IDLE_TIER_TIMEOUT = 30000;
+const uint32_t POWER_MAX_MHZ = 240;
+const uint32_t POWER_MIN_MHZ = 80;
+const uint32_t WAKE_FRAME_WINDOW_US = 1000000; // wakes without a frame this soon are not measured
+std::atomic<uint8_t> powerTier(POWER_ACTIVE);
+uint8_t powerMode = POWER_MODE_MANUAL;
+esp_pm_lock_handle_t powerFreqLock = nullptr;  // held in the active tier
+esp_pm_lock_handle_t powerSleepLock = nullptr; // held in the active tier (light sleep mode only)
+SemaphoreHandle_t powerMutex = nullptr;
+unsigned long powerWakeMs = 0;                 // millis() of the last idle -> active switch
+volatile bool touchWakeArmed = false;          // IRQ pin is a level-triggered wake source
+volatile uint32_t wakeIrqUs = 0;               // micros() of the waking touch IRQ, 0 = none pending
+
+struct PowerStats {
+  uint32_t idleEntries;
+  uint32_t touchWakes;
+  int64_t tierSinceUs;        // esp_timer time of the last switch
+  uint64_t activeUs, idleUs;  // residency up to tierSinceUs
+  uint32_t wakeFrames;        // wakes measured from IRQ to the first pushed frame
+  uint32_t lastWakeFrameUs;
+  uint32_t maxWakeFrameUs;
+  uint64_t totalWakeFrameUs;
+} powerStats;
+
 // --- Button colors (configurable) ---
 struct ButtonColors {
-  uint16_t normal[6]; // Expand to 6 colors
+  uint16_t normal[MAX_BUTTONS];
   uint16_t active;
   uint16_t background;
 } colors;
@@ -67,6 +405,161 @@ struct ButtonColors {
 // --- Preferences (NVS) ---
 Preferences prefs;
 
+// --- Write-behind persistence ---
+// Changes only mark state dirty; servicePersistence() commits once the deck
+// has been quiet for PERSIST_QUIET_MS (or after PERSIST_MAX_DELAY_MS of
+// continuous changes), and enterDeepSleep() flushes whatever is pending.
+const unsigned long PERSIST_QUIET_MS = 2000;
+const unsigned long PERSIST_MAX_DELAY_MS = 10000;
+
+bool statesDirty = false;
+bool settingsDirty = false;
+unsigned long firstDirtyMs = 0;
+unsigned long lastDirtyMs = 0;
+
+// --- Persisted blobs ---
+// Each namespace holds a single packed, versioned, CRC-checked blob, so a
+// load or save is one NVS operation and a power cut mid-write leaves either
+// the old or the new blob (NVS replaces a key atomically). Older per-key
+// layouts are migrated on first boot. Bump the version and extend the
+// load*Blob() migration when a struct changes.
+#define LABEL_MAX_LEN 31
+#define BLOB_MAGIC 0xCD
+#define BUTTONS_BLOB_VERSION 2
+#define SETTINGS_BLOB_VERSION 4
+
+struct __attribute__((packed)) ButtonsBlob {
+  uint8_t magic;
+  uint8_t version;
+  uint16_t size;         // sizeof(ButtonsBlob) when written
+  uint64_t states;       // bit i = buttons[i].state
+  char labels[MAX_BUTTONS][LABEL_MAX_LEN + 1];
+  uint32_t crc;          // CRC-32 of every byte before this field
+};
+
+struct __attribute__((packed)) SettingsBlob {
+  uint8_t magic;
+  uint8_t version;
+  uint16_t size;
+  uint32_t timeout;
+  uint16_t background;
+  uint16_t active;
+  uint8_t cols;
+  uint8_t rows;
+  uint8_t pages;
+  uint32_t infoTimeout;
+  uint8_t infoEnabled;
+  char ssid[33];
+  char password[65];
+  uint16_t normal[MAX_BUTTONS];
+  uint16_t debounce[MAX_BUTTONS];
+  uint8_t streamClients; // subscriber cap for /stream
+  uint32_t crc;
+};
+
+// Mirrors of what NVS holds, so unchanged blobs are not rewritten
+ButtonsBlob committedButtons;
+SettingsBlob committedSettings;
+
+// --- Warm resume ---
+// enterDeepSleep() leaves the flushed blobs and the current page in RTC slow
+// memory. A touch wake restores the deck from there instead of NVS; the blob
+// CRCs plus the outer one are the validity check, and anything that does not
+// check out falls back to a normal load. Network parameters already survive
+// in rtcNetCache. Tile geometry is recomputed - it is plain arithmetic.
+#define WARM_STATE_VERSION 2
+
+struct __attribute__((packed)) WarmState {
+  uint8_t magic;
+  uint8_t version;
+  uint16_t size;
+  ButtonsBlob buttons;   // identical to what NVS holds after the flush
+  SettingsBlob settings;
+  uint8_t page;
+  uint32_t crc;
+};
+RTC_DATA_ATTR WarmState rtcWarm; // zeroed on power-on, consumed by the wake that uses it
+
+// The touch that woke the chip, sampled before anything slow runs in setup()
+struct WakeTouch {
+  bool valid;
+  int rawX, rawY;
+  unsigned long ms;
+} wakeTouch;
+
+struct PersistStats {
+  uint32_t requests;      // markStatesDirty/markSettingsDirty calls
+  uint32_t commits;       // blobs written to NVS
+  uint32_t skipped;       // flushes whose blob matched what NVS already held
+  uint32_t bytesWritten;
+  uint32_t migrations;    // legacy per-key namespaces converted to blobs
+  uint32_t crcErrors;
+  uint32_t warmResumes;   // touch wakes restored from the RTC snapshot
+  uint32_t lastCommitUs;
+  uint32_t maxCommitUs;
+  uint64_t totalCommitUs;
+} persistStats;
+
+// --- Fast boot / background WiFi ---
+// setup() never waits for WiFi: startWifi() kicks off the connection and
+// serviceWifi() advances it from netTask. The BSSID, channel and DHCP lease
+// of the last successful connection are cached (RTC memory across deep
+// sleep, NVS across power cycles) so a reconnect skips the scan and DHCP.
+// The cached address is only used to get associated: right after a fast
+// connect DHCP is restarted, so the router stays in charge of the lease and
+// an address it has handed to someone else is never kept. If that fast path
+// fails we fall back to a normal scan + DHCP, and after
+// WIFI_CONNECT_TIMEOUT_MS to the setup AP.
+enum WifiPhase {
+  NET_FAST_CONNECT = 0,
+  NET_FULL_CONNECT = 1,
+  NET_ONLINE = 2,
+  NET_AP_MODE = 3
+};
+WifiPhase wifiPhase = NET_FULL_CONNECT;
+unsigned long wifiStartMs = 0;
+unsigned long wifiPhaseMs = 0;
+unsigned long wifiConnectMs = 0; // how long the last connect took
+bool leaseRenewing = false;      // online on the cached address, waiting for DHCP to bind
+bool showApiUrlOnConnect = false;
+const unsigned long WIFI_FAST_TIMEOUT_MS = 4000;
+const unsigned long WIFI_CONNECT_TIMEOUT_MS = 20000;
+#define NET_CACHE_VERSION 1
+
+struct __attribute__((packed)) NetCache {
+  uint8_t magic;
+  uint8_t version;
+  uint16_t size;
+  uint32_t ssidCrc;     // cache only applies to the network it was taken from
+  uint8_t bssid[6];
+  uint8_t channel;
+  uint32_t ip, gateway, subnet, dns;
+  uint32_t crc;
+};
+RTC_DATA_ATTR NetCache rtcNetCache; // survives deep sleep, zeroed on power-on
+NetCache netCache;                  // copy in NVS ("net"/"cache")
+
+// --- WiFi credential job ---
+// POST /save-credentials answers right away; netTask then tries the new
+// network in the background and GET /save-credentials/status reports progress.
+// On success the device restarts, on failure the setup AP comes back.
+enum CredJobState {
+  CRED_IDLE = 0,
+  CRED_PENDING = 1,    // accepted, netTask has not started yet
+  CRED_CONNECTING = 2,
+  CRED_CONNECTED = 3,  // restart follows after CRED_RESTART_DELAY_MS
+  CRED_FAILED = 4
+};
+std::atomic<uint8_t> credJob(CRED_IDLE);
+String credSSID, credPassword;   // written before CRED_PENDING, read by netTask after
+unsigned long credStartMs = 0;
+unsigned long credDoneMs = 0;
+const unsigned long CRED_CONNECT_TIMEOUT_MS = 20000;
+const unsigned long CRED_RESTART_DELAY_MS = 1000; // lets the status request see "connected"
+
+// --- Splash / API URL overlay ---
+unsigned long overlayUntil = 0; // millis() when the overlay ends; 0 = deck visible
+
 // --- AP (fallback) ---
 bool apModeActive = false;
 String apSSID = "CheapDeck-Setup";
@@ -77,43 +570,414 @@ String savedPassword = String(PASSWORD);
 bool infoModeEnabled = true;
 unsigned long INFO_MODE_TIMEOUT = 120000; // 2 minutes default
 bool infoModeActive = false;
-unsigned long lastInfoUpdate = 0;
+unsigned long infoNextUpdate = 0; // millis() of the next info mode refresh
 const unsigned long INFO_UPDATE_INTERVAL = 1000; // Update every second
 bool infoModeFirstDraw = true; // Global flag for first draw
 
+// --- Clock ---
+// Wall-clock time is kept on the device. The system clock is set once, by
+// SNTP after WiFi comes up or from the epoch the host sends to /system-info,
+// and info mode formats it locally; the host only pushes CPU/RAM. The RTC
+// keeps counting through deep sleep, so the source and offset live in RTC
+// memory and a wake shows the right time before WiFi is back.
+#define NTP_SERVER "pool.ntp.org"
+enum ClockSource {
+  CLOCK_NONE = 0,
+  CLOCK_HOST = 1, // epoch from /system-info; replaced by SNTP when that succeeds
+  CLOCK_SNTP = 2
+};
+RTC_DATA_ATTR uint8_t clockSource = CLOCK_NONE;
+RTC_DATA_ATTR int32_t tzOffsetSec = 0;          // local time = UTC + offset, from the host
+unsigned long clockSyncedMs = 0;                // millis() of the last sync this boot
+const time_t CLOCK_MIN_EPOCH = 1600000000;      // anything earlier was never set
+const int32_t TZ_OFFSET_LIMIT = 14 * 3600;
+
+// Info mode text is laid out in character cells. A cell is as wide as its
+// own glyph, except that digits and spaces all take the digit width, so a
+// changing number never shifts its neighbours and "12:34:56" keeps its
+// natural spacing. Each glyph is pre-rasterized once into a 1-bit sprite and
+// pushed opaque with the text/background colors: a clock tick is one or two
+// cell blits instead of clearing and redrawing a screen-wide band, and
+// nothing flickers.
+#define INFO_GLYPHS "0123456789:-./% CPURAM"
+#define INFO_GLYPH_COUNT (sizeof(INFO_GLYPHS) - 1)
+#define INFO_ROW_MAX 16
+
+struct GlyphFont {
+  uint8_t font;
+  int16_t digitW, cellH;            // digitW = 0 until buildInfoGlyphs()
+  int16_t cellW[INFO_GLYPH_COUNT];
+  TFT_eSprite *glyph[INFO_GLYPH_COUNT];
+};
+GlyphFont infoFonts[] = {{2}, {4}};
+enum InfoFont { INFO_FONT_SMALL = 0, INFO_FONT_LARGE = 1 };
+
+struct TextRow {
+  uint8_t font;         // InfoFont
+  int8_t dy;            // cell center relative to the screen center
+  uint8_t len;          // cells on screen
+  int16_t x;            // left edge of the first cell
+  int16_t w;            // width of all cells
+  char shown[INFO_ROW_MAX + 1];
+};
+TextRow infoRows[] = {
+  {INFO_FONT_SMALL, -40}, // date
+  {INFO_FONT_LARGE, -10}, // time
+  {INFO_FONT_SMALL,  20}, // CPU
+  {INFO_FONT_SMALL,  40}, // RAM
+};
+enum InfoRow { INFO_ROW_DATE, INFO_ROW_TIME, INFO_ROW_CPU, INFO_ROW_RAM, INFO_ROW_COUNT };
+
+struct InfoRenderStats {
+  uint32_t frames;          // drawInfoMode() calls that pushed anything
+  uint32_t glyphBlits;      // cells pushed from the glyph cache
+  uint32_t glyphFallbacks;  // cells rasterized directly (not cached / no memory)
+  uint32_t lastFramePixels;
+  uint64_t totalPixels;
+} infoStats;
+
+// --- Button event ring ---
+// Fixed-size log of press/release events. One producer (the touch handler)
+// writes; readers (/events, /stream) copy slots without locking and detect
+// overwritten slots through the per-slot sequence number (seqlock style).
+#define EVENT_RING_SIZE 64 // must be a power of two
+
+enum ButtonEventType : uint8_t {
+  EVT_RELEASE = 0,
+  EVT_PRESS = 1
+};
+
+struct ButtonEvent {
+  uint32_t seq;
+  uint32_t ms;     // millis() when the event happened
+  uint8_t button;  // 0-based index
+  uint8_t type;    // ButtonEventType
+  bool state;      // toggle state after the event
+};
+
+struct EventSlot {
+  std::atomic<uint32_t> seq; // 0 while the slot is being written
+  ButtonEvent ev;
+};
+EventSlot eventRing[EVENT_RING_SIZE];
+std::atomic<uint32_t> eventSeq(0); // sequence number of the newest event (0 = none yet)
+
+// --- Push event stream (SSE on GET /stream) ---
+// Subscribers share one serialization: each push round formats new events,
+// the deck revision and (when needed) a state snapshot once, and queues the
+// same bytes to every client. Sockets are written without blocking, so a
+// client whose TCP window is full keeps the rest in its own queue instead of
+// stalling the others. When a queue would overflow, the message is dropped
+// and the client is marked for resync: once its queue drains it gets one
+// state snapshot that stands in for everything it missed.
+#define MAX_STREAM_CLIENTS 4          // slots; the "stream_clients" setting caps how many are used
+static_assert(MAX_STREAM_CLIENTS <= HTTP_MAX_SOCKETS - 2, "streams must leave a request socket to evict");
+#define STREAM_QUEUE_BYTES 1024       // per client; holds a 48-button snapshot
+const unsigned long STREAM_HEARTBEAT_MS = 15000;
+const unsigned long STREAM_RETRY_MS = 20;     // flush retries while a client has queued bytes
+
+struct StreamClient {
+  int fd;                // socket, -1 = free slot
+  uint32_t seq;          // newest event queued to the client
+  uint32_t deckRev;      // deck revision last announced
+  bool resync;           // messages were dropped: send a snapshot once the queue drains
+  uint16_t queued;       // bytes the socket has not taken yet
+  uint16_t highWater;
+  uint32_t drops;
+  char queue[STREAM_QUEUE_BYTES];
+};
+
+// Stream sockets are only touched in the HTTP server's task; netTask just
+// schedules pushStreamClients() there through httpd_queue_work().
+StreamClient streamClients[MAX_STREAM_CLIENTS];
+uint8_t streamClientCap = MAX_STREAM_CLIENTS;
+unsigned long lastStreamHeartbeat = 0;
+unsigned long lastStreamRound = 0;
+uint32_t streamForwardedSeq = 0;              // newest event pushStreamClients() has handled
+std::atomic<bool> streamBacklog(false);       // a client has queued bytes left
+std::atomic<bool> streamWorkQueued(false);
+
+struct StreamStats {
+  uint32_t rounds;         // push rounds run
+  uint32_t serialized;     // messages formatted; once each, whatever the client count
+  uint64_t bytesQueued;    // summed over clients
+  uint32_t deferred;       // sends the socket could not take in full
+  uint32_t drops;          // messages dropped for full queues
+  uint32_t resyncs;        // snapshots sent in place of dropped messages
+  uint32_t rejected;       // connections refused by the cap
+} streamStats;
+
+// --- Tasks ---
+// esp_http_server's task (core 0): HTTP handlers and stream client writes.
+// netTask (core 0): stream push scheduling, WiFi state machine, credential
+//   job, serial commands.
+// inputTask (core 1, highest priority): touch sampling only.
+// uiTask (core 1): owns the panel - touch handling, redraws, info mode,
+//   overlays, persistence and the sleep timer.
+// Requests to uiTask travel through SPSC queues, one per producing task
+// (input, HTTP server, net); the producer wakes uiTask with a task notification. Deck state
+// (buttons, colors, layout, settings, system info) is shared and guarded by
+// deckMutex; hold it through DeckLock, and never across network I/O.
+#define TOUCH_QUEUE_SIZE 16 // power of two
+#define UI_QUEUE_SIZE 16    // power of two
+const unsigned long UI_IDLE_MS = 50;         // uiTask wakes at least this often for timers
+const unsigned long TOUCH_IDLE_MS = 100;     // inputTask re-checks the IRQ line this often when idle
+const unsigned long NET_TICK_MS = 5;         // netTask period
+const unsigned long NET_IDLE_TICK_MS = 50;   // netTask period in the idle power tier
+const unsigned long UI_IDLE_SLEEP_MS = 250;  // uiTask timer wake-up in the idle power tier
+const uint32_t TASK_STATS_WINDOW_US = 1000000;
+
+// Bounded single-producer/single-consumer ring; push fails when full
+template <typename T, uint32_t N>
+struct SpscQueue {
+  T items[N];
+  std::atomic<uint32_t> head{0}; // written by the producer only
+  std::atomic<uint32_t> tail{0}; // written by the consumer only
+  uint32_t highWater = 0;        // most items ever queued at once
+  uint32_t drops = 0;            // pushes rejected because the queue was full
+
+  bool push(const T &item) {
+    uint32_t h = head.load(std::memory_order_relaxed);
+    uint32_t used = h - tail.load(std::memory_order_acquire);
+    if (used >= N) {
+      drops++;
+      return false;
+    }
+    items[h & (N - 1)] = item;
+    head.store(h + 1, std::memory_order_release);
+    if (used + 1 > highWater) highWater = used + 1;
+    return true;
+  }
+
+  bool pop(T &item) {
+    uint32_t t = tail.load(std::memory_order_relaxed);
+    if (t == head.load(std::memory_order_acquire)) return false;
+    item = items[t & (N - 1)];
+    tail.store(t + 1, std::memory_order_release);
+    return true;
+  }
+
+  uint32_t depth() const {
+    return head.load(std::memory_order_acquire) - tail.load(std::memory_order_acquire);
+  }
+};
+
+enum TouchMsgType : uint8_t {
+  TOUCH_MSG_PRESS = 0,
+  TOUCH_MSG_RELEASE = 1
+};
+
+struct TouchMsg {
+  uint8_t type;  // TouchMsgType
+  int16_t x, y;
+  uint32_t ms;   // millis() of the press / lift
+  uint32_t us;   // micros() of the press IRQ, 0 = unknown
+};
+
+enum UiCommand : uint8_t {
+  UI_REDRAW = 0,         // deck content changed
+  UI_RELAYOUT = 1,       // geometry changed, repaint everything
+  UI_RESET_INFO = 2,     // leave info mode
+  UI_SHOW_API_URL = 3,   // WiFi came up on a cold boot
+  UI_SHOW_AP_SCREEN = 4  // setup AP started
+};
+
+SpscQueue<TouchMsg, TOUCH_QUEUE_SIZE> touchQueue; // inputTask -> uiTask
+SpscQueue<uint8_t, UI_QUEUE_SIZE> uiQueue;        // HTTP handlers -> uiTask
+SpscQueue<uint8_t, UI_QUEUE_SIZE> netUiQueue;     // netTask -> uiTask
+
+SemaphoreHandle_t deckMutex = nullptr;
+
+struct DeckLock {
+  DeckLock() { xSemaphoreTakeRecursive(deckMutex, portMAX_DELAY); }
+  ~DeckLock() { xSemaphoreGiveRecursive(deckMutex); }
+};
+
+struct TaskStats {
+  const char *name;
+  uint8_t core;
+  TaskHandle_t handle;
+  uint32_t windowStartUs;
+  uint32_t busyUs;   // work time in the current window
+  uint8_t loadPct;   // share of the last full window spent working
+  Histogram iterUs;  // one observation per loop iteration / handler call
+};
+TaskStats netStats = {"net", 0};
+TaskStats inputStats = {"input", 1};
+TaskStats uiStats = {"ui", 1};
+TaskStats httpStats = {"http", 0}; // esp_http_server's task; busy time = handler time
+
+// --- Cached JSON responses (/state, /settings) ---
+// Bodies are serialized into fixed buffers, and only when the revision they
+// were built from is stale. markStatesDirty()/markSettingsDirty() bump the
+// revisions. Responses carry an ETag; a request whose If-None-Match matches
+// gets a bodyless 304.
+#define STATE_JSON_MAX (MAX_BUTTONS * 12 + 4)
+#define SETTINGS_JSON_MAX 1280
+
+template <size_t N>
+struct JsonCache {
+  char body[N];
+  size_t len;
+  uint32_t rev;   // revision the body was built from, 0 = never built
+  char etag[24];  // "\"<boot>-<rev>\""
+};
+JsonCache<STATE_JSON_MAX> stateJson;
+JsonCache<SETTINGS_JSON_MAX> settingsJson;
+uint32_t stateRev = 1;
+uint32_t settingsRev = 1;
+uint32_t bootTag = 0; // random per boot, so ETags from a previous boot never match
+
+// --- Deck revision ---
+// Bumped once per applied change to labels or settings, whichever endpoint
+// made it, and reported by /deck and /sync so clients can skip resending an
+// unchanged config. Starts at bootTag, so a revision a client kept from
+// before a restart never matches.
+uint32_t deckRev = 0;
+
+// What the apply*Json() calls of one request changed; commitDeckChange()
+// turns that into one dirty mark per blob, one revision and one UI command
+struct DeckChange {
+  bool labels;
+  bool settings;
+  bool layout;   // geometry changed: relayout instead of redraw
+};
+
+void rgb565ToHex(uint16_t color, char out[7]);
+
+// Appends into a fixed buffer; output is truncated, never overrun
+struct BufWriter {
+  char *buf;
+  size_t cap, len;
+  void add(const char *s) {
+    while (*s && len + 1 < cap) buf[len++] = *s++;
+    buf[len] = '\0';
+  }
+  void addUInt(uint32_t v) {
+    char tmp[11];
+    int n = 0;
+    do { tmp[n++] = '0' + v % 10; v /= 10; } while (v);
+    while (n && len + 1 < cap) buf[len++] = tmp[--n];
+    buf[len] = '\0';
+  }
+  void addHex(uint16_t color) {
+    char hex[7];
+    rgb565ToHex(color, hex);
+    add(hex);
+  }
+};
+
+struct HttpCacheStats {
+  uint32_t builds;       // bodies serialized
+  uint32_t hits;         // 200s served from an up-to-date body
+  uint32_t notModified;  // 304s
+} httpCacheStats;
+
 struct SystemInfo {
   String time;
   String date;
   float cpu;
   float ram;
-} systemInfo, previousSystemInfo;
+} systemInfo;
 
 // --- Forward declarations ---
 void drawButtons();
+void invalidateDeck();
+bool ensureFace(int slot, int i);
+void freeFace(int slot);
+uint32_t drawTile(int slot, int i, uint16_t color);
+void setupIcons();
+bool iconFits(int i);
+uint32_t drawIcon(int i);
+void handleIconUpload();
+void handleIconDelete();
+void handleDraw();
+void handleStats();
+void handleMetrics();
 void handleState();
+void handleStateBin();
+void handleStream();
+void handleEvents();
+uint32_t recordButtonEvent(int index, ButtonEventType type, unsigned long ms);
+bool readButtonEvent(uint32_t seq, ButtonEvent &out);
+uint32_t oldestEventSeq();
+void publishButtonEvent(int index, ButtonEventType type, unsigned long ms);
+void serviceStreamClients();
+void pushStreamClients(void *arg);
+void streamQueue(StreamClient &c, const char *data, size_t len);
+bool streamFlush(StreamClient &c);
+void streamDisconnect(StreamClient &c);
+esp_err_t onSocketOpen(httpd_handle_t hd, int fd);
+void onSocketClose(httpd_handle_t hd, int fd);
 void handleConfig();
 void handleSettings();
+void handleSync();
+void handleDeck();
+void handleGetDeck();
+bool validSettingsJson(JsonObject doc);
+bool validLabelsJson(JsonObject doc);
+bool applySettingsJson(JsonObject doc, DeckChange &change);
+bool applyLabelsJson(JsonObject doc, DeckChange &change);
+void commitDeckChange(const DeckChange &change);
+void applySystemInfoJson(JsonObject doc);
+void appendEventsJson(String &payload, uint32_t since);
 void handleGetSettings();
 void handleRoot();
 void handleSaveCredentials(); // <-- new
+void handleCredentialStatus();
+void serviceCredentialJob();
 void showApiUrlForStartup(const String &apiUrl, unsigned long ms);
 void showStartupScreen();
 void showAPModeScreen(); // <-- new
+void startWifi(bool coldBoot);
+void serviceWifi();
+void startClockSync();
+bool clockValid();
+const char *clockSourceName();
+void startAPMode();
+void closeOverlay();
 void enterDeepSleep();
 void saveStates();
+void markStatesDirty();
+void markSettingsDirty();
+void servicePersistence();
+void flushPersistence();
 void loadStates();
 void saveSettings();
 void loadSettings();
+void applySettingsBlob(SettingsBlob &blob);
+void applyButtonsBlob(ButtonsBlob &blob);
+bool restoreWarmState();
+void saveWarmState();
+bool readTouchRaw(int &rawX, int &rawY);
+void mapTouch(int rawX, int rawY, int &x, int &y);
+void queueTouch(TouchMsgType type, int x, int y, unsigned long ms, uint32_t us = 0);
 void initDefaultColors();
 uint16_t hexToRGB565(const String& hexColor);
 String rgb565ToHex(uint16_t color);
 void setupButtonLayout();
-int getButtonCount();
+void setupPower();
+void setPowerTier(uint8_t tier);
+void notePowerFrame();
+const char *powerModeName();
+bool validLayout(int cols, int rows, int pages);
+bool setLayout(int cols, int rows, int pages);
+int legacyLayoutId();
+int hitTestButton(int x, int y);
+void showPage(int page);
 void handleSystemInfo();
 void drawInfoMode();
 void fetchSystemInfo();
 void resetInfoMode();
 void handleSerialCommands(); // New: declaration for serial command handler
+void IRAM_ATTR onTouchIrq();
+void netTask(void *arg);
+void inputTask(void *arg);
+void uiTask(void *arg);
+void postUi(UiCommand cmd);
+void serviceTouch();
+void onTouchPress(int x, int y, unsigned long ms);
+void onTouchRelease(unsigned long ms);
 
 long clampLong(long v, long a, long b) {
   if (v < a) return a;
@@ -123,173 +987,416 @@ long clampLong(long v, long a, long b) {
 
 void setup() {
   Serial.begin(115200);
-  delay(100);
-
-  // Load saved settings and states
-  loadSettings();
-  loadStates();
+  bootTag = esp_random();
+  deckRev = bootTag;
+  deckMutex = xSemaphoreCreateRecursiveMutex();
+  setupPower();
 
-  // Check wakeup reason
+  // Check wakeup reason - a touch wake goes straight to the deck
   esp_sleep_wakeup_cause_t wakeup_reason = esp_sleep_get_wakeup_cause();
+  bool touchWake = wakeup_reason == ESP_SLEEP_WAKEUP_EXT0;
   Serial.printf("Wakeup reason: %d\n", wakeup_reason);
 
-  // Touch init
+  // Touch init first: a wake tap is short, sample it before it is gone
   mySpi.begin(XPT2046_CLK, XPT2046_MISO, XPT2046_MOSI, XPT2046_CS);
   ts.begin(mySpi);
   ts.setRotation(1);
+  pinMode(XPT2046_IRQ, INPUT);
+  if (touchWake) {
+    wakeTouch.ms = millis();
+    wakeTouch.valid = digitalRead(XPT2046_IRQ) == LOW && readTouchRaw(wakeTouch.rawX, wakeTouch.rawY);
+  }
+  attachInterrupt(digitalPinToInterrupt(XPT2046_IRQ), onTouchIrq, FALLING);
+
+  // Deck state: RTC snapshot on a touch wake, NVS otherwise
+  bool warm = touchWake && restoreWarmState();
+  if (!warm) {
+    loadSettings();
+    loadStates();
+  }
 
   // TFT init
   tft.init();
   tft.setRotation(1);
-
-  // Show startup screen
-  showStartupScreen();
+  iconStats.dma = tft.initDMA();
+  setupIcons();
 
   // Setup button layout based on current configuration
   setupButtonLayout();
+  if (warm && rtcWarm.page < layout.pages) currentPage = rtcWarm.page;
+  rtcWarm.magic = 0;
 
-  // WiFi - set hostname before connection
-  WiFi.setHostname("ESP32-CheapDeck");
-  WiFi.config(INADDR_NONE, INADDR_NONE, INADDR_NONE, INADDR_NONE);
-  WiFi.setHostname("ESP32-CheapDeck");
-  
-  Serial.printf("Connecting to WiFi: %s\n", savedSSID.c_str());
-  WiFi.begin(savedSSID.c_str(), savedPassword.c_str());
-  int tries = 0;
-  while (WiFi.status() != WL_CONNECTED && tries < 40) {
-    delay(500); Serial.print(".");
-    tries++;
+  // Splash on cold boot only; it is dismissed by a touch or after 2 s
+  if (touchWake) {
+    drawButtons();
+  } else {
+    showStartupScreen();
   }
-  Serial.println();
+  lastInteraction = millis();
 
-  String apiUrl;
-  if (WiFi.status() == WL_CONNECTED) {
-    String ip = WiFi.localIP().toString();
-    Serial.printf("Connected. IP: %s\n", ip.c_str());
-    Serial.printf("Hostname: ESP32-CheapDeck\n");
-    apiUrl = String("http://") + ip + String("/state");
-  } else {
-    Serial.println("No WiFi - entering AP setup mode.");
-    // Start SoftAP for configuration
-    WiFi.softAP(apSSID.c_str());
-    apModeActive = true;
-    IPAddress apIP = WiFi.softAPIP();
-    Serial.printf("AP started: %s - %s\n", apSSID.c_str(), apIP.toString().c_str());
-    apiUrl = String("http://") + apIP.toString() + String("/");
-    showAPModeScreen();
+  // The wake touch becomes a press; serviceTouch() sees the lift and releases it
+  if (wakeTouch.valid) {
+    mapTouch(wakeTouch.rawX, wakeTouch.rawY, touch.x, touch.y);
+    touch.downX = touch.x;
+    touch.downY = touch.y;
+    touch.downMs = wakeTouch.ms;
+    touch.lastSampleMs = millis();
+    touch.phase = TOUCH_HELD;
+    touchStats.irqs++;
+    queueTouch(TOUCH_MSG_PRESS, touch.x, touch.y, touch.downMs);
   }
+  Serial.printf("Resume: %s, wake touch %s\n", warm ? "warm (RTC)" : "cold (NVS)",
+                wakeTouch.valid ? "delivered" : "none");
+
+  // WiFi connects in the background (serviceWifi), using the cached BSSID/channel/IP when valid
+  startWifi(!touchWake);
 
   // Handlers
   server.on("/", HTTP_GET, handleRoot);
   server.on("/state", HTTP_GET, handleState);
+  server.on("/state.bin", HTTP_GET, handleStateBin);
+  server.on("/stream", HTTP_GET, handleStream);
+  server.on("/events", HTTP_GET, handleEvents);
+  server.on("/stats", HTTP_GET, handleStats);
+  server.on("/metrics", HTTP_GET, handleMetrics);
+  server.on("/icon", HTTP_POST, handleIconUpload);
+  server.on("/icon", HTTP_DELETE, handleIconDelete);
+  server.on("/draw", HTTP_POST, handleDraw);
   server.on("/config", HTTP_POST, handleConfig);
   server.on("/settings", HTTP_POST, handleSettings);
   server.on("/settings", HTTP_GET, handleGetSettings);
+  server.on("/deck", HTTP_POST, handleDeck);
+  server.on("/deck", HTTP_GET, handleGetDeck);
   server.on("/system-info", HTTP_POST, handleSystemInfo);
+  server.on("/sync", HTTP_POST, handleSync);
   server.on("/save-credentials", HTTP_POST, handleSaveCredentials); // <-- new
+  server.on("/save-credentials/status", HTTP_GET, handleCredentialStatus);
+  for (int i = 0; i < MAX_STREAM_CLIENTS; i++) streamClients[i].fd = -1;
   server.begin();
-  Serial.println("HTTP server started");
+  Serial.printf("HTTP server started, deck ready after %lu ms\n", millis());
+
+  xTaskCreatePinnedToCore(uiTask, "ui", 8192, nullptr, 2, &uiStats.handle, uiStats.core);
+  xTaskCreatePinnedToCore(inputTask, "input", 3072, nullptr, 3, &inputStats.handle, inputStats.core);
+  xTaskCreatePinnedToCore(netTask, "net", 8192, nullptr, 1, &netStats.handle, netStats.core);
+}
 
-  showApiUrlForStartup(apiUrl, 3000);
+void loop() {
+  // Everything runs in the tasks started by setup()
+  vTaskDelete(nullptr);
+}
 
-  // If we started in AP/config mode, restore AP setup screen after showing API URL
-  if (apModeActive) {
-    showAPModeScreen(); // keep AP configuration screen visible
-    lastInteraction = millis();
-  } else {
-    drawButtons();
-    lastInteraction = millis();
+// --- Task bodies ---
+void accountTask(TaskStats &t, uint32_t startUs) {
+  uint32_t now = micros();
+  t.iterUs.observe(now - startUs);
+  t.busyUs += now - startUs;
+  if (now - t.windowStartUs >= TASK_STATS_WINDOW_US) {
+    t.loadPct = (uint64_t)t.busyUs * 100 / (now - t.windowStartUs);
+    t.busyUs = 0;
+    t.windowStartUs = now;
   }
 }
 
-void loop() {
-  server.handleClient();
+void netTask(void *arg) {
+  for (;;) {
+    uint32_t start = micros();
+    serviceStreamClients();
+    serviceWifi();
+    serviceCredentialJob();
+    // Check serial for special commands (e.g. forget wifi)
+    handleSerialCommands();
+    accountTask(netStats, start);
+    vTaskDelay(pdMS_TO_TICKS(powerTier == POWER_IDLE ? NET_IDLE_TICK_MS : NET_TICK_MS));
+  }
+}
 
-  // Check serial for special commands (e.g. forget wifi)
-  handleSerialCommands();
-  
-  bool touchedNow = ts.touched();
+void inputTask(void *arg) {
+  for (;;) {
+    // Idle: sleep until the touch IRQ; touching: sample at the pipeline's pace
+    if (touch.phase == TOUCH_UP) {
+      ulTaskNotifyTake(pdTRUE, pdMS_TO_TICKS(TOUCH_IDLE_MS));
+    } else {
+      vTaskDelay(pdMS_TO_TICKS(2));
+    }
+    if (powerTier == POWER_IDLE && touchIrqPending) {
+      setPowerTier(POWER_ACTIVE); // full clock before sampling
+      powerStats.touchWakes++;
+    }
+    uint32_t start = micros();
+    serviceTouch();
+    accountTask(inputStats, start);
+  }
+}
 
-  if (touchedNow) {
-    TS_Point p = ts.getPoint();
-    int rawX = clampLong(p.x, TOUCH_MIN, TOUCH_MAX);
-    int rawY = clampLong(p.y, TOUCH_MIN, TOUCH_MAX);
-    int mappedX = map(rawX, TOUCH_MIN, TOUCH_MAX, 0, tft.width()-1);
-    int mappedY = map(rawY, TOUCH_MIN, TOUCH_MAX, 0, tft.height()-1);
+// Queues a request for uiTask from an HTTP handler or netTask; each has its own queue
+void postUi(UiCommand cmd) {
+  uint8_t c = cmd;
+  SpscQueue<uint8_t, UI_QUEUE_SIZE> &q = xTaskGetCurrentTaskHandle() == netStats.handle ? netUiQueue : uiQueue;
+  if (q.push(c) && uiStats.handle) xTaskNotifyGive(uiStats.handle);
+}
+
+void handleUiCommand(uint8_t cmd) {
+  switch (cmd) {
+    case UI_REDRAW:
+      if (!infoModeActive) drawButtons();
+      break;
+    case UI_RELAYOUT:
+      invalidateDeck();
+      if (!infoModeActive) drawButtons();
+      break;
+    case UI_RESET_INFO:
+      if (infoModeActive) resetInfoMode();
+      break;
+    case UI_SHOW_API_URL:
+      // Cold boot: show where the API lives, unless the user is already using the deck
+      if (!infoModeActive && lastInteraction <= wifiStartMs) {
+        showApiUrlForStartup(String("http://") + WiFi.localIP().toString() + String("/state"), 3000);
+      }
+      break;
+    case UI_SHOW_AP_SCREEN:
+      if (!overlayUntil) showAPModeScreen(); // otherwise shown when the overlay closes
+      break;
+  }
+}
+
+void uiTask(void *arg) {
+  for (;;) {
+    unsigned long wait = powerTier == POWER_IDLE ? UI_IDLE_SLEEP_MS : UI_IDLE_MS;
+    if (infoModeActive) wait = min(wait, (unsigned long)max(0L, (long)(infoNextUpdate - millis())));
+    ulTaskNotifyTake(pdTRUE, pdMS_TO_TICKS(wait));
+    uint32_t start = micros();
+    DeckLock lock;
+
+    TouchMsg t;
+    while (touchQueue.pop(t)) {
+      if (t.type == TOUCH_MSG_PRESS) {
+        pressStartUs = t.us;
+        onTouchPress(t.x, t.y, t.ms);
+        pressStartUs = 0; // a press that drew nothing is not measured
+      }
+      else onTouchRelease(t.ms);
+    }
+    uint8_t cmd;
+    while (uiQueue.pop(cmd)) handleUiCommand(cmd);
+    while (netUiQueue.pop(cmd)) handleUiCommand(cmd);
+
+    servicePersistence();
+
+    // Splash / API URL screen timed out → back to the deck
+    if (overlayUntil && (long)(millis() - overlayUntil) >= 0) {
+      closeOverlay();
+    }
+
+    // Check if should enter info mode
+    if (infoModeEnabled && !infoModeActive && !screensaverActive && !overlayUntil &&
+        (millis() - lastInteraction > INFO_MODE_TIMEOUT)) {
+      infoModeActive = true;
+      infoModeFirstDraw = true;
+      drawInfoMode();
+    }
+
+    // Update info mode if active
+    if (infoModeActive && (long)(millis() - infoNextUpdate) >= 0) {
+      drawInfoMode();
+    }
 
-    if (p.z > 0) {
-      unsigned long now = millis();
-      lastInteraction = now;
+    // Idle power tier; inputTask brings it back on the next touch
+    if (powerTier == POWER_ACTIVE && !overlayUntil && touch.phase == TOUCH_UP &&
+        millis() - lastInteraction > IDLE_TIER_TIMEOUT && millis() - powerWakeMs > IDLE_TIER_TIMEOUT) {
+      setPowerTier(POWER_IDLE);
+    }
 
-      // If info mode was active → return to buttons
+    // Deep sleep - check after info mode
+    if (!screensaverActive && 
+        (millis() - lastInteraction > SCREENSAVER_TIMEOUT)) {
+      
+      // If info mode is active, first turn it off
       if (infoModeActive) {
-        resetInfoMode();
+        infoModeActive = false;
+      }
+      
+      enterDeepSleep();
+    }
+    accountTask(uiStats, start);
+  }
+}
+
+// --- Touch pipeline ---
+void IRAM_ATTR onTouchIrq() {
+  touchIrqPending = true;
+  touchIrqMs = millis();
+  touchIrqUs = micros();
+  if (powerTier.load(std::memory_order_relaxed) == POWER_IDLE) {
+    if (!wakeIrqUs) wakeIrqUs = micros() | 1;
+    // Armed as a light-sleep wake source the pin is level triggered: mask it
+    // until inputTask restores the edge interrupt
+    if (touchWakeArmed) GPIO.pin[XPT2046_IRQ].int_ena = 0;
+  }
+  if (inputStats.handle) {
+    BaseType_t woken = pdFALSE;
+    vTaskNotifyGiveFromISR(inputStats.handle, &woken);
+    portYIELD_FROM_ISR(woken);
+  }
+}
+
+// Hands a press/release to uiTask
+void queueTouch(TouchMsgType type, int x, int y, unsigned long ms, uint32_t us) {
+  TouchMsg m = {(uint8_t)type, (int16_t)x, (int16_t)y, (uint32_t)ms, us};
+  if (touchQueue.push(m) && uiStats.handle) xTaskNotifyGive(uiStats.handle);
+}
+
+// Oversampled raw read; false if too few readings had pressure (finger lifting, noise)
+bool readTouchRaw(int &rawX, int &rawY) {
+  int xs[TOUCH_OVERSAMPLE], ys[TOUCH_OVERSAMPLE];
+  int n = 0;
+  for (int i = 0; i < TOUCH_OVERSAMPLE; i++) {
+    TS_Point p = ts.getPoint();
+    if (p.z <= 0) continue;
+    // insertion sort as we go; n is tiny
+    int j = n++;
+    for (; j > 0 && xs[j-1] > p.x; j--) xs[j] = xs[j-1];
+    xs[j] = p.x;
+    j = n - 1;
+    for (; j > 0 && ys[j-1] > p.y; j--) ys[j] = ys[j-1];
+    ys[j] = p.y;
+  }
+  touchStats.samples++;
+  if (n < TOUCH_OVERSAMPLE / 2 + 1) {
+    touchStats.rejected++;
+    return false;
+  }
+  rawX = clampLong(xs[n/2], TOUCH_MIN, TOUCH_MAX);
+  rawY = clampLong(ys[n/2], TOUCH_MIN, TOUCH_MAX);
+  return true;
+}
+
+// Raw panel coordinates to screen pixels
+void mapTouch(int rawX, int rawY, int &x, int &y) {
+  x = map(rawX, TOUCH_MIN, TOUCH_MAX, 0, tft.width()-1);
+  y = map(rawY, TOUCH_MIN, TOUCH_MAX, 0, tft.height()-1);
+}
+
+bool readTouchPoint(int &x, int &y) {
+  int rawX, rawY;
+  if (!readTouchRaw(rawX, rawY)) return false;
+  mapTouch(rawX, rawY, x, y);
+  return true;
+}
+
+void serviceTouch() {
+  bool down = digitalRead(XPT2046_IRQ) == LOW;
+  unsigned long now = millis();
+
+  switch (touch.phase) {
+    case TOUCH_UP:
+      if (!down && !touchIrqPending) return;
+      touchStats.irqs++;
+      touch.downMs = touchIrqPending ? touchIrqMs : now;
+      touch.downUs = touchIrqPending ? touchIrqUs : micros();
+      touchIrqPending = false;
+      touch.phase = TOUCH_DOWN;
+      // fall through - try to get the first sample right away
+
+    case TOUCH_DOWN:
+      if (!down) {
+        touch.phase = TOUCH_UP; // glitch or a tap too short to sample
         return;
       }
+      if (!readTouchPoint(touch.x, touch.y)) return;
+      touch.downX = touch.x;
+      touch.downY = touch.y;
+      touch.lastSampleMs = now;
+      touch.phase = TOUCH_HELD;
+      queueTouch(TOUCH_MSG_PRESS, touch.x, touch.y, touch.downMs, touch.downUs);
+      return;
 
-      // If screensaver was active → wake up screen
-      if (screensaverActive) {
-        screensaverActive = false;
-        drawButtons();
+    case TOUCH_HELD:
+      if (!down) {
+        touch.liftMs = now;
+        touch.phase = TOUCH_LIFTING;
         return;
       }
+      if (now - touch.lastSampleMs >= TOUCH_SAMPLE_INTERVAL_MS) {
+        readTouchPoint(touch.x, touch.y);
+        touch.lastSampleMs = now;
+      }
+      return;
 
-      for (int i = 0; i < buttonCount; i++) {
-        Btn &b = buttons[i];
-        if (mappedX >= b.x && mappedX <= (b.x + b.size -1) &&
-            mappedY >= b.y && mappedY <= (b.y + b.size -1)) {
-          if (now - b.lastToggleMs > toggleDebounceMs) {
-            b.state = !b.state;
-            b.lastToggleMs = now;
-            drawButtons();
-            saveStates();
-            Serial.printf("Button %d toggled -> %s\n", i+1, b.state?"true":"false");
-            break;
-          }
-        }
+    case TOUCH_LIFTING:
+      if (down) {
+        touch.phase = TOUCH_HELD; // bounce while lifting, still the same touch
+        return;
       }
-    }
+      if (now - touch.liftMs >= TOUCH_RELEASE_MS) {
+        touch.phase = TOUCH_UP;
+        touchIrqPending = false;
+        queueTouch(TOUCH_MSG_RELEASE, touch.x, touch.y, touch.liftMs);
+      }
+      return;
+  }
+}
+
+void onTouchPress(int x, int y, unsigned long ms) {
+  lastInteraction = millis();
+  touch.button = -1;
+  touchStats.presses++;
+
+  // A touch dismisses the splash / API URL screen
+  if (overlayUntil) {
+    closeOverlay();
+    return;
   }
 
-  // Check if should enter info mode
-  if (infoModeEnabled && !infoModeActive && !screensaverActive && 
-      (millis() - lastInteraction > INFO_MODE_TIMEOUT)) {
-    infoModeActive = true;
-    infoModeFirstDraw = true;
-    
-    // Reset data to force full refresh
-    previousSystemInfo.time = "";
-    previousSystemInfo.date = "";
-    previousSystemInfo.cpu = -1;
-    previousSystemInfo.ram = -1;
-    
-    drawInfoMode();
+  // If info mode was active → return to buttons
+  if (infoModeActive) {
+    resetInfoMode();
+    return;
   }
 
-  // Update info mode if active
-  if (infoModeActive && (millis() - lastInfoUpdate > INFO_UPDATE_INTERVAL)) {
-    drawInfoMode();
-    lastInfoUpdate = millis();
+  // If screensaver was active → wake up screen
+  if (screensaverActive) {
+    screensaverActive = false;
+    drawButtons();
+    return;
   }
 
-  // Deep sleep - check after info mode
-  if (!screensaverActive && 
-      (millis() - lastInteraction > SCREENSAVER_TIMEOUT)) {
-    
-    // If info mode is active, first turn it off
-    if (infoModeActive) {
-      infoModeActive = false;
-    }
-    
-    enterDeepSleep();
+  int i = hitTestButton(x, y);
+  if (i == HIT_PAGE_PREV || i == HIT_PAGE_NEXT) {
+    // Page bar wraps around in both directions
+    int step = i == HIT_PAGE_NEXT ? 1 : layout.pages - 1;
+    showPage((currentPage + step) % layout.pages);
+    return;
+  }
+  if (i < 0) return;
+  Btn &b = buttons[i];
+  // A button never released since layout cannot be bouncing (the wake tap lands here)
+  if (b.lastReleaseMs && ms - b.lastReleaseMs < b.debounceMs) {
+    touchStats.debounced++;
+    return;
   }
+
+  touch.button = i;
+  b.state = !b.state;
+  publishButtonEvent(i, EVT_PRESS, ms);
+  drawButtons();
+  markStatesDirty();
+  Serial.printf("Button %d pressed -> %s\n", i+1, b.state?"true":"false");
+}
+
+void onTouchRelease(unsigned long ms) {
+  touchStats.releases++;
+  lastInteraction = millis();
+  if (touch.button < 0) return;
+  buttons[touch.button].lastReleaseMs = ms;
+  publishButtonEvent(touch.button, EVT_RELEASE, ms);
+  touch.button = -1;
 }
 
 // --- Helper function to reset info mode ---
 void resetInfoMode() {
   infoModeActive = false;
   infoModeFirstDraw = true;
-  tft.fillScreen(colors.background);
+  invalidateDeck();
   drawButtons();
 }
 
@@ -309,12 +1416,36 @@ void handleSystemInfo() {
     return;
   }
   
+  {
+    DeckLock lock;
+    applySystemInfoJson(doc.as<JsonObject>());
+  }
+  // Tells the host whether it still needs to send an epoch, and which offset
+  // is in use (it resets to 0 on a power cycle, so the host resends it)
+  server.send(200, "application/json", String("{\"clock\":\"") + clockSourceName() +
+                                       "\",\"tz_offset\":" + String(tzOffsetSec) + "}");
+}
+
+void applySystemInfoJson(JsonObject doc) {
   if (doc.containsKey("time")) systemInfo.time = doc["time"].as<String>();
   if (doc.containsKey("date")) systemInfo.date = doc["date"].as<String>();
   if (doc.containsKey("cpu")) systemInfo.cpu = doc["cpu"].as<float>();
   if (doc.containsKey("ram")) systemInfo.ram = doc["ram"].as<float>();
-  
-  server.send(200, "text/plain", "OK");
+
+  if (doc.containsKey("tz_offset")) {
+    int32_t tz = doc["tz_offset"].as<int32_t>();
+    if (abs(tz) <= TZ_OFFSET_LIMIT) tzOffsetSec = tz;
+  }
+  // SNTP wins over the host; the epoch only sets a clock SNTP has not
+  if (doc.containsKey("epoch") && clockSource != CLOCK_SNTP) {
+    time_t epoch = doc["epoch"].as<uint32_t>();
+    if (epoch > CLOCK_MIN_EPOCH) {
+      struct timeval tv = {epoch, 0};
+      settimeofday(&tv, nullptr);
+      clockSource = CLOCK_HOST;
+      clockSyncedMs = millis();
+    }
+  }
 }
 
 void fetchSystemInfo() {
@@ -322,112 +1453,955 @@ void fetchSystemInfo() {
   // To będzie obsługiwane przez Python który wyśle dane przez POST /system-info
 }
 
-void drawInfoMode() {
-  // Check if data changed
-  bool timeChanged = systemInfo.time != previousSystemInfo.time;
-  bool dateChanged = systemInfo.date != previousSystemInfo.date;
-  bool cpuChanged = abs(systemInfo.cpu - previousSystemInfo.cpu) > 0.1;
-  bool ramChanged = abs(systemInfo.ram - previousSystemInfo.ram) > 0.1;
-  
-  // If first call, draw everything
-  if (infoModeFirstDraw) {
-    tft.fillScreen(colors.background);
-    infoModeFirstDraw = false;
-    timeChanged = dateChanged = cpuChanged = ramChanged = true;
-  }
-  
-  tft.setTextColor(TFT_WHITE, colors.background);
-  tft.setTextDatum(MC_DATUM);
-  
-  int centerX = tft.width() / 2;
-  int centerY = tft.height() / 2;
-  
-  // Draw only changed elements
-  if (dateChanged) {
-    tft.fillRect(0, centerY - 60, tft.width(), 30, colors.background);
-    tft.drawString(systemInfo.date, centerX, centerY - 40, 2);
-  }
-  
-  if (timeChanged) {
-    tft.fillRect(0, centerY - 30, tft.width(), 40, colors.background);
-    tft.drawString(systemInfo.time, centerX, centerY - 10, 4);
-  }
-  
-  if (cpuChanged) {
-    tft.fillRect(0, centerY + 5, tft.width(), 25, colors.background);
-    String cpuText = "CPU: " + String(systemInfo.cpu, 1) + "%";
-    tft.drawString(cpuText, centerX, centerY + 20, 2);
-  }
-  
-  if (ramChanged) {
-    tft.fillRect(0, centerY + 25, tft.width(), 25, colors.background);
-    String ramText = "RAM: " + String(systemInfo.ram, 1) + "%";
-    tft.drawString(ramText, centerX, centerY + 40, 2);
+// Rasterizes the info mode glyphs once; cells stay empty if a sprite cannot be allocated
+void buildInfoGlyphs() {
+  for (GlyphFont &g : infoFonts) {
+    if (g.digitW) continue;
+    for (char c = '0'; c <= '9'; c++) g.digitW = max(g.digitW, tft.textWidth(String(c), g.font));
+    g.cellH = tft.fontHeight(g.font);
+    for (size_t k = 0; k < INFO_GLYPH_COUNT; k++) {
+      char c = INFO_GLYPHS[k];
+      g.cellW[k] = isdigit((unsigned char)c) || c == ' ' ? g.digitW : tft.textWidth(String(c), g.font);
+      TFT_eSprite *spr = new TFT_eSprite(&tft);
+      spr->setColorDepth(1);
+      if (!spr->createSprite(g.cellW[k], g.cellH)) {
+        delete spr;
+        continue;
+      }
+      spr->fillSprite(0);
+      spr->setTextColor(1);
+      spr->setTextDatum(TC_DATUM);
+      spr->drawString(String(c), g.cellW[k]/2, 0, g.font);
+      g.glyph[k] = spr;
+    }
   }
-  
-  // Save current values as previous
-  previousSystemInfo = systemInfo;
 }
 
-// --- Setup button layout ---
-void setupButtonLayout() {
-  int w = tft.width();
-  int h = tft.height();
-  int margin = max(8, min(w, h)/20);
-  
-  buttonCount = getButtonCount();
-  
-  if (currentLayout == LAYOUT_2x2) {
-    // Layout 2x2
-    int availableW = w - margin*3;
-    int availableH = h - margin*3;
-    int btnSize = min(availableW/2, availableH/2);
-    int startX = (w - (btnSize*2 + margin))/2;
-    int startY = (h - (btnSize*2 + margin))/2;
-
-    for (int i = 0; i < 4; i++) {
-      buttons[i].x = startX + (i%2)*(btnSize + margin);
-      buttons[i].y = startY + (i/2)*(btnSize + margin);
-      buttons[i].size = btnSize;
-      buttons[i].lastToggleMs = 0;
-      if (buttons[i].label=="") buttons[i].label = String(i+1);
-    }
-  } else if (currentLayout == LAYOUT_3x2) {
-    // Layout 3x2 (3 columns, 2 rows)
-    int availableW = w - margin*4;
-    int availableH = h - margin*3;
-    int btnSize = min(availableW/3, availableH/2);
-    int startX = (w - (btnSize*3 + margin*2))/2;
-    int startY = (h - (btnSize*2 + margin))/2;
+// Cell width for c; characters outside INFO_GLYPHS (strings from an older host) get their own width
+int infoCellWidth(GlyphFont &g, char c) {
+  const char *hit = c ? strchr(INFO_GLYPHS, c) : nullptr;
+  if (hit) return g.cellW[hit - INFO_GLYPHS];
+  return c ? tft.textWidth(String(c), g.font) : 0;
+}
 
-    for (int i = 0; i < 6; i++) {
-      buttons[i].x = startX + (i%3)*(btnSize + margin);
-      buttons[i].y = startY + (i/3)*(btnSize + margin);
-      buttons[i].size = btnSize;
-      buttons[i].lastToggleMs = 0;
-      if (buttons[i].label=="") buttons[i].label = String(i+1);
-    }
+// Pushes one character cell opaque; returns pixels pushed
+uint32_t drawInfoCell(GlyphFont &g, char c, int x, int y, int w) {
+  const char *hit = strchr(INFO_GLYPHS, c);
+  TFT_eSprite *spr = (c && hit) ? g.glyph[hit - INFO_GLYPHS] : nullptr;
+  if (spr) {
+    spr->setBitmapColor(TFT_WHITE, colors.background);
+    spr->pushSprite(x, y);
+    infoStats.glyphBlits++;
+  } else {
+    tft.fillRect(x, y, w, g.cellH, colors.background);
+    tft.setTextColor(TFT_WHITE, colors.background);
+    tft.setTextDatum(TC_DATUM);
+    if (c > ' ') tft.drawString(String(c), x + w/2, y, g.font);
+    infoStats.glyphFallbacks++;
   }
+  return (uint32_t)w * g.cellH;
 }
 
-int getButtonCount() {
-  return (currentLayout == LAYOUT_2x2) ? 4 : 6;
-}
+// Brings one row up to date, touching only the cells whose character changed
+uint32_t drawInfoRow(TextRow &row, const char *text) {
+  GlyphFont &g = infoFonts[row.font];
+  int len = min((int)strlen(text), INFO_ROW_MAX);
+  int y = tft.height()/2 + row.dy - g.cellH/2;
+  uint32_t pixels = 0;
+
+  int cellW[INFO_ROW_MAX];
+  int w = 0;
+  bool reshaped = len != row.len;
+  for (int k = 0; k < len; k++) {
+    cellW[k] = infoCellWidth(g, text[k]);
+    w += cellW[k];
+    if (cellW[k] != infoCellWidth(g, row.shown[k])) reshaped = true;
+  }
+
+  if (reshaped) {
+    // Cell widths changed: the row re-centers, so every cell is new
+    if (row.len) {
+      tft.fillRect(row.x, y, row.w, g.cellH, colors.background);
+      pixels += (uint32_t)row.w * g.cellH;
+    }
+    row.len = len;
+    row.w = w;
+    row.x = tft.width()/2 - w / 2;
+    memset(row.shown, 0, sizeof(row.shown));
+  }
+
+  int x = row.x;
+  for (int k = 0; k < len; k++) {
+    if (row.shown[k] != text[k]) {
+      pixels += drawInfoCell(g, text[k], x, y, cellW[k]);
+      row.shown[k] = text[k];
+    }
+    x += cellW[k];
+  }
+  return pixels;
+}
+
+void drawInfoMode() {
+  // If first call, draw everything
+  if (infoModeFirstDraw) {
+    invalidateDeck();
+    buildInfoGlyphs();
+    tft.fillScreen(colors.background);
+    for (TextRow &row : infoRows) row.len = 0;
+    infoModeFirstDraw = false;
+  }
+
+  // Local clock when set; otherwise whatever strings an older host sent
+  char timeText[9], dateText[11];
+  const char *timeStr = systemInfo.time.c_str();
+  const char *dateStr = systemInfo.date.c_str();
+  unsigned long interval = INFO_UPDATE_INTERVAL;
+  if (clockValid()) {
+    struct timeval tv;
+    gettimeofday(&tv, nullptr);
+    time_t local = tv.tv_sec + tzOffsetSec;
+    struct tm t;
+    gmtime_r(&local, &t);
+    strftime(timeText, sizeof(timeText), "%H:%M:%S", &t);
+    strftime(dateText, sizeof(dateText), "%Y-%m-%d", &t);
+    timeStr = timeText;
+    dateStr = dateText;
+    interval = 1000 - tv.tv_usec / 1000 + 2; // land just after the next second ticks
+  }
+  infoNextUpdate = millis() + interval;
+
+  // Fixed-width numbers keep the rows from re-centering as values change
+  char cpuText[INFO_ROW_MAX + 1], ramText[INFO_ROW_MAX + 1];
+  snprintf(cpuText, sizeof(cpuText), "CPU: %5.1f%%", systemInfo.cpu);
+  snprintf(ramText, sizeof(ramText), "RAM: %5.1f%%", systemInfo.ram);
+
+  uint32_t pixels = 0;
+  pixels += drawInfoRow(infoRows[INFO_ROW_DATE], dateStr);
+  pixels += drawInfoRow(infoRows[INFO_ROW_TIME], timeStr);
+  pixels += drawInfoRow(infoRows[INFO_ROW_CPU], cpuText);
+  pixels += drawInfoRow(infoRows[INFO_ROW_RAM], ramText);
+
+  if (pixels) {
+    infoStats.frames++;
+    infoStats.lastFramePixels = pixels;
+    infoStats.totalPixels += pixels;
+    notePowerFrame();
+  }
+}
+
+// --- Setup button layout ---
+// Computes tile geometry for the current grid and rebuilds the hit-test tables.
+void setupButtonLayout() {
+  int w = min((int)tft.width(), MAX_SCREEN_DIM);
+  int h = min((int)tft.height(), MAX_SCREEN_DIM);
+  int margin = max(8, min(w, h)/20);
+  int cols = layout.cols, rows = layout.rows;
+  int navH = layout.pages > 1 ? NAV_BAR_H : 0;
+
+  slotsPerPage = cols * rows;
+  buttonCount = slotsPerPage * layout.pages;
+  if (currentPage >= layout.pages) currentPage = 0;
+
+  int availableW = w - margin*(cols + 1);
+  int availableH = h - navH - margin*(rows + 1);
+  int btnSize = min(availableW/cols, availableH/rows);
+  int startX = (w - (btnSize*cols + margin*(cols - 1)))/2;
+  int startY = (h - navH - (btnSize*rows + margin*(rows - 1)))/2;
+
+  for (int i = 0; i < MAX_BUTTONS; i++) {
+    int slot = i % slotsPerPage;
+    buttons[i].x = startX + (slot%cols)*(btnSize + margin);
+    buttons[i].y = startY + (slot/cols)*(btnSize + margin);
+    buttons[i].size = btnSize;
+    buttons[i].lastReleaseMs = 0;
+    if (buttons[i].label=="") buttons[i].label = String(i+1);
+  }
+
+  memset(hitCol, HIT_GAP, sizeof(hitCol));
+  memset(hitRow, HIT_GAP, sizeof(hitRow));
+  for (int c = 0; c < cols; c++) {
+    int x0 = startX + c*(btnSize + margin);
+    memset(hitCol + x0, c, btnSize);
+  }
+  for (int r = 0; r < rows; r++) {
+    int y0 = startY + r*(btnSize + margin);
+    memset(hitRow + y0, r, btnSize);
+  }
+  if (navH) memset(hitRow + (h - navH), HIT_NAV, navH);
+}
+
+// Validates and applies a grid; false if it does not fit the limits
+bool validLayout(int cols, int rows, int pages) {
+  return cols >= 1 && cols <= MAX_COLS && rows >= 1 && rows <= MAX_ROWS &&
+         pages >= 1 && pages <= MAX_PAGES && cols * rows * pages <= MAX_BUTTONS;
+}
+
+bool setLayout(int cols, int rows, int pages) {
+  if (!validLayout(cols, rows, pages)) return false;
+  layout.cols = cols;
+  layout.rows = rows;
+  layout.pages = pages;
+  return true;
+}
+
+int legacyLayoutId() {
+  if (layout.pages == 1 && layout.rows == 2 && layout.cols == 2) return LAYOUT_2x2;
+  if (layout.pages == 1 && layout.rows == 2 && layout.cols == 3) return LAYOUT_3x2;
+  return LAYOUT_CUSTOM;
+}
+
+// Resolves a screen point to a button index (current page), a page-bar
+// action (HIT_PAGE_PREV/NEXT) or -1
+int hitTestButton(int x, int y) {
+  if (x < 0 || y < 0 || x >= MAX_SCREEN_DIM || y >= MAX_SCREEN_DIM) return -1;
+  uint8_t c = hitCol[x], r = hitRow[y];
+  if (r == HIT_NAV) return x < tft.width()/2 ? HIT_PAGE_PREV : HIT_PAGE_NEXT;
+  if (c == HIT_GAP || r == HIT_GAP) return -1;
+  return currentPage * slotsPerPage + r * layout.cols + c;
+}
+
+// Switches the visible page; the renderer only repaints tiles that differ
+void showPage(int page) {
+  if (page < 0 || page >= layout.pages || page == currentPage) return;
+  currentPage = page;
+  Serial.printf("Page %d/%d\n", currentPage + 1, layout.pages);
+  if (!infoModeActive && !apModeActive && !overlayUntil) drawButtons();
+}
 
 // --- Draw buttons ---
+// Repaints only the tiles that differ from what is on the panel. A full
+// clear happens only when the deck was covered by another screen or the
+// background color changed.
 void drawButtons() {
-  tft.fillScreen(colors.background);
+  uint32_t pixels = 0;
+  int tiles = 0;
 
-  for (int i = 0; i < buttonCount; i++) {
+  if (!deckOnScreen || drawnBackground != colors.background) {
+    tft.fillScreen(colors.background);
+    pixels += (uint32_t)tft.width() * tft.height();
+    for (int s = 0; s < MAX_SLOTS; s++) drawnTiles[s].valid = false;
+    drawnBackground = colors.background;
+    drawnPage = -1;
+    deckOnScreen = true;
+    renderStats.fullRepaints++;
+  }
+
+  for (int s = 0; s < MAX_SLOTS; s++) {
+    TileSnapshot &t = drawnTiles[s];
+
+    if (s >= slotsPerPage) {
+      // Slot no longer part of the layout
+      if (t.valid) {
+        tft.fillRect(t.x, t.y, t.size, t.size, colors.background);
+        pixels += (uint32_t)t.size * t.size;
+        t.valid = false;
+      }
+      freeFace(s);
+      continue;
+    }
+
+    int i = currentPage * slotsPerPage + s;
     Btn &b = buttons[i];
     uint16_t color = b.state ? colors.active : colors.normal[i]; // Use proper color for each button
-    tft.fillRect(b.x, b.y, b.size, b.size, color);
-    tft.drawRect(b.x, b.y, b.size, b.size, TFT_WHITE);
+    bool moved = t.x != b.x || t.y != b.y || t.size != b.size;
+    uint32_t iconRev = iconFits(i) ? icons[i].rev : 0;
+    if (t.valid && !moved && t.color == color && t.label == b.label && t.iconRev == iconRev) continue;
+
+    if (t.valid && moved) {
+      tft.fillRect(t.x, t.y, t.size, t.size, colors.background);
+      pixels += (uint32_t)t.size * t.size;
+    }
+
+    pixels += drawTile(s, i, color);
+    tiles++;
+
+    t.valid = true;
+    t.x = b.x; t.y = b.y; t.size = b.size;
+    t.color = color;
+    t.label = b.label;
+    t.iconRev = iconRev;
+  }
+
+  // Page bar: "< 2/3 >" along the bottom edge
+  int barPage = layout.pages > 1 ? currentPage : -1;
+  if (barPage != drawnPage) {
+    int barY = tft.height() - NAV_BAR_H;
+    tft.fillRect(0, barY, tft.width(), NAV_BAR_H, colors.background);
+    pixels += (uint32_t)tft.width() * NAV_BAR_H;
+    if (barPage >= 0) {
+      tft.setTextDatum(MC_DATUM);
+      tft.setTextColor(TFT_WHITE);
+      int cy = barY + NAV_BAR_H/2;
+      tft.drawString("<", tft.width()/4, cy, 2);
+      tft.drawString(String(currentPage + 1) + "/" + String(layout.pages), tft.width()/2, cy, 2);
+      tft.drawString(">", tft.width()*3/4, cy, 2);
+    }
+    drawnPage = barPage;
+  }
+
+  if (pixels > 0) {
+    renderStats.frames++;
+    renderStats.tilesDrawn += tiles;
+    renderStats.lastFramePixels = pixels;
+    renderStats.totalPixels += pixels;
+    if (pixels > renderStats.maxFramePixels) renderStats.maxFramePixels = pixels;
+    metrics.redrawPixels.observe(pixels);
+    if (pressStartUs) {
+      metrics.touchToDisplayUs.observe(micros() - pressStartUs);
+      pressStartUs = 0;
+    }
+    notePowerFrame();
+  }
+}
+
+// Pushes button i into its slot, from the face cache when possible; returns pixels pushed.
+// With an icon the face carries no label and the icon is streamed on top.
+uint32_t drawTile(int slot, int i, uint16_t color) {
+  Btn &b = buttons[i];
+  bool icon = iconFits(i);
+
+  if (ensureFace(slot, i)) {
+    FaceCache &f = faceCache[slot];
+    if (f.mono) {
+      f.face[0]->setBitmapColor(TFT_WHITE, color);
+      f.face[0]->pushSprite(b.x, b.y);
+    } else {
+      f.face[b.state ? 1 : 0]->pushSprite(b.x, b.y);
+    }
+    renderStats.faceBlits++;
+    return (uint32_t)b.size * b.size + (icon ? drawIcon(i) : 0);
+  }
+
+  renderStats.faceFallbacks++;
+  tft.fillRect(b.x, b.y, b.size, b.size, color);
+  tft.drawRect(b.x, b.y, b.size, b.size, TFT_WHITE);
+  if (icon) return (uint32_t)b.size * b.size + 4 * b.size + drawIcon(i);
+  tft.setTextDatum(MC_DATUM);
+  tft.setTextColor(TFT_WHITE);
+  tft.drawString(b.label, b.x + b.size/2, b.y + b.size/2, 2); // label
+  return (uint32_t)b.size * b.size + 4 * b.size + (uint32_t)tft.textWidth(b.label, 2) * tft.fontHeight(2);
+}
+
+// Renders one face into a sprite: fill, white border, centered label
+void renderFace(TFT_eSprite *spr, int size, uint16_t fill, uint16_t ink, const String &label) {
+  spr->fillSprite(fill);
+  spr->drawRect(0, 0, size, size, ink);
+  spr->setTextDatum(MC_DATUM);
+  spr->setTextColor(ink);
+  spr->drawString(label, size/2, size/2, 2);
+}
+
+// Makes sure faceCache[slot] shows button i; false if sprites cannot be allocated
+bool ensureFace(int slot, int i) {
+  Btn &b = buttons[i];
+  FaceCache &f = faceCache[slot];
+  bool mono = !psramFound();
+  String label = iconFits(i) ? String() : b.label; // an icon replaces the label
+
+  if (f.face[0] && f.size == b.size && f.label == label && f.mono == mono &&
+      (mono || (f.normal == colors.normal[i] && f.active == colors.active))) {
+    return true;
+  }
+
+  if (f.size != b.size || f.mono != mono) freeFace(slot);
+
+  int faces = mono ? 1 : 2;
+  for (int k = 0; k < faces; k++) {
+    if (!f.face[k]) {
+      f.face[k] = new TFT_eSprite(&tft);
+      f.face[k]->setColorDepth(mono ? 1 : 16);
+      if (!f.face[k]->createSprite(b.size, b.size)) {
+        freeFace(slot);
+        return false;
+      }
+    }
+  }
+
+  if (mono) {
+    renderFace(f.face[0], b.size, 0, 1, label);
+  } else {
+    renderFace(f.face[0], b.size, colors.normal[i], TFT_WHITE, label);
+    renderFace(f.face[1], b.size, colors.active, TFT_WHITE, label);
+  }
+
+  f.mono = mono;
+  f.size = b.size;
+  f.normal = colors.normal[i];
+  f.active = colors.active;
+  f.label = label;
+  renderStats.faceRebuilds++;
+  return true;
+}
+
+void freeFace(int slot) {
+  FaceCache &f = faceCache[slot];
+  for (int k = 0; k < 2; k++) {
+    if (f.face[k]) {
+      f.face[k]->deleteSprite();
+      delete f.face[k];
+      f.face[k] = nullptr;
+    }
+  }
+  f.size = 0;
+}
+
+// Forces the next drawButtons() to repaint the whole deck
+void invalidateDeck() {
+  deckOnScreen = false;
+}
+
+// --- Icons ---
+// Buffered reader and RLE decoder for a .cdi file or, with no file, the
+// body of the request being handled (POST /draw)
+struct RleReader {
+  File *f;
+  uint8_t buf[ICON_READ_CHUNK];
+  size_t pos = 0, len = 0;
+  uint32_t bytesRead = 0;
+  uint8_t run = 0, literal = 0; // pixels left in the current packet
+  uint16_t runPixel = 0;        // panel byte order
+
+  explicit RleReader(File *file) : f(file) {}
+
+  int next() {
+    if (pos == len) {
+      int n = f ? (int)f->read(buf, sizeof(buf)) : server.receive((char *)buf, sizeof(buf));
+      len = n > 0 ? n : 0;
+      pos = 0;
+      bytesRead += len;
+      if (len == 0) return -1;
+    }
+    return buf[pos++];
+  }
+
+  // Next u16 LE; -1 at the end of the input
+  int32_t word() {
+    int lo = next(), hi = next();
+    return hi < 0 ? -1 : (int32_t)(lo | hi << 8);
+  }
+
+  // Next pixel, byte-swapped for the panel; -1 at the end of the input
+  int32_t pixel() {
+    int lo = next(), hi = next();
+    return hi < 0 ? -1 : (int32_t)((lo << 8) | hi);
+  }
+
+  // True between packets
+  bool idle() { return !run && !literal; }
+
+  bool header(uint16_t &w, uint16_t &h) {
+    uint8_t hdr[ICON_HEADER_LEN];
+    for (int k = 0; k < ICON_HEADER_LEN; k++) {
+      int c = next();
+      if (c < 0) return false;
+      hdr[k] = c;
+    }
+    w = hdr[4] | hdr[5] << 8;
+    h = hdr[6] | hdr[7] << 8;
+    return memcmp(hdr, ICON_MAGIC, 4) == 0 && w > 0 && h > 0 && w <= ICON_MAX_DIM && h <= ICON_MAX_DIM;
+  }
+
+  // Decodes n pixels into line (may be null to only validate); false on a short or corrupt file
+  bool decode(uint16_t *line, int n) {
+    for (int k = 0; k < n; ) {
+      if (!run && !literal) {
+        int c = next();
+        if (c < 0) return false;
+        if (c & 0x80) {
+          int32_t p = pixel();
+          if (p < 0) return false;
+          run = (c & 0x7F) + 1;
+          runPixel = p;
+        } else {
+          literal = c + 1;
+        }
+      }
+      if (run) {
+        int m = min((int)run, n - k);
+        if (line) for (int j = 0; j < m; j++) line[k + j] = runPixel;
+        run -= m;
+        k += m;
+      } else {
+        int32_t p = pixel();
+        if (p < 0) return false;
+        if (line) line[k] = p;
+        literal--;
+        k++;
+      }
+    }
+    return true;
+  }
+};
+
+String iconPath(int i) {
+  return String(ICON_DIR "/") + String(i + 1) + ".cdi";
+}
+
+// Mounts LittleFS and indexes /icons; only the headers are read
+void setupIcons() {
+  iconStats.mounted = LittleFS.begin(true); // formats an empty partition on first boot
+  if (!iconStats.mounted) {
+    Serial.println("LittleFS mount failed, icons disabled");
+    return;
+  }
+  if (!LittleFS.exists(ICON_DIR)) LittleFS.mkdir(ICON_DIR);
+  File dir = LittleFS.open(ICON_DIR);
+  int found = 0;
+  for (File f = dir.openNextFile(); f; f = dir.openNextFile()) {
+    int i = atoi(f.name()) - 1;
+    uint16_t w, h;
+    RleReader rd(&f);
+    if (i >= 0 && i < MAX_BUTTONS && rd.header(w, h)) {
+      icons[i] = {w, h, (uint32_t)f.size(), ++iconRevCounter, 0, 0};
+      found++;
+    }
+  }
+  Serial.printf("Icons: %d loaded, DMA %s\n", found, iconStats.dma ? "on" : "off");
+}
+
+// True when button i has an icon that fits inside its tile border
+bool iconFits(int i) {
+  Btn &b = buttons[i];
+  return icons[i].w && icons[i].w <= b.size - 4 && icons[i].h <= b.size - 4;
+}
+
+// Streams icon i, centered in its tile, straight from flash to the panel;
+// returns pixels pushed. Runs on the UI task with the deck lock held.
+uint32_t drawIcon(int i) {
+  IconInfo &ic = icons[i];
+  Btn &b = buttons[i];
+  uint32_t start = micros();
+  File f = LittleFS.open(iconPath(i), "r");
+  if (!f) {
+    iconStats.failures++;
+    return 0;
+  }
+  RleReader rd(&f);
+  uint16_t w, h;
+  bool ok = rd.header(w, h) && w == ic.w && h == ic.h;
+
+  if (ok) {
+    tft.startWrite();
+    tft.setAddrWindow(b.x + (b.size - w) / 2, b.y + (b.size - h) / 2, w, h);
+    for (int y = 0; y < h && ok; y++) {
+      uint16_t *line = iconLine[y & 1]; // the other buffer may still be on the wire
+      ok = rd.decode(line, w);
+      if (!ok) break;
+      if (iconStats.dma) tft.pushPixelsDMA(line, w);
+      else tft.pushPixels(line, w);
+    }
+    if (iconStats.dma) tft.dmaWait();
+    tft.endWrite();
+  }
+  f.close();
+
+  ic.lastUs = micros() - start;
+  ic.lastRead = rd.bytesRead;
+  metrics.iconDrawUs.observe(ic.lastUs);
+  if (!ok) {
+    iconStats.failures++;
+    return 0;
+  }
+  iconStats.draws++;
+  return (uint32_t)w * h;
+}
+
+// --- Icon API POST /icon?button=<n> (body: .cdi image) ---
+// The body is streamed to a temporary file, then fully decoded once before
+// it replaces the button's icon, so a bad upload never reaches the panel.
+void handleIconUpload() {
+  server.sendHeader("Access-Control-Allow-Origin", "*");
+  int i = server.arg("button").toInt() - 1;
+  if (i < 0 || i >= MAX_BUTTONS) {
+    server.send(400, "text/plain", "Invalid button");
+    return;
+  }
+  if (!iconStats.mounted) {
+    server.send(503, "text/plain", "No filesystem");
+    return;
+  }
+  size_t len = server.contentLength();
+  if (len < ICON_HEADER_LEN || len > ICON_MAX_BYTES) {
+    iconStats.rejected++;
+    server.send(len ? 413 : 400, "text/plain", "Icon must be 8 to " + String(ICON_MAX_BYTES) + " bytes");
+    return;
+  }
+
+  const char *tmpPath = ICON_DIR "/upload.tmp";
+  File f = LittleFS.open(tmpPath, "w");
+  if (!f) {
+    server.send(500, "text/plain", "Cannot create file");
+    return;
+  }
+  char buf[ICON_READ_CHUNK];
+  size_t written = 0;
+  int n;
+  while ((n = server.receive(buf, sizeof(buf))) > 0) {
+    if (f.write((const uint8_t *)buf, n) != (size_t)n) break;
+    written += n;
+  }
+  f.close();
+
+  uint16_t w = 0, h = 0;
+  bool ok = written == len;
+  if (ok) {
+    f = LittleFS.open(tmpPath, "r");
+    RleReader rd(&f);
+    ok = rd.header(w, h) && rd.decode(nullptr, (int)w * h);
+    f.close();
+  }
+  if (!ok) {
+    LittleFS.remove(tmpPath);
+    iconStats.rejected++;
+    server.send(400, "text/plain", "Invalid icon");
+    return;
+  }
+
+  {
+    DeckLock lock; // the UI task may be streaming the old file
+    LittleFS.remove(iconPath(i));
+    ok = LittleFS.rename(tmpPath, iconPath(i));
+    if (ok) {
+      icons[i] = {w, h, (uint32_t)len, ++iconRevCounter, 0, 0};
+      iconStats.uploads++;
+      postUi(UI_REDRAW);
+    }
+  }
+  if (!ok) {
+    server.send(500, "text/plain", "Cannot store icon");
+    return;
+  }
+  Serial.printf("Icon for button %d: %ux%u, %u bytes\n", i + 1, w, h, (unsigned)len);
+  server.send(200, "application/json", "{\"button\":" + String(i + 1) + ",\"w\":" + String(w) +
+              ",\"h\":" + String(h) + ",\"bytes\":" + String((unsigned)len) + "}");
+}
+
+// --- Icon API DELETE /icon?button=<n> ---
+void handleIconDelete() {
+  server.sendHeader("Access-Control-Allow-Origin", "*");
+  int i = server.arg("button").toInt() - 1;
+  if (i < 0 || i >= MAX_BUTTONS) {
+    server.send(400, "text/plain", "Invalid button");
+    return;
+  }
+  {
+    DeckLock lock;
+    if (icons[i].w) {
+      LittleFS.remove(iconPath(i));
+      icons[i] = {};
+      postUi(UI_REDRAW);
+    }
+  }
+  server.send(200, "text/plain", "OK");
+}
+
+// --- Patch API POST /draw (body: patches, see "Live tile patches") ---
+// Decodes one patch for button i (-1: screen coordinates); returns pixels pushed, -1 if the body is bad
+int32_t drawPatch(RleReader &rd, int i, int x, int y, int w, int h) {
+  int32_t pushed = 0;
+  for (int row = 0; row < h; row++) {
+    if (!rd.decode(patchLine, w)) return -1;
+
+    DeckLock lock;
+    bool shown = deckOnScreen && !overlayUntil && !infoModeActive && !screensaverActive && !apModeActive;
+    if (!shown || (i >= 0 && (i >= buttonCount || i / slotsPerPage != currentPage))) continue;
+    int left = 0, top = 0, right = tft.width(), bottom = tft.height();
+    if (i >= 0) {
+      Btn &b = buttons[i];
+      left = b.x; top = b.y;
+      right = b.x + b.size; bottom = b.y + b.size;
+    }
+    int py = (i >= 0 ? top : 0) + y + row;
+    int px = (i >= 0 ? left : 0) + x;
+    int x0 = max(px, left), x1 = min(px + w, right);
+    if (py < top || py >= bottom || x0 >= x1) continue;
+    tft.startWrite();
+    tft.setAddrWindow(x0, py, x1 - x0, 1);
+    tft.pushPixels(patchLine + (x0 - px), x1 - x0);
+    tft.endWrite();
+    pushed += x1 - x0;
+  }
+  return rd.idle() ? pushed : -1; // a packet may not run into the next patch
+}
+
+// Patches are drawn as the body streams in, so the request holds the single
+// httpd task (which also runs the /stream pushes) until the last byte
+// arrives: keep bodies small, a slow upload delays every other client.
+void handleDraw() {
+  server.sendHeader("Access-Control-Allow-Origin", "*");
+  uint32_t start = micros();
+  RleReader rd(nullptr);
+  uint32_t patches = 0, dropped = 0, pixels = 0;
+  bool ok = true;
+
+  int button;
+  while ((button = rd.next()) >= 0) {
+    uint32_t patchStart = micros();
+    int32_t x = rd.word(), y = rd.word(), w = rd.word(), h = rd.word();
+    if (h <= 0 || button > MAX_BUTTONS || w <= 0 || w > MAX_SCREEN_DIM || h > MAX_SCREEN_DIM) {
+      ok = false;
+      break;
+    }
+    int32_t n = drawPatch(rd, button - 1, (int16_t)x, (int16_t)y, w, h);
+    if (n < 0) {
+      ok = false;
+      break;
+    }
+    patches++;
+    pixels += n;
+    if (!n) dropped++;
+    metrics.patchUs.observe(micros() - patchStart);
+  }
+
+  uint32_t us = micros() - start;
+  patchStats.requests++;
+  patchStats.patches += patches;
+  patchStats.dropped += dropped;
+  patchStats.pixels += pixels;
+  patchStats.bytesIn += rd.bytesRead;
+  patchStats.lastUs = us;
+  if (us > patchStats.maxUs) patchStats.maxUs = us;
+  if (!ok) patchStats.errors++;
+
+  String payload = "{\"patches\":" + String(patches) + ",\"dropped\":" + String(dropped) +
+                   ",\"pixels\":" + String(pixels) + ",\"bytes\":" + String(rd.bytesRead) +
+                   ",\"us\":" + String(us) + (ok ? "}" : ",\"error\":\"Invalid patch\"}");
+  server.send(ok ? 200 : 400, "application/json", payload);
+}
+
+// --- HTTP server ---
+void DeckServer::on(const char *uri, httpd_method_t method, void (*handler)()) {
+  if (routeCount >= HTTP_MAX_ROUTES) return;
+  routes[routeCount++] = {this, uri, method, handler};
+}
+
+bool DeckServer::begin() {
+  httpd_config_t config = HTTPD_DEFAULT_CONFIG();
+  config.core_id = 0;
+  config.stack_size = 8192;
+  config.max_uri_handlers = HTTP_MAX_ROUTES;
+  config.max_resp_headers = HTTP_MAX_HEADERS + 2;
+  config.max_open_sockets = HTTP_MAX_SOCKETS;
+  config.lru_purge_enable = false; // opened() evicts instead, sparing stream sockets
+  config.open_fn = onSocketOpen;
+  config.close_fn = onSocketClose;
+  for (Session &s : sessions) s.fd = -1;
+  if (httpd_start(&hd, &config) != ESP_OK) {
+    Serial.println("HTTP server failed to start");
+    return false;
+  }
+  for (int i = 0; i < routeCount; i++) {
+    httpd_uri_t uri = {routes[i].uri, routes[i].method, dispatch, &routes[i]};
+    httpd_register_uri_handler(hd, &uri);
+  }
+  return true;
+}
+
+esp_err_t DeckServer::dispatch(httpd_req_t *r) {
+  Route *route = (Route *)r->user_ctx;
+  DeckServer &self = *route->owner;
+  uint32_t start = micros();
+  if (!httpStats.handle) httpStats.handle = xTaskGetCurrentTaskHandle();
+
+  for (Session &s : self.sessions) {
+    if (s.fd == httpd_req_to_sockfd(r)) s.lastMs = millis();
+  }
+  self.req = r;
+  self.reqBody = "";
+  self.bodyLeft = r->content_len;
+  self.bodyTimeouts = 0;
+  self.bodyRead = false;
+  self.responded = false;
+  self.hdrCount = 0;
+  self.chunked = false;
+  route->handler();
+  if (!self.responded) self.send(500, "text/plain", "No response");
+  if (self.chunked) httpd_resp_send_chunk(r, nullptr, 0);
+  self.req = nullptr;
+
+  route->latencyUs.observe(micros() - start);
+  accountTask(httpStats, start);
+  return ESP_OK;
+}
+
+const String &DeckServer::body() {
+  if (bodyRead) return reqBody;
+  bodyRead = true;
+  char buf[256];
+  int n;
+  while ((n = receive(buf, sizeof(buf))) > 0) {
+    if (reqBody.length() + n <= HTTP_MAX_BODY) reqBody.concat(buf, n); // excess is drained, not kept
+  }
+  return reqBody;
+}
+
+int DeckServer::receive(char *buf, size_t len) {
+  while (bodyLeft > 0) {
+    int n = httpd_req_recv(req, buf, min(bodyLeft, len));
+    if (n == HTTPD_SOCK_ERR_TIMEOUT && ++bodyTimeouts < HTTP_BODY_TIMEOUTS) continue;
+    if (n <= 0) {
+      // A stalled client must not hold the only httpd task; the rest of its
+      // body would parse as the next request, so the connection goes too
+      bodyLeft = 0;
+      httpd_sess_trigger_close(hd, httpd_req_to_sockfd(req));
+      return -1;
+    }
+    bodyLeft -= n;
+    return n;
+  }
+  return 0;
+}
+
+// Looks name up in a query / form-urlencoded string and URL-decodes the value
+bool DeckServer::findArg(const char *query, const char *name, String *value) {
+  char raw[160];
+  if (httpd_query_key_value(query, name, raw, sizeof(raw)) != ESP_OK) return false;
+  if (!value) return true;
+  *value = "";
+  for (const char *p = raw; *p; p++) {
+    if (*p == '+') {
+      *value += ' ';
+    } else if (*p == '%' && isxdigit((unsigned char)p[1]) && isxdigit((unsigned char)p[2])) {
+      char hex[3] = {p[1], p[2], 0};
+      *value += (char)strtol(hex, nullptr, 16);
+      p += 2;
+    } else {
+      *value += *p;
+    }
+  }
+  return true;
+}
+
+// "plain" is the raw request body, as with WebServer; other names come from
+// the query string, then from a form-urlencoded body
+bool DeckServer::lookupArg(const char *name, String *value) {
+  char query[160];
+  size_t qlen = httpd_req_get_url_query_len(req);
+  if (qlen > 0 && qlen < sizeof(query) &&
+      httpd_req_get_url_query_str(req, query, sizeof(query)) == ESP_OK && findArg(query, name, value)) {
+    return true;
+  }
+  char type[48];
+  if (req->content_len > 0 &&
+      httpd_req_get_hdr_value_str(req, "Content-Type", type, sizeof(type)) == ESP_OK &&
+      strncmp(type, "application/x-www-form-urlencoded", 33) == 0) {
+    return findArg(body().c_str(), name, value);
+  }
+  return false;
+}
+
+bool DeckServer::hasArg(const char *name) {
+  if (strcmp(name, "plain") == 0) return req->content_len > 0;
+  return lookupArg(name, nullptr);
+}
+
+String DeckServer::arg(const char *name) {
+  if (strcmp(name, "plain") == 0) return body();
+  String value;
+  lookupArg(name, &value);
+  return value;
+}
+
+bool DeckServer::hasHeader(const char *name) {
+  return httpd_req_get_hdr_value_len(req, name) > 0;
+}
+
+String DeckServer::header(const char *name) {
+  char value[96];
+  size_t len = httpd_req_get_hdr_value_len(req, name);
+  if (len == 0 || len >= sizeof(value)) return String();
+  if (httpd_req_get_hdr_value_str(req, name, value, sizeof(value)) != ESP_OK) return String();
+  return String(value);
+}
+
+// httpd keeps pointers to header strings until the response is sent
+void DeckServer::sendHeader(const char *name, const String &value) {
+  if (hdrCount >= HTTP_MAX_HEADERS) return;
+  hdrNames[hdrCount] = name;
+  hdrValues[hdrCount] = value;
+  hdrCount++;
+}
+
+static const char *httpStatusLine(int code) {
+  switch (code) {
+    case 200: return "200 OK";
+    case 202: return "202 Accepted";
+    case 304: return "304 Not Modified";
+    case 400: return "400 Bad Request";
+    case 404: return "404 Not Found";
+    case 409: return "409 Conflict";
+    case 413: return "413 Payload Too Large";
+    case 503: return "503 Service Unavailable";
+    default: return "500 Internal Server Error";
+  }
+}
 
-    // label
-    tft.setTextDatum(MC_DATUM);
-    tft.setTextColor(TFT_WHITE);
-    tft.drawString(b.label, b.x + b.size/2, b.y + b.size/2, 2);
+void DeckServer::prepare(int code, const char *type) {
+  httpd_resp_set_status(req, httpStatusLine(code));
+  if (type) httpd_resp_set_type(req, type);
+  for (int i = 0; i < hdrCount; i++) {
+    httpd_resp_set_hdr(req, hdrNames[i].c_str(), hdrValues[i].c_str());
+  }
+  if (bodyLeft > 0) body(); // drain, so the next request on this connection parses
+}
+
+void DeckServer::respond(int code, const char *type, const char *data, size_t len) {
+  prepare(code, type);
+  httpd_resp_send(req, data, len);
+  responded = true;
+}
+
+// Streams a response in pieces; code/type apply to the first chunk, dispatch() ends it if the handler does not
+void DeckServer::sendChunk(int code, const char *type, const String &data) {
+  if (!responded) {
+    prepare(code, type);
+    responded = chunked = true;
+  }
+  if (!chunked) return;
+  if (data.length() == 0) chunked = false;
+  httpd_resp_send_chunk(req, data.c_str(), data.length());
+}
+
+void DeckServer::send(int code, const char *type, const String &body) {
+  respond(code, type, body.c_str(), body.length());
+}
+
+void DeckServer::send_P(int code, const char *type, const char *body, size_t len) {
+  respond(code, type, body, len);
+}
+
+int DeckServer::detach() {
+  if (bodyLeft > 0) body();
+  responded = true;
+  int fd = httpd_req_to_sockfd(req);
+  for (Session &s : sessions) {
+    if (s.fd == fd) s.detached = true;
+  }
+  return fd;
+}
+
+// A new connection that takes the last free socket evicts the longest-idle
+// request connection, so the next client is never refused
+void DeckServer::opened(int fd) {
+  Session *slot = nullptr, *idle = nullptr;
+  int open = 0;
+  for (Session &s : sessions) {
+    if (s.fd < 0) {
+      if (!slot) slot = &s;
+      continue;
+    }
+    open++;
+    if (!s.detached && (!idle || (long)(s.lastMs - idle->lastMs) < 0)) idle = &s;
+  }
+  if (slot) *slot = {fd, millis(), false};
+  if (open + 1 >= HTTP_MAX_SOCKETS && idle) {
+    httpd_sess_trigger_close(hd, idle->fd);
+  }
+}
+
+void DeckServer::closed(int fd) {
+  for (Session &s : sessions) {
+    if (s.fd == fd) s.fd = -1;
   }
 }
 
@@ -446,28 +2420,672 @@ void handleRoot() {
     html += "<input type='submit' value='Save and Connect' />";
     html += "</form>";
     html += "<p>Or send JSON POST to /save-credentials: {\"ssid\":\"...\",\"password\":\"...\"}</p>";
+    html += "<p>The device connects in the background; progress is at <a href='/save-credentials/status'>/save-credentials/status</a>.</p>";
     html += "</body></html>";
     server.send(200, "text/html", html);
     return;
   }
 
-  server.sendHeader("Content-Type", "text/plain");
   server.send(200, "text/plain", "cheap deck api");
 }
 
 // --- API ---
+// Serves a cached body with its ETag, or 304 when the client already has it
+template <size_t N>
+void sendCachedJson(JsonCache<N> &cache) {
+  server.sendHeader("Access-Control-Allow-Origin", "*");
+  server.sendHeader("Cache-Control", "no-cache");
+  server.sendHeader("ETag", cache.etag);
+  if (server.hasHeader("If-None-Match") && server.header("If-None-Match") == cache.etag) {
+    httpCacheStats.notModified++;
+    server.send(304);
+    return;
+  }
+  httpCacheStats.hits++;
+  server.send_P(200, "application/json", cache.body, cache.len);
+}
+
+template <size_t N>
+void sealJsonCache(JsonCache<N> &cache, const BufWriter &w, uint32_t rev) {
+  cache.len = w.len;
+  cache.rev = rev;
+  snprintf(cache.etag, sizeof(cache.etag), "\"%08x-%u\"", bootTag, rev);
+  httpCacheStats.builds++;
+}
+
+void buildStateJson() {
+  BufWriter w = {stateJson.body, sizeof(stateJson.body), 0};
+  w.add("{");
+  for (int i = 0; i < buttonCount; i++) {
+    if (i) w.add(",");
+    w.add("\"");
+    w.addUInt(i+1);
+    w.add(buttons[i].state ? "\":true" : "\":false");
+  }
+  w.add("}");
+  sealJsonCache(stateJson, w, stateRev);
+}
+
 void handleState() {
+  if (stateJson.rev != stateRev) {
+    DeckLock lock;
+    buildStateJson();
+  }
+  sendCachedJson(stateJson);
+}
+
+// --- Binary state API GET /state.bin ---
+// Fixed 20-byte frame, little-endian, no padding (Python: struct "<BBBBQII"):
+//   offset  size  field
+//        0     1  version  (STATE_FRAME_VERSION)
+//        1     1  cols
+//        2     1  rows
+//        3     1  pages
+//        4     8  states   bit i = state of button i+1
+//       12     4  seq      newest event sequence number (same as /events)
+//       16     4  ms       millis() when the frame was sent
+// A client that only needs to know whether anything happened compares seq
+// with the last one it saw and fetches /events?since= only when it moved.
+#define STATE_FRAME_VERSION 1
+
+struct __attribute__((packed)) StateFrame {
+  uint8_t version;
+  uint8_t cols, rows, pages;
+  uint64_t states;
+  uint32_t seq;
+  uint32_t ms;
+};
+
+void handleStateBin() {
+  StateFrame f;
+  f.version = STATE_FRAME_VERSION;
+  f.cols = layout.cols;
+  f.rows = layout.rows;
+  f.pages = layout.pages;
+  f.states = 0;
+  {
+    DeckLock lock;
+    for (int i = 0; i < buttonCount; i++) {
+      if (buttons[i].state) f.states |= 1ULL << i;
+    }
+  }
+  f.seq = eventSeq.load();
+  f.ms = millis();
   server.sendHeader("Access-Control-Allow-Origin", "*");
-  server.sendHeader("Content-Type", "application/json");
-  String payload = "{";
+  server.sendHeader("Cache-Control", "no-store");
+  server.send_P(200, "application/octet-stream", (const char *)&f, sizeof(f));
+}
+
+// --- Push stream API GET /stream ---
+// Server-Sent Events. Every press and release is sent as
+//   id: <seq>
+//   event: button
+//   data: {"seq":<seq>,"button":<1..N>,"type":"press"|"release","ms":<millis>,"state":true|false}
+// A "state" event with the full snapshot follows the connect/replay, so the
+// client always knows the current state. Reconnecting clients pass the last
+// seq they saw (Last-Event-ID header or ?since=) and get the missed events
+// replayed from the ring; if the gap is older than the ring, only the
+// snapshot is sent.
+String formatButtonEvent(const ButtonEvent &e) {
+  String msg = "id: " + String(e.seq) + "\nevent: button\ndata: {\"seq\":" + String(e.seq) +
+               ",\"button\":" + String(e.button + 1) +
+               ",\"type\":" + (e.type == EVT_PRESS ? "\"press\"" : "\"release\"") +
+               ",\"ms\":" + String(e.ms) +
+               ",\"state\":" + (e.state ? "true" : "false") + "}\n\n";
+  return msg;
+}
+
+String formatStateEvent() {
+  uint32_t seq = eventSeq.load();
+  String msg = "id: " + String(seq) + "\nevent: state\ndata: {\"seq\":" + String(seq) + ",\"state\":{";
   for (int i = 0; i < buttonCount; i++) {
-    payload += "\"" + String(i+1) + "\":" + (buttons[i].state?"true":"false");
-    if (i < buttonCount-1) payload += ",";
+    msg += "\"" + String(i+1) + "\":" + (buttons[i].state?"true":"false");
+    if (i < buttonCount-1) msg += ",";
+  }
+  msg += "}}\n\n";
+  return msg;
+}
+
+String formatDeckEvent() {
+  return "event: deck\ndata: {\"rev\":" + String(deckRev) + "}\n\n";
+}
+
+void handleStream() {
+  int active = 0, slot = -1;
+  for (int i = 0; i < MAX_STREAM_CLIENTS; i++) {
+    if (streamClients[i].fd >= 0) active++;
+    else if (slot < 0) slot = i;
   }
+  if (slot < 0 || active >= streamClientCap) {
+    streamStats.rejected++;
+    server.sendHeader("Access-Control-Allow-Origin", "*");
+    server.send(503, "text/plain", "Too many stream clients");
+    return;
+  }
+
+  // Resume point: Last-Event-ID (EventSource reconnect) or ?since= (manual)
+  long since = -1;
+  if (server.hasHeader("Last-Event-ID") && server.header("Last-Event-ID").length() > 0) {
+    since = server.header("Last-Event-ID").toInt();
+  } else if (server.hasArg("since")) {
+    since = server.arg("since").toInt();
+  }
+
+  // The response never ends; httpd leaves the socket open and we write to it directly
+  StreamClient &c = streamClients[slot];
+  int fd = server.detach();
+  c.fd = fd;
+  c.resync = false;
+  c.queued = c.highWater = 0;
+  c.drops = 0;
+  int nodelay = 1;
+  setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &nodelay, sizeof(nodelay));
+  static const char head[] = "HTTP/1.1 200 OK\r\n"
+                             "Content-Type: text/event-stream\r\n"
+                             "Cache-Control: no-cache\r\n"
+                             "Connection: keep-alive\r\n"
+                             "Access-Control-Allow-Origin: *\r\n\r\n"
+                             "retry: 2000\n\n";
+  streamQueue(c, head, sizeof(head) - 1);
+
+  // Replay missed events if they are all still in the ring; a replay that
+  // does not fit the queue turns into a resync
+  uint32_t newest = eventSeq.load();
+  if (since >= 0 && (uint32_t)since < newest && (uint32_t)since + 1 >= oldestEventSeq()) {
+    ButtonEvent e;
+    for (uint32_t seq = since + 1; seq <= newest; seq++) {
+      if (!readButtonEvent(seq, e)) continue;
+      String msg = formatButtonEvent(e);
+      streamQueue(c, msg.c_str(), msg.length());
+    }
+  }
+  String snapshot;
+  {
+    DeckLock lock;
+    snapshot = formatStateEvent() + formatDeckEvent();
+    c.deckRev = deckRev;
+  }
+  streamQueue(c, snapshot.c_str(), snapshot.length());
+  c.seq = newest;
+  if (streamFlush(c) && (c.queued || c.resync)) streamBacklog = true;
+  Serial.printf("Stream client %d connected (since=%ld, seq=%u, %d/%d)\n", slot, since, newest,
+                active + 1, streamClientCap);
+}
+
+// Records the event; netTask forwards it to stream clients (serviceStreamClients)
+void publishButtonEvent(int index, ButtonEventType type, unsigned long ms) {
+  recordButtonEvent(index, type, ms);
+}
+
+// Appends a message to the client's queue; if it does not fit, the message
+// is dropped and the client is marked for resync (later messages are dropped
+// too until the snapshot goes out, so the stream never has holes mid-run)
+void streamQueue(StreamClient &c, const char *data, size_t len) {
+  if (c.fd < 0) return;
+  if (!c.resync && c.queued + len > STREAM_QUEUE_BYTES) {
+    streamFlush(c);
+    if (c.fd >= 0 && c.queued + len > STREAM_QUEUE_BYTES) c.resync = true;
+  }
+  if (c.fd < 0) return;
+  if (c.resync) {
+    c.drops++;
+    streamStats.drops++;
+    return;
+  }
+  memcpy(c.queue + c.queued, data, len);
+  c.queued += len;
+  if (c.queued > c.highWater) c.highWater = c.queued;
+  streamStats.bytesQueued += len;
+}
+
+// Hands queued bytes to the socket without blocking; false once the client is gone
+bool streamFlush(StreamClient &c) {
+  while (c.fd >= 0 && c.queued) {
+    int sent = httpd_socket_send(server.handle(), c.fd, c.queue, c.queued, MSG_DONTWAIT);
+    if (sent == HTTPD_SOCK_ERR_TIMEOUT) {
+      streamStats.deferred++;
+      return true;
+    }
+    if (sent <= 0) {
+      streamDisconnect(c);
+      return false;
+    }
+    c.queued -= sent;
+    memmove(c.queue, c.queue + sent, c.queued);
+  }
+  return c.fd >= 0;
+}
+
+// Frees the slot and has httpd close the socket
+void streamDisconnect(StreamClient &c) {
+  Serial.printf("Stream client %d disconnected (%u dropped)\n", (int)(&c - streamClients), (unsigned)c.drops);
+  httpd_sess_trigger_close(server.handle(), c.fd);
+  c.fd = -1;
+  c.queued = 0;
+}
+
+// netTask: schedules a push when there are new events, a new deck revision,
+// queued bytes left over or a heartbeat is due
+void serviceStreamClients() {
+  if (streamWorkQueued.load()) return;
+  bool due = eventSeq.load(std::memory_order_acquire) != streamForwardedSeq ||
+             (streamBacklog.load() && millis() - lastStreamRound >= STREAM_RETRY_MS) ||
+             millis() - lastStreamHeartbeat >= STREAM_HEARTBEAT_MS;
+  if (!due) {
+    for (int i = 0; i < MAX_STREAM_CLIENTS && !due; i++) {
+      due = streamClients[i].fd >= 0 && streamClients[i].deckRev != deckRev;
+    }
+  }
+  if (!due) return;
+  streamWorkQueued = true;
+  if (httpd_queue_work(server.handle(), pushStreamClients, nullptr) != ESP_OK) streamWorkQueued = false;
+}
+
+// HTTP server task: one push round. New events are formatted once into a
+// shared buffer and each client is queued the tail it has not seen yet; the
+// deck event and snapshot are likewise built at most once per round. A
+// client that fell behind the ring, or overflowed its queue, gets the
+// snapshot once its queue has drained.
+void pushStreamClients(void *arg) {
+  streamStats.rounds++;
+  lastStreamRound = millis();
+  uint32_t newest = eventSeq.load(std::memory_order_acquire);
+  uint32_t first = max(streamForwardedSeq + 1, oldestEventSeq());
+  String events;
+  uint16_t offset[EVENT_RING_SIZE + 1]; // start of event first + k in events
+  uint32_t count = 0;
+  ButtonEvent e;
+  for (uint32_t seq = first; seq <= newest && count < EVENT_RING_SIZE; seq++) {
+    offset[count++] = events.length();
+    if (readButtonEvent(seq, e)) {
+      events += formatButtonEvent(e);
+      streamStats.serialized++;
+    }
+  }
+  offset[count] = events.length();
+  streamForwardedSeq = newest;
+
+  String deckMsg, snapshot;
+  uint32_t snapshotRev = 0;
+  unsigned long now = millis();
+  bool heartbeat = now - lastStreamHeartbeat >= STREAM_HEARTBEAT_MS;
+  if (heartbeat) lastStreamHeartbeat = now;
+  bool backlog = false;
+
+  for (int i = 0; i < MAX_STREAM_CLIENTS; i++) {
+    StreamClient &c = streamClients[i];
+    if (c.fd < 0) continue;
+    if (c.seq < newest) {
+      if (c.seq + 1 < first) {
+        c.resync = true; // its next event is no longer in the ring or this batch
+      } else {
+        uint32_t k = c.seq + 1 - first;
+        streamQueue(c, events.c_str() + offset[k], offset[count] - offset[k]);
+      }
+      c.seq = newest;
+    }
+    if (c.deckRev != deckRev && !c.resync) {
+      if (!deckMsg.length()) {
+        deckMsg = formatDeckEvent();
+        streamStats.serialized++;
+      }
+      c.deckRev = deckRev;
+      streamQueue(c, deckMsg.c_str(), deckMsg.length());
+    }
+    if (heartbeat && !c.queued) streamQueue(c, ": ping\n\n", 9);
+    if (!streamFlush(c)) continue;
+
+    if (c.resync && !c.queued) {
+      if (!snapshot.length()) {
+        {
+          DeckLock lock;
+          snapshot = formatStateEvent() + formatDeckEvent();
+          snapshotRev = deckRev;
+        }
+        streamStats.serialized++;
+      }
+      c.resync = false;
+      c.seq = newest;
+      c.deckRev = snapshotRev;
+      streamStats.resyncs++;
+      streamQueue(c, snapshot.c_str(), snapshot.length());
+      if (!streamFlush(c)) continue;
+    }
+    if (c.queued || c.resync) backlog = true;
+  }
+  streamBacklog = backlog;
+  streamWorkQueued = false;
+}
+
+esp_err_t onSocketOpen(httpd_handle_t hd, int fd) {
+  server.opened(fd);
+  return ESP_OK;
+}
+
+// httpd close callback: forget stream sockets the peer (or an eviction) closed
+void onSocketClose(httpd_handle_t hd, int fd) {
+  server.closed(fd);
+  for (int i = 0; i < MAX_STREAM_CLIENTS; i++) {
+    if (streamClients[i].fd == fd) {
+      streamClients[i].fd = -1;
+      streamClients[i].queued = 0;
+      Serial.printf("Stream client %d disconnected\n", i);
+    }
+  }
+  close(fd);
+}
+
+// --- Event ring ---
+uint32_t recordButtonEvent(int index, ButtonEventType type, unsigned long ms) {
+  uint32_t seq = eventSeq.load(std::memory_order_relaxed) + 1;
+  EventSlot &slot = eventRing[seq & (EVENT_RING_SIZE - 1)];
+
+  slot.seq.store(0, std::memory_order_relaxed);
+  std::atomic_thread_fence(std::memory_order_release);
+  slot.ev.seq = seq;
+  slot.ev.ms = ms;
+  slot.ev.button = index;
+  slot.ev.type = type;
+  slot.ev.state = buttons[index].state;
+  slot.seq.store(seq, std::memory_order_release);
+  eventSeq.store(seq, std::memory_order_release);
+  return seq;
+}
+
+// Copies event <seq> out of the ring; false if it was never written or has been overwritten
+bool readButtonEvent(uint32_t seq, ButtonEvent &out) {
+  const EventSlot &slot = eventRing[seq & (EVENT_RING_SIZE - 1)];
+  if (seq == 0 || slot.seq.load(std::memory_order_acquire) != seq) return false;
+  out = slot.ev;
+  std::atomic_thread_fence(std::memory_order_acquire);
+  return slot.seq.load(std::memory_order_relaxed) == seq;
+}
+
+uint32_t oldestEventSeq() {
+  uint32_t newest = eventSeq.load(std::memory_order_acquire);
+  return newest >= EVENT_RING_SIZE ? newest - EVENT_RING_SIZE + 1 : 1;
+}
+
+// --- Event API GET /events?since=<seq> ---
+// Returns every event after <seq> still held in the ring:
+//   {"seq":<newest>,"events":[[seq,button,type,ms,state],...],"lost":<n>}
+// button is 1-based, type is 1 = press / 0 = release, state is 0/1.
+// "lost" counts events that were overwritten before this poll; a client that
+// sees lost > 0 should resync from /state. Without ?since= only the newest
+// seq is returned, so a new client can start draining from there.
+void handleEvents() {
+  server.sendHeader("Access-Control-Allow-Origin", "*");
+
+  uint32_t newest = eventSeq.load(std::memory_order_acquire);
+  uint32_t since = server.hasArg("since") ? (uint32_t)server.arg("since").toInt() : newest;
+  String payload = "{";
+  appendEventsJson(payload, since);
   payload += "}";
   server.send(200, "application/json", payload);
 }
 
+// Appends "seq":N,"events":[...],"lost":k for the events after since
+void appendEventsJson(String &payload, uint32_t since) {
+  uint32_t newest = eventSeq.load(std::memory_order_acquire);
+  if (since > newest) since = newest; // device rebooted; client will resync from our seq
+
+  uint32_t first = since + 1;
+  uint32_t oldest = oldestEventSeq();
+  uint32_t lost = 0;
+  if (first < oldest) {
+    lost = oldest - first;
+    first = oldest;
+  }
+
+  payload.reserve(payload.length() + 40 + (newest - first + 1) * 28);
+  payload += "\"seq\":" + String(newest) + ",\"events\":[";
+  ButtonEvent e;
+  bool firstItem = true;
+  for (uint32_t seq = first; seq <= newest; seq++) {
+    if (!readButtonEvent(seq, e)) { lost++; continue; } // overwritten while we were reading
+    if (!firstItem) payload += ",";
+    firstItem = false;
+    payload += "[" + String(e.seq) + "," + String(e.button + 1) + "," + String(e.type) + "," +
+               String(e.ms) + "," + (e.state ? "1" : "0") + "]";
+  }
+  payload += "],\"lost\":" + String(lost);
+  metrics.eventsLost += lost;
+}
+
+// --- Stats API GET /stats ---
+void handleStats() {
+  server.sendHeader("Access-Control-Allow-Origin", "*");
+  String payload = "{\"render\":{";
+  payload += "\"frames\":" + String(renderStats.frames) + ",";
+  payload += "\"full_repaints\":" + String(renderStats.fullRepaints) + ",";
+  payload += "\"tiles_drawn\":" + String(renderStats.tilesDrawn) + ",";
+  payload += "\"last_frame_pixels\":" + String(renderStats.lastFramePixels) + ",";
+  payload += "\"max_frame_pixels\":" + String(renderStats.maxFramePixels) + ",";
+  payload += "\"total_pixels\":" + String((unsigned long long)renderStats.totalPixels) + ",";
+  payload += "\"face_blits\":" + String(renderStats.faceBlits) + ",";
+  payload += "\"face_rebuilds\":" + String(renderStats.faceRebuilds) + ",";
+  payload += "\"face_fallbacks\":" + String(renderStats.faceFallbacks);
+  payload += "},\"icons\":{";
+  payload += "\"mounted\":" + String(iconStats.mounted ? "true" : "false") + ",";
+  payload += "\"dma\":" + String(iconStats.dma ? "true" : "false") + ",";
+  payload += "\"draws\":" + String(iconStats.draws) + ",";
+  payload += "\"failures\":" + String(iconStats.failures) + ",";
+  payload += "\"uploads\":" + String(iconStats.uploads) + ",";
+  payload += "\"rejected\":" + String(iconStats.rejected) + ",";
+  payload += "\"buttons\":{";
+  bool firstIcon = true;
+  for (int i = 0; i < MAX_BUTTONS; i++) {
+    const IconInfo &ic = icons[i];
+    if (!ic.w) continue;
+    if (!firstIcon) payload += ",";
+    firstIcon = false;
+    payload += "\"" + String(i + 1) + "\":{\"w\":" + String(ic.w) + ",\"h\":" + String(ic.h) +
+               ",\"bytes\":" + String(ic.bytes) + ",\"last_us\":" + String(ic.lastUs) +
+               ",\"last_read\":" + String(ic.lastRead) + "}";
+  }
+  payload += "}},\"patches\":{";
+  payload += "\"requests\":" + String(patchStats.requests) + ",";
+  payload += "\"patches\":" + String(patchStats.patches) + ",";
+  payload += "\"dropped\":" + String(patchStats.dropped) + ",";
+  payload += "\"errors\":" + String(patchStats.errors) + ",";
+  payload += "\"pixels\":" + String((unsigned long long)patchStats.pixels) + ",";
+  payload += "\"bytes_in\":" + String((unsigned long long)patchStats.bytesIn) + ",";
+  payload += "\"last_us\":" + String(patchStats.lastUs) + ",";
+  payload += "\"max_us\":" + String(patchStats.maxUs);
+  payload += "},\"stream\":{";
+  payload += "\"cap\":" + String(streamClientCap) + ",";
+  payload += "\"rounds\":" + String(streamStats.rounds) + ",";
+  payload += "\"serialized\":" + String(streamStats.serialized) + ",";
+  payload += "\"bytes_queued\":" + String((unsigned long long)streamStats.bytesQueued) + ",";
+  payload += "\"deferred\":" + String(streamStats.deferred) + ",";
+  payload += "\"drops\":" + String(streamStats.drops) + ",";
+  payload += "\"resyncs\":" + String(streamStats.resyncs) + ",";
+  payload += "\"rejected\":" + String(streamStats.rejected) + ",";
+  payload += "\"clients\":[";
+  bool firstClient = true;
+  for (int i = 0; i < MAX_STREAM_CLIENTS; i++) {
+    const StreamClient &c = streamClients[i];
+    if (c.fd < 0) continue;
+    if (!firstClient) payload += ",";
+    firstClient = false;
+    payload += "{\"slot\":" + String(i) + ",\"seq\":" + String(c.seq) +
+               ",\"queued\":" + String(c.queued) + ",\"high_water\":" + String(c.highWater) +
+               ",\"drops\":" + String(c.drops) + "}";
+  }
+  payload += "]},\"info\":{";
+  payload += "\"frames\":" + String(infoStats.frames) + ",";
+  payload += "\"glyph_blits\":" + String(infoStats.glyphBlits) + ",";
+  payload += "\"glyph_fallbacks\":" + String(infoStats.glyphFallbacks) + ",";
+  payload += "\"last_frame_pixels\":" + String(infoStats.lastFramePixels) + ",";
+  payload += "\"total_pixels\":" + String((unsigned long long)infoStats.totalPixels);
+  payload += "},\"clock\":{";
+  payload += "\"source\":\"" + String(clockSourceName()) + "\",";
+  payload += "\"epoch\":" + String((unsigned long)time(nullptr)) + ",";
+  payload += "\"tz_offset\":" + String(tzOffsetSec) + ",";
+  payload += "\"synced_ago_ms\":" + String(clockSyncedMs ? millis() - clockSyncedMs : 0);
+  int64_t tierUs = esp_timer_get_time() - powerStats.tierSinceUs;
+  uint64_t idleUs = powerStats.idleUs + (powerTier == POWER_IDLE ? tierUs : 0);
+  uint64_t activeUs = powerStats.activeUs + (powerTier == POWER_IDLE ? 0 : tierUs);
+  payload += "},\"power\":{";
+  payload += "\"mode\":\"" + String(powerModeName()) + "\",";
+  payload += "\"tier\":\"" + String(powerTier == POWER_IDLE ? "idle" : "active") + "\",";
+  payload += "\"cpu_mhz\":" + String(getCpuFrequencyMhz()) + ",";
+  payload += "\"idle_entries\":" + String(powerStats.idleEntries) + ",";
+  payload += "\"touch_wakes\":" + String(powerStats.touchWakes) + ",";
+  payload += "\"active_ms\":" + String((unsigned long long)(activeUs / 1000)) + ",";
+  payload += "\"idle_ms\":" + String((unsigned long long)(idleUs / 1000)) + ",";
+  payload += "\"idle_pct\":" + String(idleUs + activeUs ? (uint32_t)(idleUs * 100 / (idleUs + activeUs)) : 0) + ",";
+  payload += "\"wake_frames\":" + String(powerStats.wakeFrames) + ",";
+  payload += "\"last_wake_frame_us\":" + String(powerStats.lastWakeFrameUs) + ",";
+  payload += "\"max_wake_frame_us\":" + String(powerStats.maxWakeFrameUs) + ",";
+  payload += "\"avg_wake_frame_us\":" + String(powerStats.wakeFrames ? (uint32_t)(powerStats.totalWakeFrameUs / powerStats.wakeFrames) : 0);
+  payload += "},\"touch\":{";
+  payload += "\"irqs\":" + String(touchStats.irqs) + ",";
+  payload += "\"samples\":" + String(touchStats.samples) + ",";
+  payload += "\"rejected\":" + String(touchStats.rejected) + ",";
+  payload += "\"presses\":" + String(touchStats.presses) + ",";
+  payload += "\"releases\":" + String(touchStats.releases) + ",";
+  payload += "\"debounced\":" + String(touchStats.debounced);
+  payload += "},\"nvs\":{";
+  payload += "\"pending\":" + String((statesDirty || settingsDirty) ? "true" : "false") + ",";
+  payload += "\"requests\":" + String(persistStats.requests) + ",";
+  payload += "\"commits\":" + String(persistStats.commits) + ",";
+  payload += "\"skipped\":" + String(persistStats.skipped) + ",";
+  payload += "\"bytes_written\":" + String(persistStats.bytesWritten) + ",";
+  payload += "\"migrations\":" + String(persistStats.migrations) + ",";
+  payload += "\"crc_errors\":" + String(persistStats.crcErrors) + ",";
+  payload += "\"warm_resumes\":" + String(persistStats.warmResumes) + ",";
+  payload += "\"last_commit_us\":" + String(persistStats.lastCommitUs) + ",";
+  payload += "\"max_commit_us\":" + String(persistStats.maxCommitUs) + ",";
+  payload += "\"avg_commit_us\":" + String(persistStats.commits ? (uint32_t)(persistStats.totalCommitUs / persistStats.commits) : 0);
+  payload += "},\"http_cache\":{";
+  payload += "\"builds\":" + String(httpCacheStats.builds) + ",";
+  payload += "\"hits\":" + String(httpCacheStats.hits) + ",";
+  payload += "\"not_modified\":" + String(httpCacheStats.notModified);
+  payload += "},\"tasks\":[";
+  TaskStats *tasks[] = {&httpStats, &netStats, &inputStats, &uiStats};
+  for (int i = 0; i < 4; i++) {
+    TaskStats &t = *tasks[i];
+    if (i) payload += ",";
+    payload += "{\"name\":\"" + String(t.name) + "\",";
+    payload += "\"core\":" + String(t.core) + ",";
+    payload += "\"load_pct\":" + String(t.loadPct) + ",";
+    payload += "\"stack_free\":" + String(t.handle ? uxTaskGetStackHighWaterMark(t.handle) : 0) + "}";
+  }
+  payload += "],\"queues\":{";
+  payload += "\"touch\":{\"depth\":" + String(touchQueue.depth()) + ",\"high_water\":" + String(touchQueue.highWater) +
+             ",\"drops\":" + String(touchQueue.drops) + ",\"size\":" + String(TOUCH_QUEUE_SIZE) + "},";
+  payload += "\"ui\":{\"depth\":" + String(uiQueue.depth()) + ",\"high_water\":" + String(uiQueue.highWater) +
+             ",\"drops\":" + String(uiQueue.drops) + ",\"size\":" + String(UI_QUEUE_SIZE) + "},";
+  payload += "\"net_ui\":{\"depth\":" + String(netUiQueue.depth()) + ",\"high_water\":" + String(netUiQueue.highWater) +
+             ",\"drops\":" + String(netUiQueue.drops) + ",\"size\":" + String(UI_QUEUE_SIZE) + "}";
+  payload += "}}";
+  server.send(200, "application/json", payload);
+}
+
+// --- Metrics API GET /metrics (Prometheus text format) ---
+// Times are exported in seconds, as Prometheus expects; they are recorded in microseconds.
+void appendSeconds(String &out, uint64_t us) {
+  char buf[24];
+  snprintf(buf, sizeof(buf), "%llu.%06llu", (unsigned long long)(us / 1000000), (unsigned long long)(us % 1000000));
+  out += buf;
+}
+
+void appendMetricHeader(String &out, const char *name, const char *type, const char *help) {
+  out += "# HELP ";
+  out += name;
+  out += " ";
+  out += help;
+  out += "\n# TYPE ";
+  out += name;
+  out += " ";
+  out += type;
+  out += "\n";
+}
+
+// One histogram series; labels is "" or e.g. "task=\"ui\""
+void appendHistogram(String &out, const char *name, const char *labels, const Histogram &h, bool seconds) {
+  String prefix = String(name) + "_bucket{" + labels + (*labels ? "," : "") + "le=\"";
+  String suffix = *labels ? String("{") + labels + "}" : String();
+  uint32_t cumulative = 0;
+  for (uint8_t i = 0; i <= h.buckets; i++) {
+    cumulative += h.counts[i];
+    out += prefix;
+    if (i == h.buckets) out += "+Inf";
+    else if (seconds) appendSeconds(out, h.bounds[i]);
+    else out += String(h.bounds[i]);
+    out += "\"} " + String(cumulative) + "\n";
+  }
+  out += String(name) + "_sum" + suffix + " ";
+  if (seconds) appendSeconds(out, h.sum);
+  else out += String((unsigned long long)h.sum);
+  out += "\n" + String(name) + "_count" + suffix + " " + String(h.count) + "\n";
+}
+
+void handleMetrics() {
+  String out;
+  out.reserve(2048);
+
+  appendMetricHeader(out, "cheapdeck_task_iteration_seconds", "histogram", "Work time per task loop iteration (http: per request).");
+  TaskStats *tasks[] = {&httpStats, &netStats, &inputStats, &uiStats};
+  for (TaskStats *t : tasks) {
+    appendHistogram(out, "cheapdeck_task_iteration_seconds", (String("task=\"") + t->name + "\"").c_str(), t->iterUs, true);
+  }
+  server.sendChunk(200, "text/plain; version=0.0.4", out);
+
+  out = "";
+  appendMetricHeader(out, "cheapdeck_http_handler_seconds", "histogram", "Handler time per route.");
+  const DeckServer::Route *routes;
+  int routeCount = server.routeTable(&routes);
+  for (int i = 0; i < routeCount; i++) {
+    const Histogram &h = routes[i].latencyUs;
+    if (!h.count) continue;
+    String labels = String("route=\"") + routes[i].uri + "\",method=\"" + (routes[i].method == HTTP_GET ? "GET" : routes[i].method == HTTP_POST ? "POST" : "DELETE") + "\"";
+    appendHistogram(out, "cheapdeck_http_handler_seconds", labels.c_str(), h, true);
+    if (out.length() > 1500) {
+      server.sendChunk(200, nullptr, out);
+      out = "";
+    }
+  }
+
+  appendMetricHeader(out, "cheapdeck_touch_to_display_seconds", "histogram", "Touch IRQ to the first frame pushed for that press.");
+  appendHistogram(out, "cheapdeck_touch_to_display_seconds", "", metrics.touchToDisplayUs, true);
+  appendMetricHeader(out, "cheapdeck_redraw_pixels", "histogram", "Pixels pushed per deck redraw.");
+  appendHistogram(out, "cheapdeck_redraw_pixels", "", metrics.redrawPixels, false);
+  appendMetricHeader(out, "cheapdeck_icon_draw_seconds", "histogram", "Icon decode + DMA push time per tile.");
+  appendHistogram(out, "cheapdeck_icon_draw_seconds", "", metrics.iconDrawUs, true);
+  appendMetricHeader(out, "cheapdeck_patch_seconds", "histogram", "POST /draw time per patch, network included.");
+  appendHistogram(out, "cheapdeck_patch_seconds", "", metrics.patchUs, true);
+  server.sendChunk(200, nullptr, out);
+
+  out = "";
+  appendMetricHeader(out, "cheapdeck_nvs_commit_seconds", "histogram", "NVS blob write time (saveStates / saveSettings).");
+  appendHistogram(out, "cheapdeck_nvs_commit_seconds", "blob=\"buttons\"", metrics.nvsCommitUs[0], true);
+  appendHistogram(out, "cheapdeck_nvs_commit_seconds", "blob=\"settings\"", metrics.nvsCommitUs[1], true);
+
+  appendMetricHeader(out, "cheapdeck_heap_free_bytes", "gauge", "Free heap.");
+  out += "cheapdeck_heap_free_bytes " + String(ESP.getFreeHeap()) + "\n";
+  appendMetricHeader(out, "cheapdeck_heap_largest_free_block_bytes", "gauge", "Largest allocatable heap block.");
+  out += "cheapdeck_heap_largest_free_block_bytes " + String(ESP.getMaxAllocHeap()) + "\n";
+  appendMetricHeader(out, "cheapdeck_heap_min_free_bytes", "gauge", "Lowest free heap since boot.");
+  out += "cheapdeck_heap_min_free_bytes " + String(ESP.getMinFreeHeap()) + "\n";
+  appendMetricHeader(out, "cheapdeck_queue_drops_total", "counter", "Messages dropped because a task queue was full.");
+  out += "cheapdeck_queue_drops_total{queue=\"touch\"} " + String(touchQueue.drops) + "\n";
+  out += "cheapdeck_queue_drops_total{queue=\"ui\"} " + String(uiQueue.drops) + "\n";
+  out += "cheapdeck_queue_drops_total{queue=\"net_ui\"} " + String(netUiQueue.drops) + "\n";
+  appendMetricHeader(out, "cheapdeck_events_lost_total", "counter", "Button events overwritten before a client read them.");
+  out += "cheapdeck_events_lost_total " + String(metrics.eventsLost) + "\n";
+  appendMetricHeader(out, "cheapdeck_button_events_total", "counter", "Button events recorded.");
+  out += "cheapdeck_button_events_total " + String(eventSeq.load()) + "\n";
+  appendMetricHeader(out, "cheapdeck_touch_debounced_total", "counter", "Presses dropped by the per-button debounce.");
+  out += "cheapdeck_touch_debounced_total " + String(touchStats.debounced) + "\n";
+  appendMetricHeader(out, "cheapdeck_uptime_seconds", "gauge", "Time since boot.");
+  out += "cheapdeck_uptime_seconds ";
+  appendSeconds(out, esp_timer_get_time());
+  out += "\n";
+  server.sendChunk(200, nullptr, out);
+}
+
 // --- Config API POST /config {"1":"Label1",...} ---
 void handleConfig() {
   if (!server.hasArg("plain")) {
@@ -475,65 +3093,265 @@ void handleConfig() {
     server.send(400,"text/plain","Missing body");
     return;
   }
-  
-  String body = server.arg("plain");
-  Serial.println("=== CONFIG REQUEST ===");
-  Serial.println("Raw body: " + body);
-  
-  // Parse JSON using ArduinoJson
-  DynamicJsonDocument doc(1024);
-  DeserializationError error = deserializeJson(doc, body);
-  
-  if (error) {
-    Serial.printf("Config JSON parse error: %s\n", error.c_str());
+  
+  String body = server.arg("plain");
+#if LOG_HTTP_BODIES
+  Serial.println("=== CONFIG REQUEST ===");
+  Serial.println("Raw body: " + body);
+#endif
+  
+  // Parse JSON using ArduinoJson
+  DynamicJsonDocument doc(4096); // up to MAX_BUTTONS labels
+  DeserializationError error = deserializeJson(doc, body);
+  
+  if (error) {
+    Serial.printf("Config JSON parse error: %s\n", error.c_str());
+    server.send(400, "text/plain", "Invalid JSON");
+    return;
+  }
+  
+  if (!validLabelsJson(doc.as<JsonObject>())) {
+    server.send(400, "text/plain", "Labels must be strings");
+    return;
+  }
+
+  DeckChange change = {};
+  {
+    DeckLock lock;
+    applyLabelsJson(doc.as<JsonObject>(), change);
+    commitDeckChange(change);
+  }
+  if (change.labels) {
+    Serial.println("Config updated and saved!");
+  } else {
+    Serial.println("No changes detected in config");
+  }
+  
+  Serial.println("=== CONFIG COMPLETE ===");
+  server.send(200, "text/plain", "OK");
+}
+
+// Labels must be strings; keys that name no button are ignored
+bool validLabelsJson(JsonObject doc) {
+  for (int i = 0; i < MAX_BUTTONS; i++) {
+    char key[12];
+    snprintf(key, sizeof(key), "%d", i+1);
+    if (doc.containsKey(key) && !doc[key].is<const char*>()) return false;
+  }
+  return true;
+}
+
+// Applies {"<button>": "<label>", ...}; true if any label changed
+bool applyLabelsJson(JsonObject doc, DeckChange &change) {
+  bool changed = false;
+  for (int i = 0; i < buttonCount; i++) {
+    char key[12];
+    snprintf(key, sizeof(key), "%d", i+1);
+    if (doc.containsKey(key)) {
+      String newLabel = doc[key].as<String>();
+      if (newLabel.length() > LABEL_MAX_LEN) newLabel = newLabel.substring(0, LABEL_MAX_LEN); // fits the NVS blob
+      if (buttons[i].label != newLabel) {
+        Serial.printf("Button %d: '%s' -> '%s'\n", i+1, buttons[i].label.c_str(), newLabel.c_str());
+        buttons[i].label = newLabel;
+        changed = true;
+      }
+    }
+  }
+  if (changed) change.labels = true;
+  return changed;
+}
+
+// Marks what changed dirty and repaints once; call with the deck lock held
+void commitDeckChange(const DeckChange &change) {
+  if (!change.labels && !change.settings) return;
+  if (change.labels) markStatesDirty();
+  if (change.settings) markSettingsDirty();
+  deckRev++;
+  postUi(change.layout ? UI_RELAYOUT : UI_REDRAW);
+}
+
+// --- Sync API POST /sync ---
+// One round trip for everything the host does periodically. Body, every
+// field optional:
+//   {"since": <seq>, "info": {"time","date","cpu","ram"},
+//    "labels": {"1": "..."}, "settings": {...same fields as POST /settings...}}
+// Response, same event encoding as GET /events:
+//   {"seq":N,"events":[[seq,button,type,ms,state],...],"lost":k,"clock":"sntp","tz_offset":3600,
+//    "state":{"1":true,...}}
+// Without "since" no events are returned, only the current seq. An invalid
+// field in "settings" or "labels" rejects the whole request with 400 before
+// anything is applied. "rev" is the deck revision (see POST /deck).
+void handleSync() {
+  if (!server.hasArg("plain")) {
+    server.send(400,"text/plain","Missing body");
+    return;
+  }
+
+  DynamicJsonDocument doc(6144);
+  DeserializationError error = deserializeJson(doc, server.arg("plain"));
+  if (error) {
+    Serial.printf("Sync JSON parse error: %s\n", error.c_str());
+    server.send(400, "text/plain", "Invalid JSON");
+    return;
+  }
+
+  uint32_t rev;
+  bool valid;
+  {
+    DeckLock lock;
+    DeckChange change = {};
+    valid = (!doc.containsKey("settings") || validSettingsJson(doc["settings"].as<JsonObject>())) &&
+            (!doc.containsKey("labels") || validLabelsJson(doc["labels"].as<JsonObject>()));
+    if (valid) {
+      if (doc.containsKey("settings")) applySettingsJson(doc["settings"].as<JsonObject>(), change);
+      if (doc.containsKey("labels")) applyLabelsJson(doc["labels"].as<JsonObject>(), change);
+      commitDeckChange(change);
+      if (doc.containsKey("info")) applySystemInfoJson(doc["info"].as<JsonObject>());
+      if (stateJson.rev != stateRev) buildStateJson();
+    }
+    rev = deckRev;
+  }
+  if (!valid) {
+    server.send(400, "text/plain", "Invalid settings or labels");
+    return;
+  }
+
+  uint32_t since = doc.containsKey("since") ? doc["since"].as<uint32_t>() : eventSeq.load();
+
+  String payload = "{";
+  appendEventsJson(payload, since);
+  payload += ",\"clock\":\"" + String(clockSourceName()) + "\"";
+  payload += ",\"tz_offset\":" + String(tzOffsetSec);
+  payload += ",\"rev\":" + String(rev);
+  payload += ",\"state\":";
+  payload += stateJson.body;
+  payload += "}";
+  server.sendHeader("Access-Control-Allow-Origin", "*");
+  server.send(200, "application/json", payload);
+}
+
+// --- Settings API GET /settings ---
+void buildSettingsJson() {
+  BufWriter w = {settingsJson.body, sizeof(settingsJson.body), 0};
+  w.add("{\"timeout\":");
+  w.addUInt(SCREENSAVER_TIMEOUT / 1000);
+  w.add(",\"background\":\"");
+  w.addHex(colors.background);
+  w.add("\",\"active\":\"");
+  w.addHex(colors.active);
+  w.add("\",\"layout\":");
+  if (legacyLayoutId() == LAYOUT_CUSTOM) w.add("-1");
+  else w.addUInt(legacyLayoutId());
+  w.add(",\"cols\":");
+  w.addUInt(layout.cols);
+  w.add(",\"rows\":");
+  w.addUInt(layout.rows);
+  w.add(",\"pages\":");
+  w.addUInt(layout.pages);
+  w.add(",\"info_timeout\":");
+  w.addUInt(INFO_MODE_TIMEOUT / 1000);
+  w.add(",\"info_enabled\":");
+  w.add(infoModeEnabled ? "true" : "false");
+  w.add(",\"stream_clients\":");
+  w.addUInt(streamClientCap);
+  // Per-button arrays cover at least the six buttons older hosts expect
+  int listed = max(buttonCount, 6);
+  w.add(",\"debounce\":[");
+  for (int i = 0; i < listed; i++) {
+    if (i) w.add(",");
+    w.addUInt(buttons[i].debounceMs);
+  }
+  w.add("],\"colors\":[");
+  for (int i = 0; i < listed; i++) {
+    w.add(i ? ",\"" : "\"");
+    w.addHex(colors.normal[i]);
+    w.add("\"");
+  }
+  w.add("]}");
+  sealJsonCache(settingsJson, w, settingsRev);
+}
+
+void handleGetSettings() {
+  if (settingsJson.rev != settingsRev) {
+    DeckLock lock;
+    buildSettingsJson();
+  }
+  sendCachedJson(settingsJson);
+}
+
+// --- Deck API POST /deck ---
+// Labels and settings as one transaction. Body, every field optional:
+//   {"if_rev": N, "labels": {"1": "..."}, "settings": {...same fields as POST /settings...}}
+// Every field is validated before anything is applied (400 otherwise), and
+// the change then costs one redraw and one write-behind commit per changed blob, however
+// many fields it touched. With "if_rev" the body only applies while the deck
+// is still at that revision (409 otherwise), so two clients cannot silently
+// overwrite each other. Response: {"rev":N,"changed":true|false}.
+void handleDeck() {
+  server.sendHeader("Access-Control-Allow-Origin", "*");
+  if (!server.hasArg("plain")) {
+    server.send(400, "text/plain", "Missing body");
+    return;
+  }
+
+  DynamicJsonDocument doc(8192); // MAX_BUTTONS labels plus per-button settings arrays
+  DeserializationError error = deserializeJson(doc, server.arg("plain"));
+  if (error || !doc.is<JsonObject>()) {
+    Serial.printf("Deck JSON parse error: %s\n", error.c_str());
     server.send(400, "text/plain", "Invalid JSON");
     return;
   }
-  
-  bool changed = false;
-  for (int i = 0; i < buttonCount; i++) {
-    String key = String(i+1);
-    if (doc.containsKey(key)) {
-      String newLabel = doc[key].as<String>();
-      if (buttons[i].label != newLabel) {
-        Serial.printf("Button %d: '%s' -> '%s'\n", i+1, buttons[i].label.c_str(), newLabel.c_str());
-        buttons[i].label = newLabel;
-        changed = true;
-      }
+  if ((doc.containsKey("labels") && !doc["labels"].is<JsonObject>()) ||
+      (doc.containsKey("settings") && !doc["settings"].is<JsonObject>())) {
+    server.send(400, "text/plain", "labels and settings must be objects");
+    return;
+  }
+
+  DeckChange change = {};
+  uint32_t rev;
+  int code = 200;
+  {
+    DeckLock lock;
+    if (doc.containsKey("if_rev") && doc["if_rev"].as<uint32_t>() != deckRev) {
+      code = 409;
+    } else if ((doc.containsKey("settings") && !validSettingsJson(doc["settings"].as<JsonObject>())) ||
+               (doc.containsKey("labels") && !validLabelsJson(doc["labels"].as<JsonObject>()))) {
+      code = 400;
+    } else {
+      if (doc.containsKey("settings")) applySettingsJson(doc["settings"].as<JsonObject>(), change);
+      if (doc.containsKey("labels")) applyLabelsJson(doc["labels"].as<JsonObject>(), change);
+      commitDeckChange(change);
     }
+    rev = deckRev;
   }
-  
-  if (changed) {
-    saveStates();
-    drawButtons();
-    Serial.println("Config updated and saved!");
-  } else {
-    Serial.println("No changes detected in config");
+
+  if (code == 400) {
+    server.send(400, "text/plain", "Invalid settings or labels");
+    return;
   }
-  
-  Serial.println("=== CONFIG COMPLETE ===");
-  server.send(200, "text/plain", "OK");
+  bool changed = change.labels || change.settings;
+  if (changed) Serial.printf("Deck updated, rev %u\n", (unsigned)rev);
+  server.send(code, "application/json", "{\"rev\":" + String(rev) + ",\"changed\":" + (changed ? "true" : "false") + "}");
 }
 
-// --- Settings API GET /settings ---
-void handleGetSettings() {
-  server.sendHeader("Access-Control-Allow-Origin", "*");
-  server.sendHeader("Content-Type", "application/json");
-  
-  String payload = "{";
-  payload += "\"timeout\":" + String(SCREENSAVER_TIMEOUT / 1000) + ",";
-  payload += "\"background\":\"" + rgb565ToHex(colors.background) + "\",";
-  payload += "\"active\":\"" + rgb565ToHex(colors.active) + "\",";
-  payload += "\"layout\":" + String(currentLayout) + ",";
-  payload += "\"info_timeout\":" + String(INFO_MODE_TIMEOUT / 1000) + ",";
-  payload += "\"info_enabled\":" + String(infoModeEnabled ? "true" : "false") + ",";
-  payload += "\"colors\":[";
-  for (int i = 0; i < 6; i++) {
-    payload += "\"" + rgb565ToHex(colors.normal[i]) + "\"";
-    if (i < 5) payload += ",";
+// --- Deck API GET /deck ---
+// {"rev":N,"labels":{"1":"...",...},"settings":{...as GET /settings...}}
+void handleGetDeck() {
+  DynamicJsonDocument doc(4096);
+  String payload;
+  {
+    DeckLock lock;
+    doc["rev"] = deckRev;
+    JsonObject labels = doc.createNestedObject("labels");
+    for (int i = 0; i < buttonCount; i++) labels[String(i + 1)] = buttons[i].label;
+    if (settingsJson.rev != settingsRev) buildSettingsJson();
+    serializeJson(doc, payload);
+    payload.remove(payload.length() - 1); // reopen the object for the cached settings body
+    payload += ",\"settings\":";
+    payload += settingsJson.body;
+    payload += "}";
   }
-  payload += "]}";
-  
+  server.sendHeader("Access-Control-Allow-Origin", "*");
   server.send(200, "application/json", payload);
 }
 
@@ -546,11 +3364,13 @@ void handleSettings() {
   }
   
   String body = server.arg("plain");
+#if LOG_HTTP_BODIES
   Serial.println("=== SETTINGS REQUEST ===");
   Serial.println("Raw body: " + body);
+#endif
   
   // Parse JSON using ArduinoJson
-  DynamicJsonDocument doc(1024);
+  DynamicJsonDocument doc(3072); // per-button arrays up to MAX_BUTTONS
   DeserializationError error = deserializeJson(doc, body);
   
   if (error) {
@@ -559,8 +3379,101 @@ void handleSettings() {
     return;
   }
   
+  DeckChange change = {};
+  bool valid;
+  {
+    DeckLock lock;
+    valid = applySettingsJson(doc.as<JsonObject>(), change);
+    if (valid) commitDeckChange(change);
+  }
+  if (!valid) {
+    server.send(400, "text/plain", "Invalid settings");
+    return;
+  }
+  if (change.settings) {
+    Serial.println("Settings updated and saved!");
+  } else {
+    Serial.println("No changes detected in settings");
+  }
+  
+  Serial.println("=== SETTINGS COMPLETE ===");
+  server.send(200, "text/plain", "OK");
+}
+
+// The layout a /settings body asks for, over the current one: legacy id
+// (0 = 2x2, 1 = 3x2) or an explicit cols/rows/pages grid. False if none.
+bool settingsLayout(JsonObject doc, int &cols, int &rows, int &pages) {
+  cols = layout.cols;
+  rows = layout.rows;
+  pages = layout.pages;
+  if (!doc.containsKey("layout") && !doc.containsKey("cols") && !doc.containsKey("rows") && !doc.containsKey("pages")) return false;
+  if (doc.containsKey("layout")) {
+    int id = doc["layout"].as<int>();
+    if (id == LAYOUT_2x2 || id == LAYOUT_3x2) {
+      cols = id == LAYOUT_3x2 ? 3 : 2;
+      rows = 2;
+      pages = 1;
+    }
+  }
+  if (doc.containsKey("cols")) cols = doc["cols"].as<int>();
+  if (doc.containsKey("rows")) rows = doc["rows"].as<int>();
+  if (doc.containsKey("pages")) pages = doc["pages"].as<int>();
+  return true;
+}
+
+// Six hex digits, "rrggbb" as hexToRGB565() reads it
+bool validHexColor(JsonVariant v) {
+  const char *hex = v.as<const char*>();
+  if (!hex || strlen(hex) != 6) return false;
+  for (int i = 0; i < 6; i++) {
+    if (!isxdigit((unsigned char)hex[i])) return false;
+  }
+  return true;
+}
+
+bool validTimeout(JsonVariant v) {
+  return v.is<unsigned long>() && v.as<unsigned long>() >= 1 && v.as<unsigned long>() <= TIMEOUT_MAX_S;
+}
+
+// Checks every /settings field a body carries, so a request is applied
+// whole or not at all; call with the deck lock held (reads the layout)
+bool validSettingsJson(JsonObject doc) {
+  int cols, rows, pages;
+  if (settingsLayout(doc, cols, rows, pages) && !validLayout(cols, rows, pages)) return false;
+  if (doc.containsKey("timeout") && !validTimeout(doc["timeout"])) return false;
+  if (doc.containsKey("info_timeout") && !validTimeout(doc["info_timeout"])) return false;
+  if (doc.containsKey("info_enabled") && !doc["info_enabled"].is<bool>()) return false;
+  if (doc.containsKey("stream_clients") && !doc["stream_clients"].is<int>()) return false;
+  if (doc.containsKey("background") && !validHexColor(doc["background"])) return false;
+  if (doc.containsKey("active") && !validHexColor(doc["active"])) return false;
+  if (doc.containsKey("debounce")) {
+    if (doc["debounce"].is<JsonArray>()) {
+      JsonArray list = doc["debounce"];
+      for (size_t i = 0; i < list.size(); i++) {
+        if (!list[i].isNull() && !list[i].is<int>()) return false;
+      }
+    } else if (!doc["debounce"].is<int>()) {
+      return false;
+    }
+  }
+  if (doc.containsKey("colors")) {
+    if (!doc["colors"].is<JsonArray>()) return false;
+    JsonArray list = doc["colors"];
+    for (size_t i = 0; i < list.size(); i++) {
+      if (!validHexColor(list[i])) return false;
+    }
+  }
+  return true;
+}
+
+// Applies any subset of the /settings fields into change; false, with
+// nothing applied, unless validSettingsJson() accepts the whole body
+bool applySettingsJson(JsonObject doc, DeckChange &change) {
+  if (!validSettingsJson(doc)) return false;
   bool changed = false;
   bool layoutChanged = false;
+  int cols, rows, pages;
+  bool layoutGiven = settingsLayout(doc, cols, rows, pages);
   
   // Parse timeout
   if (doc.containsKey("timeout")) {
@@ -591,22 +3504,30 @@ void handleSettings() {
       
       // If info mode was disabled and was active, return to buttons
       if (!infoModeEnabled && infoModeActive) {
-        resetInfoMode();
+        postUi(UI_RESET_INFO);
       }
     }
   }
   
-  // Parse layout
-  if (doc.containsKey("layout")) {
-    LayoutType newLayout = (LayoutType)doc["layout"].as<int>();
-    if (newLayout != currentLayout) {
-      currentLayout = newLayout;
-      layoutChanged = true;
+  // Subscriber cap for /stream; clients already connected over a lower cap stay
+  if (doc.containsKey("stream_clients")) {
+    uint8_t newCap = constrain(doc["stream_clients"].as<int>(), 1, MAX_STREAM_CLIENTS);
+    if (newCap != streamClientCap) {
+      streamClientCap = newCap;
       changed = true;
-      Serial.printf("Layout changed to: %d\n", currentLayout);
+      Serial.printf("Stream client cap changed to: %d\n", streamClientCap);
     }
   }
   
+  // Apply the layout resolved above
+  if (layoutGiven && (cols != layout.cols || rows != layout.rows || pages != layout.pages)) {
+    setLayout(cols, rows, pages);
+    layoutChanged = true;
+    stateRev++; // /state lists buttonCount keys
+    changed = true;
+    Serial.printf("Layout changed to: %dx%d, %d page(s)\n", cols, rows, pages);
+  }
+  
   // Parse background color
   if (doc.containsKey("background")) {
     String hexColor = doc["background"].as<String>();
@@ -629,10 +3550,24 @@ void handleSettings() {
     }
   }
   
+  // Parse per-button debounce: one value for all buttons or an array
+  if (doc.containsKey("debounce")) {
+    for (int i = 0; i < MAX_BUTTONS; i++) {
+      JsonVariant v = doc["debounce"].is<JsonArray>() ? doc["debounce"][i] : doc["debounce"];
+      if (v.isNull()) continue;
+      uint16_t newDebounce = constrain(v.as<int>(), 0, 1000);
+      if (newDebounce != buttons[i].debounceMs) {
+        buttons[i].debounceMs = newDebounce;
+        changed = true;
+        Serial.printf("Button %d debounce changed to: %u ms\n", i+1, newDebounce);
+      }
+    }
+  }
+
   // Parse button colors
-  if (doc.containsKey("colors") && doc["colors"].is<JsonArray>()) {
+  if (doc.containsKey("colors")) {
     JsonArray colorArray = doc["colors"];
-    for (int i = 0; i < 6 && i < colorArray.size(); i++) { // Parse all 6 colors
+    for (int i = 0; i < MAX_BUTTONS && i < (int)colorArray.size(); i++) {
       String hexColor = colorArray[i].as<String>();
       uint16_t newColor = hexToRGB565(hexColor);
       if (newColor != colors.normal[i]) {
@@ -644,67 +3579,193 @@ void handleSettings() {
   }
   
   if (changed) {
-    saveSettings();
+    change.settings = true;
     if (layoutChanged) {
-      setupButtonLayout();
+      setupButtonLayout(); // buttonCount is current for labels applied after this
+      change.layout = true;
     }
-    // Don't draw buttons if info mode is active
-    if (!infoModeActive) {
-      drawButtons();
-    }
-    Serial.println("Settings updated and saved!");
-  } else {
-    Serial.println("No changes detected in settings");
   }
-  
-  Serial.println("=== SETTINGS COMPLETE ===");
-  server.send(200, "text/plain", "OK");
+  return true;
 }
 
 void showApiUrlForStartup(const String &apiUrl, unsigned long ms) {
+  invalidateDeck();
   tft.fillScreen(tft.color565(10,30,70));
   tft.setTextDatum(MC_DATUM);
   tft.setTextColor(TFT_WHITE);
   tft.drawCentreString("API URL:", tft.width()/2, tft.height()/2 - 12, 2);
   tft.drawCentreString(apiUrl, tft.width()/2, tft.height()/2 + 12, 2);
-  delay(ms);
+  overlayUntil = millis() + ms; // uiTask returns to the deck afterwards
 }
 
-void saveStates() {
-  prefs.begin("buttons", false);
-  for (int i = 0; i < 6; i++) { // Save all 6 buttons
-    prefs.putBool(("state" + String(i)).c_str(), buttons[i].state);
-    prefs.putString(("label" + String(i)).c_str(), buttons[i].label);
+void closeOverlay() {
+  overlayUntil = 0;
+  if (apModeActive) {
+    showAPModeScreen(); // keep AP configuration screen visible
+  } else {
+    drawButtons();
   }
-  prefs.end();
 }
 
-void saveSettings() {
-  prefs.begin("settings", false);
-  prefs.putULong("timeout", SCREENSAVER_TIMEOUT);
-  prefs.putUShort("bg_color", colors.background);
-  prefs.putUShort("active_color", colors.active);
-  prefs.putInt("layout", currentLayout);
-  prefs.putULong("info_timeout", INFO_MODE_TIMEOUT);
-  prefs.putBool("info_enabled", infoModeEnabled);
-  for (int i = 0; i < 6; i++) {
-    prefs.putUShort(("color" + String(i)).c_str(), colors.normal[i]);
+// --- Write-behind persistence ---
+void markStatesDirty() {
+  unsigned long now = millis();
+  if (!statesDirty && !settingsDirty) firstDirtyMs = now;
+  statesDirty = true;
+  stateRev++;
+  lastDirtyMs = now;
+  persistStats.requests++;
+}
+
+void markSettingsDirty() {
+  unsigned long now = millis();
+  if (!statesDirty && !settingsDirty) firstDirtyMs = now;
+  settingsDirty = true;
+  settingsRev++;
+  lastDirtyMs = now;
+  persistStats.requests++;
+}
+
+void servicePersistence() {
+  if (!statesDirty && !settingsDirty) return;
+  unsigned long now = millis();
+  if (now - lastDirtyMs >= PERSIST_QUIET_MS || now - firstDirtyMs >= PERSIST_MAX_DELAY_MS) {
+    flushPersistence();
+  }
+}
+
+// Commits pending changes right away (deep sleep, restart)
+void flushPersistence() {
+  if (statesDirty) saveStates();
+  if (settingsDirty) saveSettings();
+}
+
+uint32_t crc32(const uint8_t *data, size_t len) {
+  uint32_t crc = 0xFFFFFFFF;
+  while (len--) {
+    crc ^= *data++;
+    for (int k = 0; k < 8; k++) crc = (crc >> 1) ^ (0xEDB88320 & -(crc & 1));
+  }
+  return ~crc;
+}
+
+template <typename T> void sealBlob(T &blob, uint8_t version) {
+  blob.magic = BLOB_MAGIC;
+  blob.version = version;
+  blob.size = sizeof(T);
+  blob.crc = crc32((const uint8_t*)&blob, offsetof(T, crc));
+}
+
+template <typename T> bool blobValid(const T &blob, uint8_t version) {
+  return blob.magic == BLOB_MAGIC && blob.version == version && blob.size == sizeof(T) &&
+         blob.crc == crc32((const uint8_t*)&blob, offsetof(T, crc));
+}
+
+// Reads a blob from an open namespace; false if missing, truncated or corrupt
+template <typename T> bool readBlob(const char *key, T &blob, uint8_t version) {
+  if (prefs.getBytesLength(key) != sizeof(T)) return false;
+  prefs.getBytes(key, &blob, sizeof(T));
+  if (!blobValid(blob, version)) {
+    persistStats.crcErrors++;
+    return false;
+  }
+  return true;
+}
+
+// Writes a blob unless NVS already holds the same bytes
+template <typename T> void commitBlob(const char *ns, const char *key, const T &blob, T &committed, Histogram &hist) {
+  if (memcmp(&blob, &committed, sizeof(T)) == 0) {
+    persistStats.skipped++;
+    return;
   }
+  unsigned long start = micros();
+  prefs.begin(ns, false);
+  prefs.putBytes(key, &blob, sizeof(T));
   prefs.end();
+  committed = blob;
+
+  uint32_t us = micros() - start;
+  persistStats.commits++;
+  persistStats.bytesWritten += sizeof(T);
+  hist.observe(us);
+  persistStats.lastCommitUs = us;
+  persistStats.totalCommitUs += us;
+  if (us > persistStats.maxCommitUs) persistStats.maxCommitUs = us;
+}
+
+void copyLabel(char *dst, const String &src) {
+  strncpy(dst, src.c_str(), LABEL_MAX_LEN);
+  dst[LABEL_MAX_LEN] = '\0';
+}
+
+void packButtons(ButtonsBlob &blob) {
+  memset(&blob, 0, sizeof(blob));
+  for (int i = 0; i < MAX_BUTTONS; i++) {
+    if (buttons[i].state) blob.states |= 1ULL << i;
+    copyLabel(blob.labels[i], buttons[i].label);
+  }
+  sealBlob(blob, BUTTONS_BLOB_VERSION);
+}
+
+void packSettings(SettingsBlob &blob) {
+  memset(&blob, 0, sizeof(blob));
+  blob.timeout = SCREENSAVER_TIMEOUT;
+  blob.background = colors.background;
+  blob.active = colors.active;
+  blob.cols = layout.cols;
+  blob.rows = layout.rows;
+  blob.pages = layout.pages;
+  blob.infoTimeout = INFO_MODE_TIMEOUT;
+  blob.infoEnabled = infoModeEnabled;
+  strncpy(blob.ssid, savedSSID.c_str(), sizeof(blob.ssid) - 1);
+  strncpy(blob.password, savedPassword.c_str(), sizeof(blob.password) - 1);
+  for (int i = 0; i < MAX_BUTTONS; i++) {
+    blob.normal[i] = colors.normal[i];
+    blob.debounce[i] = buttons[i].debounceMs;
+  }
+  blob.streamClients = streamClientCap;
+  sealBlob(blob, SETTINGS_BLOB_VERSION);
+}
+
+void saveStates() {
+  statesDirty = false;
+  ButtonsBlob blob;
+  packButtons(blob);
+  commitBlob("buttons", "deck", blob, committedButtons, metrics.nvsCommitUs[0]);
+}
+
+void saveSettings() {
+  settingsDirty = false;
+  SettingsBlob blob;
+  packSettings(blob);
+  commitBlob("settings", "cfg", blob, committedSettings, metrics.nvsCommitUs[1]);
 }
 
 void loadSettings() {
   initDefaultColors();
-  
-  prefs.begin("settings", true);
+
+  for (int i = 0; i < MAX_BUTTONS; i++) buttons[i].debounceMs = DEFAULT_DEBOUNCE_MS;
+
+  SettingsBlob blob;
+  prefs.begin("settings", false);
+  if (readBlob("cfg", blob, SETTINGS_BLOB_VERSION)) {
+    applySettingsBlob(blob);
+    prefs.end();
+    committedSettings = blob;
+    return;
+  }
+
+  // Legacy per-key layout (or a fresh device): read it once, then replace it with the blob
+  const char* colorKeys[6] = {"color0", "color1", "color2", "color3", "color4", "color5"};
+  bool legacy = prefs.isKey("timeout") || prefs.isKey("wifi_ssid");
   SCREENSAVER_TIMEOUT = prefs.getULong("timeout", 900000);
   colors.background = prefs.getUShort("bg_color", colors.background);
   colors.active = prefs.getUShort("active_color", colors.active);
-  currentLayout = (LayoutType)prefs.getInt("layout", LAYOUT_2x2);
+  setLayout(prefs.getInt("layout", LAYOUT_2x2) == LAYOUT_3x2 ? 3 : 2, 2, 1);
   INFO_MODE_TIMEOUT = prefs.getULong("info_timeout", 120000);
   infoModeEnabled = prefs.getBool("info_enabled", true);
   for (int i = 0; i < 6; i++) {
-    colors.normal[i] = prefs.getUShort(("color" + String(i)).c_str(), colors.normal[i]);
+    colors.normal[i] = prefs.getUShort(colorKeys[i], colors.normal[i]);
   }
 
   // Load saved WiFi credentials if present
@@ -712,16 +3773,114 @@ void loadSettings() {
   savedPassword = prefs.getString("wifi_pass", savedPassword);
 
   prefs.end();
+
+  // The blob is committed before the legacy keys go, so a power cut in
+  // between leaves either layout readable
+  memset(&committedSettings, 0, sizeof(committedSettings));
+  saveSettings();
+  if (legacy) {
+    const char* legacyKeys[] = {"timeout", "bg_color", "active_color", "layout", "info_timeout",
+                                "info_enabled", "wifi_ssid", "wifi_pass"};
+    prefs.begin("settings", false);
+    for (const char* key : legacyKeys) prefs.remove(key);
+    for (int i = 0; i < 6; i++) prefs.remove(colorKeys[i]);
+    prefs.end();
+    persistStats.migrations++;
+    Serial.println("Migrated settings to blob format");
+  }
+}
+
+void applySettingsBlob(SettingsBlob &blob) {
+  SCREENSAVER_TIMEOUT = blob.timeout;
+  colors.background = blob.background;
+  colors.active = blob.active;
+  if (!setLayout(blob.cols, blob.rows, blob.pages)) setLayout(2, 2, 1);
+  INFO_MODE_TIMEOUT = blob.infoTimeout;
+  infoModeEnabled = blob.infoEnabled;
+  blob.ssid[sizeof(blob.ssid) - 1] = '\0';
+  blob.password[sizeof(blob.password) - 1] = '\0';
+  savedSSID = String(blob.ssid);
+  savedPassword = String(blob.password);
+  for (int i = 0; i < MAX_BUTTONS; i++) {
+    colors.normal[i] = blob.normal[i];
+    buttons[i].debounceMs = blob.debounce[i];
+  }
+  streamClientCap = constrain((int)blob.streamClients, 1, MAX_STREAM_CLIENTS);
+}
+
+void applyButtonsBlob(ButtonsBlob &blob) {
+  for (int i = 0; i < MAX_BUTTONS; i++) {
+    buttons[i].state = blob.states & (1ULL << i);
+    blob.labels[i][LABEL_MAX_LEN] = '\0';
+    buttons[i].label = String(blob.labels[i]);
+  }
+}
+
+// --- Warm resume (RTC snapshot) ---
+// Called after flushPersistence(), so the blobs match NVS byte for byte
+void saveWarmState() {
+  packButtons(rtcWarm.buttons);
+  packSettings(rtcWarm.settings);
+  rtcWarm.page = currentPage;
+  sealBlob(rtcWarm, WARM_STATE_VERSION);
+}
+
+// Restores settings and buttons from RTC memory; false if the snapshot is missing or corrupt
+bool restoreWarmState() {
+  if (!blobValid(rtcWarm, WARM_STATE_VERSION) ||
+      !blobValid(rtcWarm.buttons, BUTTONS_BLOB_VERSION) ||
+      !blobValid(rtcWarm.settings, SETTINGS_BLOB_VERSION)) {
+    if (rtcWarm.magic) persistStats.crcErrors++;
+    return false;
+  }
+  initDefaultColors();
+  applySettingsBlob(rtcWarm.settings);
+  applyButtonsBlob(rtcWarm.buttons);
+  // The snapshot was taken right after a flush: NVS holds the same bytes
+  committedSettings = rtcWarm.settings;
+  committedButtons = rtcWarm.buttons;
+  persistStats.warmResumes++;
+  return true;
 }
 
 // --- Load button states and labels from NVS ---
 void loadStates() {
-  prefs.begin("buttons", true); // read-only
-  for (int i = 0; i < 6; i++) { // Load all 6 buttons
-    buttons[i].state = prefs.getBool(("state" + String(i)).c_str(), false);
-    buttons[i].label = prefs.getString(("label" + String(i)).c_str(), String(i+1));
+  ButtonsBlob blob;
+  prefs.begin("buttons", false);
+  if (readBlob("deck", blob, BUTTONS_BLOB_VERSION)) {
+    applyButtonsBlob(blob);
+    prefs.end();
+    committedButtons = blob;
+    return;
+  }
+
+  // Legacy per-key layout (or a fresh device)
+  bool legacy = prefs.isKey("state0") || prefs.isKey("label0");
+  for (int i = 0; i < MAX_BUTTONS; i++) {
+    char stateKey[8], labelKey[8];
+    snprintf(stateKey, sizeof(stateKey), "state%d", i);
+    snprintf(labelKey, sizeof(labelKey), "label%d", i);
+    buttons[i].state = prefs.getBool(stateKey, false);
+    buttons[i].label = prefs.getString(labelKey, String(i+1));
   }
   prefs.end();
+
+  // Commit the blob first, then drop the legacy keys (see loadSettings)
+  memset(&committedButtons, 0, sizeof(committedButtons));
+  saveStates();
+  if (legacy) {
+    prefs.begin("buttons", false);
+    for (int i = 0; i < MAX_BUTTONS; i++) {
+      char stateKey[8], labelKey[8];
+      snprintf(stateKey, sizeof(stateKey), "state%d", i);
+      snprintf(labelKey, sizeof(labelKey), "label%d", i);
+      prefs.remove(stateKey);
+      prefs.remove(labelKey);
+    }
+    prefs.end();
+    persistStats.migrations++;
+    Serial.println("Migrated button states to blob format");
+  }
 }
 
 void initDefaultColors() {
@@ -733,16 +3892,103 @@ void initDefaultColors() {
   colors.normal[3] = tft.color565(95,158,160);   // cadet blue
   colors.normal[4] = tft.color565(255,99,71);    // tomato
   colors.normal[5] = tft.color565(138,43,226);   // blue violet
+  // Further buttons cycle through the same palette
+  for (int i = 6; i < MAX_BUTTONS; i++) colors.normal[i] = colors.normal[i % 6];
+}
+
+// --- Idle power tier ---
+const char *powerModeName() {
+  static const char *names[] = {"manual", "dfs", "light_sleep"};
+  return names[powerMode];
+}
+
+// Picks the best power management the build supports; starts in the active tier
+void setupPower() {
+  powerMutex = xSemaphoreCreateMutex();
+  esp_pm_config_esp32_t pm = {(int)POWER_MAX_MHZ, (int)POWER_MIN_MHZ, true};
+  if (esp_pm_configure(&pm) == ESP_OK) {
+    powerMode = POWER_MODE_LIGHT_SLEEP;
+  } else {
+    pm.light_sleep_enable = false;
+    if (esp_pm_configure(&pm) == ESP_OK) powerMode = POWER_MODE_DFS;
+  }
+
+  if (powerMode != POWER_MODE_MANUAL) {
+    esp_pm_lock_create(ESP_PM_CPU_FREQ_MAX, 0, "deck", &powerFreqLock);
+    esp_pm_lock_acquire(powerFreqLock);
+  }
+  if (powerMode == POWER_MODE_LIGHT_SLEEP) {
+    esp_pm_lock_create(ESP_PM_NO_LIGHT_SLEEP, 0, "deck", &powerSleepLock);
+    esp_pm_lock_acquire(powerSleepLock);
+    esp_sleep_enable_gpio_wakeup();
+  }
+  powerStats.tierSinceUs = esp_timer_get_time();
+  Serial.printf("Power management: %s\n", powerModeName());
+}
+
+void setPowerTier(uint8_t tier) {
+  xSemaphoreTake(powerMutex, portMAX_DELAY);
+  if (powerTier != tier) {
+    int64_t now = esp_timer_get_time();
+    if (powerTier == POWER_IDLE) powerStats.idleUs += now - powerStats.tierSinceUs;
+    else powerStats.activeUs += now - powerStats.tierSinceUs;
+    powerStats.tierSinceUs = now;
+
+    if (tier == POWER_IDLE) {
+      powerStats.idleEntries++;
+      powerTier = tier;
+      if (wifiPhase == NET_ONLINE) WiFi.setSleep(WIFI_PS_MAX_MODEM);
+      if (powerMode == POWER_MODE_LIGHT_SLEEP) {
+        touchWakeArmed = true;
+        gpio_wakeup_enable((gpio_num_t)XPT2046_IRQ, GPIO_INTR_LOW_LEVEL);
+        esp_pm_lock_release(powerSleepLock);
+      }
+      if (powerMode == POWER_MODE_MANUAL) setCpuFrequencyMhz(POWER_MIN_MHZ);
+      else esp_pm_lock_release(powerFreqLock);
+    } else {
+      if (powerMode == POWER_MODE_MANUAL) setCpuFrequencyMhz(POWER_MAX_MHZ);
+      else esp_pm_lock_acquire(powerFreqLock);
+      if (powerMode == POWER_MODE_LIGHT_SLEEP) {
+        esp_pm_lock_acquire(powerSleepLock);
+        gpio_wakeup_disable((gpio_num_t)XPT2046_IRQ);
+        gpio_set_intr_type((gpio_num_t)XPT2046_IRQ, GPIO_INTR_NEGEDGE);
+        touchWakeArmed = false;
+        gpio_intr_enable((gpio_num_t)XPT2046_IRQ);
+      }
+      if (wifiPhase == NET_ONLINE) WiFi.setSleep(WIFI_PS_MIN_MODEM);
+      powerWakeMs = millis();
+      powerTier = tier;
+    }
+  }
+  xSemaphoreGive(powerMutex);
+}
+
+// Called for every pushed frame; closes a pending wake-to-first-frame measurement
+void notePowerFrame() {
+  uint32_t irq = wakeIrqUs;
+  if (!irq) return;
+  wakeIrqUs = 0;
+  uint32_t us = micros() - irq;
+  if (us > WAKE_FRAME_WINDOW_US) return; // the wake touch drew nothing; this frame is unrelated
+  powerStats.wakeFrames++;
+  powerStats.lastWakeFrameUs = us;
+  powerStats.totalWakeFrameUs += us;
+  if (us > powerStats.maxWakeFrameUs) powerStats.maxWakeFrameUs = us;
 }
 
 // --- Enter deep sleep ---
 void enterDeepSleep() {
   Serial.println("Entering deep sleep...");
+  invalidateDeck();
   tft.fillScreen(tft.color565(0,0,0));
   tft.setTextDatum(MC_DATUM);
   tft.setTextColor(TFT_WHITE);
   tft.drawCentreString("Sleep mode", tft.width()/2, tft.height()/2, 2);
 
+  // Don't lose changes still waiting for the quiet period
+  flushPersistence();
+  saveWarmState();
+
   // Configure wakeup on touch IRQ pin
   esp_sleep_enable_ext0_wakeup((gpio_num_t)DEEPSLEEP_WAKEUP_PIN, DEEPSLEEP_PIN_ACT);
 
@@ -762,17 +4008,28 @@ uint16_t hexToRGB565(const String& hexColor) {
 }
 
 String rgb565ToHex(uint16_t color) {
-  // Convert RGB565 back to hex string for web interface
-  uint8_t r = (color >> 11) * 255 / 31;
-  uint8_t g = ((color >> 5) & 0x3F) * 255 / 63;
-  uint8_t b = (color & 0x1F) * 255 / 31;
-  
   char hexStr[7];
-  sprintf(hexStr, "%02x%02x%02x", r, g, b);
+  rgb565ToHex(color, hexStr);
   return String(hexStr);
 }
 
+// Convert RGB565 back to a hex string for the web interface, without sprintf
+void rgb565ToHex(uint16_t color, char out[7]) {
+  static const char digits[] = "0123456789abcdef";
+  uint8_t rgb[3] = {
+    (uint8_t)((color >> 11) * 255 / 31),
+    (uint8_t)(((color >> 5) & 0x3F) * 255 / 63),
+    (uint8_t)((color & 0x1F) * 255 / 31)
+  };
+  for (int i = 0; i < 3; i++) {
+    out[i*2] = digits[rgb[i] >> 4];
+    out[i*2 + 1] = digits[rgb[i] & 0x0F];
+  }
+  out[6] = '\0';
+}
+
 void showStartupScreen() {
+  invalidateDeck();
   // Blue background
   tft.fillScreen(tft.color565(70, 130, 180)); // Steel blue background
   
@@ -786,10 +4043,11 @@ void showStartupScreen() {
   tft.setTextColor(tft.color565(128, 128, 128)); // Gray color
   tft.drawString("Version 1.1", tft.width()/2, tft.height()/2 + 25, 2);
   
-  delay(2000); // Show for 2 seconds
+  overlayUntil = millis() + 2000; // Show for 2 seconds (or until touched)
 }
 
 void showAPModeScreen() {
+  invalidateDeck();
   tft.fillScreen(colors.background);
   tft.setTextDatum(MC_DATUM);
   tft.setTextColor(TFT_WHITE);
@@ -799,6 +4057,169 @@ void showAPModeScreen() {
   tft.drawString("Open http://192.168.4.1/", tft.width()/2, tft.height()/2 + 45, 2);
 }
 
+// --- Background WiFi ---
+bool netCacheUsable(const NetCache &c) {
+  return c.magic == BLOB_MAGIC && c.version == NET_CACHE_VERSION && c.size == sizeof(NetCache) &&
+         c.crc == crc32((const uint8_t*)&c, offsetof(NetCache, crc)) &&
+         c.ssidCrc == crc32((const uint8_t*)savedSSID.c_str(), savedSSID.length());
+}
+
+void startWifi(bool coldBoot) {
+  showApiUrlOnConnect = coldBoot;
+  leaseRenewing = false;
+  wifiStartMs = wifiPhaseMs = millis();
+
+  WiFi.mode(WIFI_STA);
+  WiFi.setHostname("ESP32-CheapDeck");
+  WiFi.setAutoReconnect(true);
+
+  // RTC copy first (deep sleep wake), NVS copy otherwise
+  const NetCache *cache = nullptr;
+  if (netCacheUsable(rtcNetCache)) {
+    cache = &rtcNetCache;
+  } else {
+    prefs.begin("net", true);
+    if (readBlob("cache", netCache, NET_CACHE_VERSION) && netCacheUsable(netCache)) cache = &netCache;
+    prefs.end();
+  }
+
+  if (cache) {
+    Serial.printf("Connecting to WiFi: %s (cached channel %u)\n", savedSSID.c_str(), cache->channel);
+    WiFi.config(IPAddress(cache->ip), IPAddress(cache->gateway), IPAddress(cache->subnet), IPAddress(cache->dns));
+    WiFi.begin(savedSSID.c_str(), savedPassword.c_str(), cache->channel, cache->bssid);
+    wifiPhase = NET_FAST_CONNECT;
+  } else {
+    Serial.printf("Connecting to WiFi: %s\n", savedSSID.c_str());
+    WiFi.config(INADDR_NONE, INADDR_NONE, INADDR_NONE, INADDR_NONE);
+    WiFi.begin(savedSSID.c_str(), savedPassword.c_str());
+    wifiPhase = NET_FULL_CONNECT;
+  }
+}
+
+// Remembers how we got connected; NVS is only written when the values change.
+// Runs on netTask: prefs is shared with uiTask and the handlers, hence DeckLock.
+void cacheNetParams() {
+  DeckLock lock;
+  NetCache c;
+  memset(&c, 0, sizeof(c));
+  c.ssidCrc = crc32((const uint8_t*)savedSSID.c_str(), savedSSID.length());
+  memcpy(c.bssid, WiFi.BSSID(), 6);
+  c.channel = WiFi.channel();
+  c.ip = WiFi.localIP();
+  c.gateway = WiFi.gatewayIP();
+  c.subnet = WiFi.subnetMask();
+  c.dns = WiFi.dnsIP();
+  sealBlob(c, NET_CACHE_VERSION);
+
+  rtcNetCache = c;
+  if (memcmp(&c, &netCache, sizeof(c)) != 0) {
+    prefs.begin("net", false);
+    prefs.putBytes("cache", &c, sizeof(c));
+    prefs.end();
+    netCache = c;
+  }
+}
+
+// Runs once the address is one DHCP handed out
+void finishConnect() {
+  cacheNetParams();
+  startClockSync();
+  if (showApiUrlOnConnect) postUi(UI_SHOW_API_URL);
+}
+
+// After a fast connect: waits for the restarted DHCP client to bind. If it
+// never does, the cache is dropped so the next connect takes the full path
+// (lwIP keeps retrying DHCP in the meantime).
+void serviceLeaseRenew() {
+  if ((uint32_t)WiFi.localIP() != 0) {
+    leaseRenewing = false;
+    String ip = WiFi.localIP().toString();
+    Serial.printf("DHCP lease bound in %lu ms. IP: %s\n", millis() - wifiPhaseMs, ip.c_str());
+    finishConnect();
+  } else if (millis() - wifiPhaseMs > WIFI_CONNECT_TIMEOUT_MS) {
+    leaseRenewing = false;
+    Serial.println("No DHCP lease after fast reconnect, dropping the network cache");
+    DeckLock lock;
+    rtcNetCache.magic = 0;
+    netCache.magic = 0;
+    prefs.begin("net", false);
+    prefs.remove("cache");
+    prefs.end();
+  }
+}
+
+void serviceWifi() {
+  if (leaseRenewing) serviceLeaseRenew();
+  if (wifiPhase == NET_ONLINE || wifiPhase == NET_AP_MODE) return;
+
+  unsigned long now = millis();
+  if (WiFi.status() == WL_CONNECTED) {
+    bool fast = wifiPhase == NET_FAST_CONNECT;
+    wifiPhase = NET_ONLINE;
+    wifiConnectMs = now - wifiStartMs;
+    String ip = WiFi.localIP().toString();
+    Serial.printf("Connected in %lu ms. IP: %s%s\n", wifiConnectMs, ip.c_str(), fast ? " (cached)" : "");
+    Serial.printf("Hostname: ESP32-CheapDeck\n");
+    WiFi.setSleep(powerTier == POWER_IDLE ? WIFI_PS_MAX_MODEM : WIFI_PS_MIN_MODEM);
+
+    if (fast) {
+      // Hand the address back to DHCP; it usually confirms the same one
+      WiFi.config(INADDR_NONE, INADDR_NONE, INADDR_NONE, INADDR_NONE);
+      leaseRenewing = true;
+      wifiPhaseMs = now;
+    } else {
+      finishConnect();
+    }
+    return;
+  }
+
+  if (wifiPhase == NET_FAST_CONNECT && now - wifiPhaseMs > WIFI_FAST_TIMEOUT_MS) {
+    // Cached AP/lease did not work (AP moved channel, lease expired) - scan + DHCP
+    Serial.println("Fast reconnect failed, falling back to full scan");
+    rtcNetCache.magic = 0;
+    WiFi.disconnect();
+    WiFi.config(INADDR_NONE, INADDR_NONE, INADDR_NONE, INADDR_NONE);
+    WiFi.begin(savedSSID.c_str(), savedPassword.c_str());
+    wifiPhase = NET_FULL_CONNECT;
+    wifiPhaseMs = now;
+  } else if (now - wifiStartMs > WIFI_CONNECT_TIMEOUT_MS) {
+    Serial.println("No WiFi - entering AP setup mode.");
+    startAPMode();
+  }
+}
+
+// --- Clock ---
+void onSntpSync(struct timeval *tv) {
+  clockSource = CLOCK_SNTP;
+  clockSyncedMs = millis();
+  Serial.printf("Clock synced via SNTP: %ld\n", (long)tv->tv_sec);
+}
+
+// Starts SNTP in the background; it keeps re-syncing on its own (hourly by default)
+void startClockSync() {
+  sntp_set_time_sync_notification_cb(onSntpSync);
+  configTime(0, 0, NTP_SERVER); // system clock stays UTC, tzOffsetSec is applied when formatting
+}
+
+bool clockValid() {
+  return clockSource != CLOCK_NONE && time(nullptr) > CLOCK_MIN_EPOCH;
+}
+
+const char *clockSourceName() {
+  if (!clockValid()) return "none";
+  return clockSource == CLOCK_SNTP ? "sntp" : "host";
+}
+
+void startAPMode() {
+  // Start SoftAP for configuration
+  WiFi.softAP(apSSID.c_str());
+  apModeActive = true;
+  wifiPhase = NET_AP_MODE;
+  IPAddress apIP = WiFi.softAPIP();
+  Serial.printf("AP started: %s - %s\n", apSSID.c_str(), apIP.toString().c_str());
+  postUi(UI_SHOW_AP_SCREEN);
+}
+
 // --- New: save credentials handler ---
 void handleSaveCredentials() {
   Serial.println("=== SAVE CREDENTIALS REQUEST ===");
@@ -831,42 +4252,74 @@ void handleSaveCredentials() {
     return;
   }
 
+  uint8_t job = credJob.load();
+  if (job == CRED_PENDING || job == CRED_CONNECTING || job == CRED_CONNECTED) {
+    server.send(409, "text/plain", "Already connecting");
+    return;
+  }
+
   Serial.printf("Attempting to save/connect to SSID: %s\n", newSSID.c_str());
 
-  // Save to NVS
-  prefs.begin("settings", false);
-  prefs.putString("wifi_ssid", newSSID);
-  prefs.putString("wifi_pass", newPass);
-  prefs.end();
+  // Save to NVS (immediately - a restart follows on success)
+  {
+    DeckLock lock;
+    savedSSID = newSSID;
+    savedPassword = newPass;
+    saveSettings();
+  }
 
-  // Try to connect using new credentials
-  WiFi.softAPdisconnect(true);
-  delay(200);
-  WiFi.begin(newSSID.c_str(), newPass.c_str());
+  // netTask connects in the background (serviceCredentialJob)
+  credSSID = newSSID;
+  credPassword = newPass;
+  credJob = CRED_PENDING;
+  server.sendHeader("Access-Control-Allow-Origin", "*");
+  server.send(202, "text/plain", "Connecting - check /save-credentials/status");
+}
 
-  int tries = 0;
-  while (WiFi.status() != WL_CONNECTED && tries < 40) {
-    delay(500);
-    Serial.print(".");
-    tries++;
-  }
-  Serial.println();
+void handleCredentialStatus() {
+  static const char *names[] = {"idle", "pending", "connecting", "connected", "failed"};
+  uint8_t job = credJob.load();
+  unsigned long elapsed = job == CRED_IDLE || job == CRED_PENDING ? 0 :
+                          (job == CRED_CONNECTING ? millis() : credDoneMs) - credStartMs;
+  String payload = "{\"state\":\"" + String(names[job]) + "\",";
+  payload += "\"ssid\":\"" + credSSID + "\",";
+  payload += "\"elapsed_ms\":" + String(elapsed) + "}";
+  server.sendHeader("Access-Control-Allow-Origin", "*");
+  server.sendHeader("Cache-Control", "no-store");
+  server.send(200, "application/json", payload);
+}
 
-  if (WiFi.status() == WL_CONNECTED) {
-    Serial.println("Connected with new credentials. Restarting...");
-    server.send(200, "text/plain", "OK");
-    delay(500);
-    ESP.restart();
-    return;
-  } else {
-    // Failed - re-enable AP and inform user
-    WiFi.softAP(apSSID.c_str());
-    apModeActive = true;
-    IPAddress apIP = WiFi.softAPIP();
-    Serial.println("Failed to connect with provided credentials. AP restored.");
-    server.send(500, "text/plain", "Failed to connect with provided credentials");
-    showAPModeScreen();
-    return;
+// netTask: drives a credential change without blocking anything else
+void serviceCredentialJob() {
+  unsigned long now = millis();
+  switch (credJob.load()) {
+    case CRED_PENDING:
+      // Try to connect using new credentials
+      WiFi.softAPdisconnect(true);
+      WiFi.begin(credSSID.c_str(), credPassword.c_str());
+      credStartMs = now;
+      credJob = CRED_CONNECTING;
+      break;
+
+    case CRED_CONNECTING:
+      if (WiFi.status() == WL_CONNECTED) {
+        Serial.println("Connected with new credentials. Restarting...");
+        credDoneMs = now;
+        credJob = CRED_CONNECTED;
+        DeckLock lock;
+        flushPersistence();
+      } else if (now - credStartMs > CRED_CONNECT_TIMEOUT_MS) {
+        // Failed - re-enable AP and inform user
+        credDoneMs = now;
+        credJob = CRED_FAILED;
+        startAPMode();
+        Serial.println("Failed to connect with provided credentials. AP restored.");
+      }
+      break;
+
+    case CRED_CONNECTED:
+      if (now - credDoneMs > CRED_RESTART_DELAY_MS) ESP.restart();
+      break;
   }
 }
 
@@ -885,24 +4338,19 @@ void handleSerialCommands() {
     if (cmd == "FORGET" || cmd == "RESET_WIFI" || cmd == "CLEAR_WIFI") {
       Serial.println("Command received: clear WiFi credentials");
 
-      // Remove saved credentials from NVS
-      prefs.begin("settings", false);
-      prefs.remove("wifi_ssid");
-      prefs.remove("wifi_pass");
-      prefs.end();
-
-      // Reset in-memory values
-      savedSSID = String(SSID);
-      savedPassword = String(PASSWORD);
+      // Reset to the built-in credentials and persist right away
+      {
+        DeckLock lock;
+        savedSSID = String(SSID);
+        savedPassword = String(PASSWORD);
+        saveSettings();
+      }
 
       // Disconnect and start AP for reconfiguration
       WiFi.disconnect(true);
       delay(100);
-      WiFi.softAP(apSSID.c_str());
-      apModeActive = true;
+      startAPMode(); // also shows the AP screen
 
-      // Show AP screen and inform user
-      showAPModeScreen();
       Serial.println("WiFi credentials cleared. AP mode started (CheapDeck-Setup).");
     } else {
       Serial.printf("Unknown command: %s\n", cmd.c_str());
@@ -0,0 +1,291 @@
+// Arduino core stand-in for the host simulator (see ../README.md).
+// Just enough of arduino-esp32 for arduino.h: String, Serial, timing,
+// GPIO, ESP, FreeRTOS and a few ESP-IDF calls, backed by the host OS.
+#pragma once
+#include <cstdint>
+#include <cstddef>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <cstdarg>
+#include <cmath>
+#include <string>
+#include <algorithm>
+#include <time.h>
+#include <sys/time.h>
+
+using std::min;
+using std::max;
+typedef bool boolean;
+typedef uint8_t byte;
+
+#define HIGH 1
+#define LOW 0
+#define INPUT 0x01
+#define OUTPUT 0x03
+#define INPUT_PULLUP 0x05
+#define RISING 0x01
+#define FALLING 0x02
+#define CHANGE 0x03
+#define IRAM_ATTR
+#define PROGMEM
+#define F(x) x
+// RTC slow memory: a named section the simulator saves on deep sleep and
+// restores on a simulated touch wake
+#define RTC_DATA_ATTR __attribute__((section("rtc_data")))
+#define RTC_NOINIT_ATTR RTC_DATA_ATTR
+
+// --- String ---
+class StringSumHelper;
+
+class String {
+public:
+  String() {}
+  String(const char *c) : s(c ? c : "") {}
+  String(const std::string &c) : s(c) {}
+  String(const String &o) = default;
+  String(char c) : s(1, c) {}
+  String(unsigned char v, unsigned char base = 10) : s(fmt(v, base)) {}
+  String(int v, unsigned char base = 10) : s(base == 10 ? std::to_string(v) : fmt((unsigned long long)(unsigned)v, base)) {}
+  String(unsigned v, unsigned char base = 10) : s(fmt(v, base)) {}
+  String(long v, unsigned char base = 10) : s(base == 10 ? std::to_string(v) : fmt((unsigned long long)(unsigned long)v, base)) {}
+  String(unsigned long v, unsigned char base = 10) : s(fmt(v, base)) {}
+  String(long long v) : s(std::to_string(v)) {}
+  String(unsigned long long v, unsigned char base = 10) : s(fmt(v, base)) {}
+  String(float v, unsigned char decimals = 2) : s(fmtf(v, decimals)) {}
+  String(double v, unsigned char decimals = 2) : s(fmtf(v, decimals)) {}
+
+  String &operator=(const String &o) = default;
+  String &operator=(const char *c) { s = c ? c : ""; return *this; }
+
+  const char *c_str() const { return s.c_str(); }
+  unsigned length() const { return s.size(); }
+  bool reserve(unsigned n) { s.reserve(n); return true; }
+  bool isEmpty() const { return s.empty(); }
+
+  bool concat(const String &o) { s += o.s; return true; }
+  bool concat(const char *o) { if (o) s += o; return o != nullptr; }
+  bool concat(const char *o, unsigned n) { if (o) s.append(o, n); return o != nullptr; }
+  bool concat(char c) { s += c; return true; }
+  bool concat(int v) { s += std::to_string(v); return true; }
+  bool concat(unsigned v) { s += std::to_string(v); return true; }
+  bool concat(long v) { s += std::to_string(v); return true; }
+  bool concat(unsigned long v) { s += std::to_string(v); return true; }
+  bool concat(float v) { s += fmtf(v, 2); return true; }
+  bool concat(double v) { s += fmtf(v, 2); return true; }
+  template <typename T> String &operator+=(const T &v) { concat(v); return *this; }
+
+  friend StringSumHelper operator+(const String &a, const String &b);
+  friend StringSumHelper operator+(const String &a, const char *b);
+  friend StringSumHelper operator+(const char *a, const String &b);
+  friend StringSumHelper operator+(const String &a, char b);
+
+  bool equals(const String &o) const { return s == o.s; }
+  bool operator==(const String &o) const { return s == o.s; }
+  bool operator==(const char *o) const { return s == (o ? o : ""); }
+  bool operator!=(const String &o) const { return s != o.s; }
+  bool operator!=(const char *o) const { return !(*this == o); }
+  bool operator<(const String &o) const { return s < o.s; }
+  char operator[](unsigned i) const { return i < s.size() ? s[i] : 0; }
+  char &operator[](unsigned i) { return s[i]; }
+  char charAt(unsigned i) const { return (*this)[i]; }
+
+  bool startsWith(const String &p) const { return s.compare(0, p.s.size(), p.s) == 0; }
+  bool endsWith(const String &p) const { return s.size() >= p.s.size() && s.compare(s.size() - p.s.size(), p.s.size(), p.s) == 0; }
+  int indexOf(char c, unsigned from = 0) const { size_t p = s.find(c, from); return p == std::string::npos ? -1 : (int)p; }
+  int indexOf(const String &c, unsigned from = 0) const { size_t p = s.find(c.s, from); return p == std::string::npos ? -1 : (int)p; }
+  int lastIndexOf(char c) const { size_t p = s.rfind(c); return p == std::string::npos ? -1 : (int)p; }
+  String substring(unsigned a) const { return a < s.size() ? String(s.substr(a)) : String(); }
+  String substring(unsigned a, unsigned b) const {
+    if (a > b) std::swap(a, b);
+    return a < s.size() ? String(s.substr(a, b - a)) : String();
+  }
+  void remove(unsigned i) { if (i < s.size()) s.erase(i); }
+  void remove(unsigned i, unsigned n) { if (i < s.size()) s.erase(i, n); }
+  void replace(const String &from, const String &to) {
+    if (from.s.empty()) return;
+    for (size_t p = 0; (p = s.find(from.s, p)) != std::string::npos; p += to.s.size()) s.replace(p, from.s.size(), to.s);
+  }
+  void trim() {
+    size_t a = s.find_first_not_of(" \t\r\n"), b = s.find_last_not_of(" \t\r\n");
+    s = a == std::string::npos ? std::string() : s.substr(a, b - a + 1);
+  }
+  void toLowerCase() { for (char &c : s) c = tolower((unsigned char)c); }
+  void toUpperCase() { for (char &c : s) c = toupper((unsigned char)c); }
+  long toInt() const { return atol(s.c_str()); }
+  float toFloat() const { return atof(s.c_str()); }
+  void toCharArray(char *buf, unsigned n) const { if (n) { strncpy(buf, s.c_str(), n - 1); buf[n - 1] = 0; } }
+  void getBytes(unsigned char *buf, unsigned n) const { toCharArray((char *)buf, n); }
+
+private:
+  std::string s;
+  static std::string fmt(unsigned long long v, unsigned base) {
+    if (base < 2 || base > 36) base = 10;
+    char b[72];
+    int i = sizeof(b) - 1;
+    b[i] = 0;
+    do { b[--i] = "0123456789abcdefghijklmnopqrstuvwxyz"[v % base]; v /= base; } while (v);
+    return b + i;
+  }
+  static std::string fmtf(double v, unsigned char decimals) {
+    char b[48];
+    snprintf(b, sizeof(b), "%.*f", decimals, v);
+    return b;
+  }
+};
+
+// Result type of String concatenation, as in the Arduino core (ArduinoJson adapts it too)
+class StringSumHelper : public String {
+public:
+  StringSumHelper(const String &s) : String(s) {}
+  StringSumHelper(const char *p) : String(p) {}
+};
+
+inline StringSumHelper operator+(const String &a, const String &b) { StringSumHelper r(a); r.concat(b); return r; }
+inline StringSumHelper operator+(const String &a, const char *b) { StringSumHelper r(a); r.concat(b); return r; }
+inline StringSumHelper operator+(const char *a, const String &b) { StringSumHelper r(a); r.concat(b); return r; }
+inline StringSumHelper operator+(const String &a, char b) { StringSumHelper r(a); r.concat(b); return r; }
+
+// --- Print / Stream / Serial ---
+class Print {
+public:
+  virtual ~Print() {}
+  virtual size_t write(uint8_t c) = 0;
+  virtual size_t write(const uint8_t *b, size_t n) { size_t k = 0; while (n--) k += write(*b++); return k; }
+  size_t write(const char *str) { return write((const uint8_t *)str, strlen(str)); }
+  size_t print(const String &v) { return write(v.c_str()); }
+  size_t print(const char *v) { return write(v); }
+  template <typename T> size_t print(T v) { return print(String(v)); }
+  size_t println() { return write("\n"); }
+  template <typename T> size_t println(const T &v) { return print(v) + println(); }
+  size_t printf(const char *format, ...) __attribute__((format(printf, 2, 3)));
+};
+
+class Stream : public Print {
+public:
+  virtual int available() = 0;
+  virtual int read() = 0;
+  String readStringUntil(char terminator);
+  void setTimeout(unsigned long) {}
+};
+
+// Serial output goes to stderr (silenced with --quiet); input comes from
+// --serial-stdin, otherwise nothing is ever available
+class HardwareSerial : public Stream {
+public:
+  void begin(unsigned long) {}
+  void flush() { fflush(stderr); }
+  operator bool() const { return true; }
+  size_t write(uint8_t c) override;
+  size_t write(const uint8_t *b, size_t n) override;
+  int available() override;
+  int read() override;
+};
+extern HardwareSerial Serial;
+
+// --- Timing / GPIO ---
+unsigned long millis();
+unsigned long micros();
+void delay(unsigned long ms);
+void delayMicroseconds(unsigned int us);
+void yield();
+long map(long x, long inMin, long inMax, long outMin, long outMax);
+template <class T> T constrain(T a, T l, T h) { return a < l ? l : (a > h ? h : a); }
+
+void pinMode(uint8_t pin, uint8_t mode);
+int digitalRead(uint8_t pin);
+void digitalWrite(uint8_t pin, uint8_t value);
+void attachInterrupt(uint8_t pin, void (*isr)(void), int mode);
+void detachInterrupt(uint8_t pin);
+inline uint8_t digitalPinToInterrupt(uint8_t pin) { return pin; }
+
+// --- Network address ---
+class IPAddress {
+public:
+  IPAddress() {}
+  IPAddress(uint8_t a, uint8_t b, uint8_t c, uint8_t d) { bytes[0] = a; bytes[1] = b; bytes[2] = c; bytes[3] = d; }
+  IPAddress(uint32_t v) { memcpy(bytes, &v, 4); }
+  operator uint32_t() const { uint32_t v; memcpy(&v, bytes, 4); return v; }
+  uint8_t operator[](int i) const { return bytes[i]; }
+  String toString() const {
+    char b[16];
+    snprintf(b, sizeof(b), "%u.%u.%u.%u", bytes[0], bytes[1], bytes[2], bytes[3]);
+    return String(b);
+  }
+private:
+  uint8_t bytes[4] = {0, 0, 0, 0};
+};
+
+// --- ESP ---
+typedef int esp_err_t;
+#define ESP_OK 0
+#define ESP_FAIL -1
+#define ESP_ERR_NO_MEM 0x101
+#define ESP_ERR_INVALID_ARG 0x102
+#define ESP_ERR_INVALID_STATE 0x103
+#define ESP_ERR_NOT_FOUND 0x105
+#define ESP_ERR_NOT_SUPPORTED 0x106
+
+class EspClass {
+public:
+  void restart();
+  uint32_t getFreeHeap();
+  uint32_t getMaxAllocHeap();
+  uint32_t getMinFreeHeap();
+  uint32_t getHeapSize();
+};
+extern EspClass ESP;
+
+bool psramFound();
+uint32_t esp_random();
+int64_t esp_timer_get_time();
+bool setCpuFrequencyMhz(uint32_t mhz);
+uint32_t getCpuFrequencyMhz();
+
+// The firmware's clock calls must not touch the host clock: settimeofday()
+// only shifts the simulated wall clock. The simulator's own sources define
+// SIM_HOST_CLOCK to keep the libc names.
+int sim_settimeofday(const struct timeval *tv, const void *tz);
+int sim_gettimeofday(struct timeval *tv, void *tz);
+time_t sim_time(time_t *t);
+#ifndef SIM_HOST_CLOCK
+#define settimeofday(tv, tz) sim_settimeofday(tv, tz)
+#define gettimeofday(tv, tz) sim_gettimeofday(tv, tz)
+#define time(t) sim_time(t)
+#endif
+void configTime(long gmtOffsetSec, int daylightOffsetSec, const char *server1,
+                const char *server2 = nullptr, const char *server3 = nullptr);
+
+// --- FreeRTOS ---
+// Tasks are host threads; core pinning and priorities are recorded but not
+// enforced. One tick is one millisecond.
+typedef void *TaskHandle_t;
+typedef void *SemaphoreHandle_t;
+typedef uint32_t TickType_t;
+typedef int BaseType_t;
+typedef unsigned UBaseType_t;
+#define pdTRUE 1
+#define pdFALSE 0
+#define pdPASS 1
+#define portMAX_DELAY 0xffffffffu
+#define pdMS_TO_TICKS(ms) ((TickType_t)(ms))
+#define portTICK_PERIOD_MS 1
+#define portYIELD_FROM_ISR(woken) (void)(woken)
+
+BaseType_t xTaskCreatePinnedToCore(void (*fn)(void *), const char *name, uint32_t stack, void *arg,
+                                   UBaseType_t prio, TaskHandle_t *handle, BaseType_t core);
+void vTaskDelete(TaskHandle_t task);
+void vTaskDelay(TickType_t ticks);
+TickType_t xTaskGetTickCount();
+TaskHandle_t xTaskGetCurrentTaskHandle();
+UBaseType_t uxTaskGetStackHighWaterMark(TaskHandle_t task);
+BaseType_t xTaskNotifyGive(TaskHandle_t task);
+void vTaskNotifyGiveFromISR(TaskHandle_t task, BaseType_t *woken);
+uint32_t ulTaskNotifyTake(BaseType_t clear, TickType_t ticks);
+
+SemaphoreHandle_t xSemaphoreCreateMutex();
+SemaphoreHandle_t xSemaphoreCreateRecursiveMutex();
+BaseType_t xSemaphoreTake(SemaphoreHandle_t sem, TickType_t ticks);
+BaseType_t xSemaphoreGive(SemaphoreHandle_t sem);
+BaseType_t xSemaphoreTakeRecursive(SemaphoreHandle_t sem, TickType_t ticks);
+BaseType_t xSemaphoreGiveRecursive(SemaphoreHandle_t sem);
@@ -0,0 +1,52 @@
+// LittleFS stand-in for the host simulator: the filesystem is a host
+// directory (--fs DIR, build/littlefs by default). Bytes read and written
+// are counted (sim::counters).
+#pragma once
+#include "Arduino.h"
+#include <memory>
+
+class File {
+public:
+  struct Impl;
+  File() {}
+  explicit File(std::shared_ptr<Impl> p) : impl(p) {}
+
+  explicit operator bool() const { return impl != nullptr; }
+  size_t read(uint8_t *buf, size_t len);
+  int read();
+  size_t write(const uint8_t *buf, size_t len);
+  size_t write(uint8_t c) { return write(&c, 1); }
+  bool seek(uint32_t pos);
+  size_t position() const;
+  size_t size() const;
+  int available() { return (int)(size() - position()); }
+  void close() { impl.reset(); }
+  const char *name() const;   // base name, as on the ESP32 core 2.x
+  const char *path() const;   // from the filesystem root
+  bool isDirectory() const;
+  File openNextFile();
+
+private:
+  std::shared_ptr<Impl> impl;
+};
+
+class LittleFSFS {
+public:
+  bool begin(bool formatOnFail = false, const char *basePath = "/littlefs", uint8_t maxOpenFiles = 10,
+             const char *partitionLabel = "spiffs");
+  void end() {}
+  File open(const char *path, const char *mode = "r");
+  File open(const String &path, const char *mode = "r") { return open(path.c_str(), mode); }
+  bool exists(const char *path);
+  bool exists(const String &path) { return exists(path.c_str()); }
+  bool remove(const char *path);
+  bool remove(const String &path) { return remove(path.c_str()); }
+  bool rename(const char *from, const char *to);
+  bool rename(const String &from, const String &to) { return rename(from.c_str(), to.c_str()); }
+  bool mkdir(const char *path);
+  bool mkdir(const String &path) { return mkdir(path.c_str()); }
+  size_t totalBytes() { return 1408 * 1024; } // default "spiffs" partition
+  size_t usedBytes();
+};
+
+extern LittleFSFS LittleFS;
@@ -0,0 +1,40 @@
+// NVS stand-in for the host simulator: namespaces of byte blobs in memory,
+// optionally loaded from / saved to --nvs <file>. Every read, write and
+// erase is counted (sim::counters).
+#pragma once
+#include "Arduino.h"
+
+class Preferences {
+public:
+  bool begin(const char *name, bool readOnly = false, const char *partition = nullptr);
+  void end();
+  bool clear();
+  bool remove(const char *key);
+  bool isKey(const char *key);
+
+  size_t putBytes(const char *key, const void *value, size_t len);
+  size_t putBool(const char *key, bool v) { uint8_t b = v; return putBytes(key, &b, 1); }
+  size_t putUChar(const char *key, uint8_t v) { return putBytes(key, &v, sizeof(v)); }
+  size_t putUShort(const char *key, uint16_t v) { return putBytes(key, &v, sizeof(v)); }
+  size_t putInt(const char *key, int32_t v) { return putBytes(key, &v, sizeof(v)); }
+  size_t putUInt(const char *key, uint32_t v) { return putBytes(key, &v, sizeof(v)); }
+  size_t putULong(const char *key, uint32_t v) { return putBytes(key, &v, sizeof(v)); }
+  size_t putString(const char *key, const char *v) { return putBytes(key, v, strlen(v) + 1); }
+  size_t putString(const char *key, const String &v) { return putString(key, v.c_str()); }
+
+  size_t getBytesLength(const char *key);
+  size_t getBytes(const char *key, void *buf, size_t maxLen);
+  bool getBool(const char *key, bool def = false) { uint8_t b = def; getValue(key, &b, 1); return b; }
+  uint8_t getUChar(const char *key, uint8_t def = 0) { getValue(key, &def, sizeof(def)); return def; }
+  uint16_t getUShort(const char *key, uint16_t def = 0) { getValue(key, &def, sizeof(def)); return def; }
+  int32_t getInt(const char *key, int32_t def = 0) { getValue(key, &def, sizeof(def)); return def; }
+  uint32_t getUInt(const char *key, uint32_t def = 0) { getValue(key, &def, sizeof(def)); return def; }
+  uint32_t getULong(const char *key, uint32_t def = 0) { getValue(key, &def, sizeof(def)); return def; }
+  String getString(const char *key, const String &def = String());
+
+private:
+  void getValue(const char *key, void *value, size_t len); // leaves *value alone unless key has exactly len bytes
+  std::string ns;
+  bool open = false;
+  bool readOnly = false;
+};
@@ -0,0 +1,12 @@
+// SPI stand-in for the host simulator: the bus itself is not modelled,
+// TFT_eSPI.h counts what would go over it.
+#pragma once
+#include "Arduino.h"
+#define VSPI 3
+#define HSPI 2
+
+class SPIClass {
+public:
+  SPIClass(int bus = VSPI) {}
+  void begin(int sck = -1, int miso = -1, int mosi = -1, int ss = -1) {}
+};
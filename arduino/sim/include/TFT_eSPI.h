@@ -0,0 +1,158 @@
+// TFT_eSPI stand-in for the host simulator. Nothing is rasterized: each
+// call is counted with the SPI traffic the ILI9341 driver would generate
+// (address window setup plus 2 bytes per pixel). Sprites draw into "RAM"
+// for free and pay when pushed. Text is sized with fixed per-font cells.
+#pragma once
+#include "Arduino.h"
+
+#define TFT_BLACK 0x0000
+#define TFT_NAVY 0x000F
+#define TFT_DARKGREEN 0x03E0
+#define TFT_DARKGREY 0x7BEF
+#define TFT_BLUE 0x001F
+#define TFT_GREEN 0x07E0
+#define TFT_CYAN 0x07FF
+#define TFT_RED 0xF800
+#define TFT_MAGENTA 0xF81F
+#define TFT_YELLOW 0xFFE0
+#define TFT_WHITE 0xFFFF
+#define TFT_ORANGE 0xFDA0
+#define TFT_TRANSPARENT 0x0120
+
+#define TL_DATUM 0
+#define TC_DATUM 1
+#define TR_DATUM 2
+#define ML_DATUM 3
+#define MC_DATUM 4
+#define MR_DATUM 5
+#define BL_DATUM 6
+#define BC_DATUM 7
+#define BR_DATUM 8
+
+#define TFT_WIDTH 240
+#define TFT_HEIGHT 320
+
+class TFT_eSPI {
+public:
+  TFT_eSPI(int16_t w = TFT_WIDTH, int16_t h = TFT_HEIGHT) : w0(w), h0(h), w(w), h(h) {}
+  virtual ~TFT_eSPI() {}
+
+  void init(uint8_t tc = 0) { emitCommand(24); } // reset and panel setup sequence
+  void setRotation(uint8_t r) {
+    rotation = r & 3;
+    w = (rotation & 1) ? h0 : w0;
+    h = (rotation & 1) ? w0 : h0;
+    emitCommand(2);
+  }
+  uint8_t getRotation() { return rotation; }
+  int16_t width() { return w; }
+  int16_t height() { return h; }
+
+  void fillScreen(uint32_t color);
+  void fillRect(int32_t x, int32_t y, int32_t rw, int32_t rh, uint32_t color) { emitArea(x, y, rw, rh); }
+  void drawRect(int32_t x, int32_t y, int32_t rw, int32_t rh, uint32_t color) {
+    // four lines, one window each
+    emitArea(x, y, rw, 1);
+    emitArea(x, y + rh - 1, rw, 1);
+    emitArea(x, y + 1, 1, rh - 2);
+    emitArea(x + rw - 1, y + 1, 1, rh - 2);
+  }
+  void drawFastHLine(int32_t x, int32_t y, int32_t len, uint32_t color) { emitArea(x, y, len, 1); }
+  void drawFastVLine(int32_t x, int32_t y, int32_t len, uint32_t color) { emitArea(x, y, 1, len); }
+  void drawPixel(int32_t x, int32_t y, uint32_t color) { emitArea(x, y, 1, 1); }
+
+  void setTextColor(uint16_t fg) { textFg = fg; textBgFill = false; }
+  void setTextColor(uint16_t fg, uint16_t bg, bool fill = false) { textFg = fg; textBg = bg; textBgFill = true; }
+  void setTextDatum(uint8_t d) { datum = d; }
+  uint8_t getTextDatum() { return datum; }
+  void setTextPadding(uint16_t px) { padding = px; }
+  void setTextFont(uint8_t f) { font = f; }
+  void setTextSize(uint8_t s) { textSize = s ? s : 1; }
+
+  int16_t textWidth(const char *s, uint8_t f) { return strlen(s) * cellWidth(f) * textSize; }
+  int16_t textWidth(const char *s) { return textWidth(s, font); }
+  int16_t textWidth(const String &s, uint8_t f) { return textWidth(s.c_str(), f); }
+  int16_t textWidth(const String &s) { return textWidth(s.c_str(), font); }
+  int16_t fontHeight(int16_t f) { return cellHeight(f) * textSize; }
+  int16_t fontHeight() { return fontHeight(font); }
+
+  int16_t drawString(const char *s, int32_t x, int32_t y, uint8_t f);
+  int16_t drawString(const char *s, int32_t x, int32_t y) { return drawString(s, x, y, font); }
+  int16_t drawString(const String &s, int32_t x, int32_t y, uint8_t f) { return drawString(s.c_str(), x, y, f); }
+  int16_t drawString(const String &s, int32_t x, int32_t y) { return drawString(s.c_str(), x, y, font); }
+  int16_t drawCentreString(const char *s, int32_t x, int32_t y, uint8_t f) {
+    uint8_t d = datum;
+    datum = TC_DATUM;
+    int16_t r = drawString(s, x, y, f);
+    datum = d;
+    return r;
+  }
+  int16_t drawCentreString(const String &s, int32_t x, int32_t y, uint8_t f) { return drawCentreString(s.c_str(), x, y, f); }
+
+  uint16_t color565(uint8_t r, uint8_t g, uint8_t b) { return ((r & 0xF8) << 8) | ((g & 0xFC) << 3) | (b >> 3); }
+
+  void startWrite() {}
+  void endWrite() {}
+  void setSwapBytes(bool on) { swap = on; }
+  bool getSwapBytes() { return swap; }
+  void pushImage(int32_t x, int32_t y, int32_t iw, int32_t ih, const uint16_t *data) { emitArea(x, y, iw, ih); }
+
+  // Raw pixel streaming into an address window; DMA completes at once
+  bool initDMA(bool ctrlCS = false) { return dma = true; }
+  void setAddrWindow(int32_t x, int32_t y, int32_t ww, int32_t wh);
+  void pushPixels(const void *data, uint32_t len);
+  void pushPixelsDMA(uint16_t *data, uint32_t len) { pushPixels(data, len); }
+  bool dmaBusy() { return false; }
+  void dmaWait() {}
+
+protected:
+  friend class TFT_eSprite;
+  // Accounts one primitive covering rw x rh pixels in one address window;
+  // sprites override this to draw into their own memory
+  virtual void emitArea(int32_t x, int32_t y, int32_t rw, int32_t rh);
+  void emitCommand(uint32_t bytes);
+  static int16_t cellWidth(uint8_t f);
+  static int16_t cellHeight(uint8_t f);
+
+  int16_t w0, h0, w, h;
+  uint8_t rotation = 0;
+  uint8_t datum = TL_DATUM;
+  uint8_t font = 1;
+  uint8_t textSize = 1;
+  uint16_t textFg = TFT_WHITE, textBg = TFT_BLACK;
+  bool textBgFill = false;
+  uint16_t padding = 0;
+  bool swap = false;
+  bool dma = false;
+};
+
+class TFT_eSprite : public TFT_eSPI {
+public:
+  explicit TFT_eSprite(TFT_eSPI *parent) : TFT_eSPI(0, 0), tft(parent) {}
+  ~TFT_eSprite() override { deleteSprite(); }
+
+  void *setColorDepth(int8_t bits) {
+    depth = bits == 1 || bits == 8 ? bits : 16;
+    return buf;
+  }
+  int8_t getColorDepth() { return depth; }
+  void *createSprite(int16_t sw, int16_t sh, uint8_t frames = 1);
+  void deleteSprite();
+  bool created() { return buf != nullptr; }
+  void *getPointer() { return buf; }
+  void setBitmapColor(uint16_t fg, uint16_t bg) { bitmapFg = fg; bitmapBg = bg; }
+
+  void fillSprite(uint32_t color) { emitArea(0, 0, w, h); }
+  void pushSprite(int32_t x, int32_t y);
+  void pushSprite(int32_t x, int32_t y, uint16_t transparent);
+
+protected:
+  void emitArea(int32_t x, int32_t y, int32_t rw, int32_t rh) override;
+
+private:
+  TFT_eSPI *tft;
+  uint8_t *buf = nullptr;
+  size_t bytes = 0;
+  int8_t depth = 16;
+  uint16_t bitmapFg = TFT_WHITE, bitmapBg = TFT_BLACK;
+};
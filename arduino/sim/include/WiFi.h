@@ -0,0 +1,49 @@
+// WiFi stand-in for the host simulator: station mode "connects" right away
+// (or after --wifi-delay ms) with the loopback address; AP mode is a no-op.
+#pragma once
+#include "Arduino.h"
+#include <netinet/in.h> // INADDR_NONE, as lwIP defines it
+
+typedef enum {
+  WL_IDLE_STATUS = 0,
+  WL_NO_SSID_AVAIL = 1,
+  WL_CONNECTED = 3,
+  WL_CONNECT_FAILED = 4,
+  WL_CONNECTION_LOST = 5,
+  WL_DISCONNECTED = 6
+} wl_status_t;
+typedef enum { WIFI_OFF = 0, WIFI_STA = 1, WIFI_AP = 2, WIFI_AP_STA = 3 } wifi_mode_t;
+typedef enum { WIFI_PS_NONE, WIFI_PS_MIN_MODEM, WIFI_PS_MAX_MODEM } wifi_ps_type_t;
+
+class WiFiClass {
+public:
+  bool mode(wifi_mode_t m) { wifiMode = m; return true; }
+  wifi_mode_t getMode() { return wifiMode; }
+  bool setHostname(const char *name) { return true; }
+  bool setAutoReconnect(bool on) { return true; }
+  bool setSleep(bool on) { return setSleep(on ? WIFI_PS_MIN_MODEM : WIFI_PS_NONE); }
+  bool setSleep(wifi_ps_type_t type) { psType = type; return true; }
+  wifi_ps_type_t getSleep() { return psType; }
+  bool config(IPAddress ip, IPAddress gateway, IPAddress subnet, IPAddress dns1 = IPAddress(), IPAddress dns2 = IPAddress()) { return true; }
+  wl_status_t begin(const char *ssid, const char *pass = nullptr, int32_t channel = 0, const uint8_t *bssid = nullptr, bool connect = true);
+  bool disconnect(bool wifiOff = false, bool eraseAp = false);
+  wl_status_t status();
+  IPAddress localIP() { return IPAddress(127, 0, 0, 1); }
+  IPAddress gatewayIP() { return IPAddress(127, 0, 0, 1); }
+  IPAddress subnetMask() { return IPAddress(255, 0, 0, 0); }
+  IPAddress dnsIP(uint8_t i = 0) { return IPAddress(127, 0, 0, 1); }
+  int32_t channel() { return 1; }
+  uint8_t *BSSID() { return bssid; }
+  int8_t RSSI() { return -40; }
+  bool softAP(const char *ssid, const char *pass = nullptr) { return true; }
+  IPAddress softAPIP() { return IPAddress(127, 0, 0, 1); }
+  bool softAPdisconnect(bool wifiOff = false) { return true; }
+
+private:
+  wifi_mode_t wifiMode = WIFI_STA;
+  wifi_ps_type_t psType = WIFI_PS_MIN_MODEM;
+  unsigned long beginMs = 0;
+  bool started = false;
+  uint8_t bssid[6] = {0x02, 0x00, 0x00, 0x00, 0x00, 0x01};
+};
+extern WiFiClass WiFi;
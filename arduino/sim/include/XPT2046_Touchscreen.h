@@ -0,0 +1,20 @@
+// XPT2046 stand-in for the host simulator: reports the finger the touch
+// script puts down (sim::touchDown/touchUp), in raw panel coordinates.
+#pragma once
+#include "SPI.h"
+
+class TS_Point {
+public:
+  TS_Point() : x(0), y(0), z(0) {}
+  TS_Point(int16_t x, int16_t y, int16_t z) : x(x), y(y), z(z) {}
+  int16_t x, y, z;
+};
+
+class XPT2046_Touchscreen {
+public:
+  XPT2046_Touchscreen(uint8_t cs, uint8_t irq = 255) {}
+  bool begin(SPIClass &spi) { return true; }
+  void setRotation(uint8_t r) {}
+  TS_Point getPoint();
+  bool touched();
+};
@@ -0,0 +1,8 @@
+// GPIO driver stand-in for the host simulator: wake and interrupt type
+// changes are accepted and ignored.
+#pragma once
+#include "../esp_sleep.h"
+
+inline esp_err_t gpio_wakeup_disable(gpio_num_t pin) { return ESP_OK; }
+inline esp_err_t gpio_set_intr_type(gpio_num_t pin, gpio_int_type_t type) { return ESP_OK; }
+inline esp_err_t gpio_intr_enable(gpio_num_t pin) { return ESP_OK; }
@@ -0,0 +1,75 @@
+// esp_http_server stand-in for the host simulator: the calls arduino.h
+// makes, served by one thread on 127.0.0.1:--port (src/httpd.cpp). Like
+// httpd it keeps connections alive, matches URIs exactly, runs handlers one
+// at a time and runs httpd_queue_work() callbacks on the server thread.
+#pragma once
+#include "Arduino.h"
+#include <sys/types.h>
+
+#define HTTPD_MAX_URI_LEN 512
+#define HTTPD_SOCK_ERR_FAIL -1
+#define HTTPD_SOCK_ERR_INVALID -2
+#define HTTPD_SOCK_ERR_TIMEOUT -3
+#define HTTPD_RESP_USE_STRLEN -1
+
+typedef void *httpd_handle_t;
+typedef enum { HTTP_DELETE = 0, HTTP_GET = 1, HTTP_HEAD = 2, HTTP_POST = 3, HTTP_PUT = 4, HTTP_OPTIONS = 6 } httpd_method_t;
+
+typedef struct httpd_req {
+  httpd_handle_t handle;
+  int method;
+  const char uri[HTTPD_MAX_URI_LEN + 1];
+  size_t content_len;
+  void *aux;
+  void *user_ctx;
+} httpd_req_t;
+
+typedef struct httpd_uri {
+  const char *uri;
+  httpd_method_t method;
+  esp_err_t (*handler)(httpd_req_t *r);
+  void *user_ctx;
+} httpd_uri_t;
+
+typedef esp_err_t (*httpd_open_func_t)(httpd_handle_t hd, int sockfd);
+typedef void (*httpd_close_func_t)(httpd_handle_t hd, int sockfd);
+typedef void (*httpd_work_fn_t)(void *arg);
+
+typedef struct {
+  unsigned task_priority;
+  size_t stack_size;
+  BaseType_t core_id;
+  uint16_t server_port;
+  uint16_t ctrl_port;
+  uint16_t max_open_sockets;
+  uint16_t max_uri_handlers;
+  uint16_t max_resp_headers;
+  uint16_t backlog_conn;
+  bool lru_purge_enable;
+  uint16_t recv_wait_timeout;
+  uint16_t send_wait_timeout;
+  httpd_open_func_t open_fn;
+  httpd_close_func_t close_fn;
+} httpd_config_t;
+
+httpd_config_t HTTPD_DEFAULT_CONFIG();
+esp_err_t httpd_start(httpd_handle_t *handle, const httpd_config_t *config);
+esp_err_t httpd_register_uri_handler(httpd_handle_t handle, const httpd_uri_t *uri);
+
+int httpd_req_recv(httpd_req_t *r, char *buf, size_t len);
+size_t httpd_req_get_url_query_len(httpd_req_t *r);
+esp_err_t httpd_req_get_url_query_str(httpd_req_t *r, char *buf, size_t len);
+esp_err_t httpd_query_key_value(const char *qry, const char *key, char *val, size_t len);
+size_t httpd_req_get_hdr_value_len(httpd_req_t *r, const char *field);
+esp_err_t httpd_req_get_hdr_value_str(httpd_req_t *r, const char *field, char *val, size_t len);
+int httpd_req_to_sockfd(httpd_req_t *r);
+
+esp_err_t httpd_resp_set_status(httpd_req_t *r, const char *status);
+esp_err_t httpd_resp_set_type(httpd_req_t *r, const char *type);
+esp_err_t httpd_resp_set_hdr(httpd_req_t *r, const char *field, const char *value);
+esp_err_t httpd_resp_send(httpd_req_t *r, const char *buf, ssize_t len);
+esp_err_t httpd_resp_send_chunk(httpd_req_t *r, const char *buf, ssize_t len);
+
+int httpd_socket_send(httpd_handle_t hd, int sockfd, const char *buf, size_t len, int flags);
+esp_err_t httpd_queue_work(httpd_handle_t hd, httpd_work_fn_t work, void *arg);
+esp_err_t httpd_sess_trigger_close(httpd_handle_t hd, int sockfd);
@@ -0,0 +1,24 @@
+// Sleep stand-in for the host simulator. esp_deep_sleep_start() saves NVS
+// and RTC memory and ends the process; start the simulator again with
+// --wake touch to resume the way a touch wake would.
+#pragma once
+#include "Arduino.h"
+
+typedef enum {
+  ESP_SLEEP_WAKEUP_UNDEFINED = 0,
+  ESP_SLEEP_WAKEUP_ALL,
+  ESP_SLEEP_WAKEUP_EXT0,
+  ESP_SLEEP_WAKEUP_EXT1,
+  ESP_SLEEP_WAKEUP_TIMER,
+  ESP_SLEEP_WAKEUP_TOUCHPAD,
+  ESP_SLEEP_WAKEUP_ULP,
+  ESP_SLEEP_WAKEUP_GPIO
+} esp_sleep_wakeup_cause_t;
+typedef int gpio_num_t;
+typedef enum { GPIO_INTR_DISABLE = 0, GPIO_INTR_POSEDGE, GPIO_INTR_NEGEDGE, GPIO_INTR_ANYEDGE, GPIO_INTR_LOW_LEVEL, GPIO_INTR_HIGH_LEVEL } gpio_int_type_t;
+
+esp_sleep_wakeup_cause_t esp_sleep_get_wakeup_cause();
+inline esp_err_t esp_sleep_enable_ext0_wakeup(gpio_num_t pin, int level) { return ESP_OK; }
+inline esp_err_t esp_sleep_enable_gpio_wakeup() { return ESP_OK; }
+inline esp_err_t gpio_wakeup_enable(gpio_num_t pin, gpio_int_type_t type) { return ESP_OK; }
+void esp_deep_sleep_start() __attribute__((noreturn));
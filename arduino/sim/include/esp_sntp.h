@@ -0,0 +1,7 @@
+// SNTP stand-in for the host simulator: configTime() "syncs" at once from
+// the host clock and calls the notification callback.
+#pragma once
+#include "Arduino.h"
+
+typedef void (*sntp_sync_time_cb_t)(struct timeval *tv);
+void sntp_set_time_sync_notification_cb(sntp_sync_time_cb_t callback);
@@ -0,0 +1,6 @@
+// lwIP stand-in for the host simulator: the BSD socket API of the host.
+#pragma once
+#include <unistd.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
@@ -0,0 +1,87 @@
+// Simulator internals shared by the stand-ins and the driver (src/main.cpp).
+#pragma once
+#include "Arduino.h"
+#include <atomic>
+#include <vector>
+
+namespace sim {
+
+// Everything the simulator counts; /sim/counters and --out report these
+struct Counters {
+  // panel: what TFT_eSPI would push over SPI
+  std::atomic<uint64_t> drawCalls{0};     // primitives drawn on the panel (sprite pushes included)
+  std::atomic<uint64_t> panelPixels{0};   // pixels written to the panel
+  std::atomic<uint64_t> spiBytes{0};      // commands, window setup and pixel data
+  std::atomic<uint64_t> fullClears{0};    // fillScreen() calls
+  // sprites: drawing into RAM, no SPI traffic until pushed
+  std::atomic<uint64_t> spriteDrawCalls{0};
+  std::atomic<uint64_t> spritePushes{0};
+  std::atomic<uint64_t> spriteAllocFails{0};
+  std::atomic<uint64_t> spriteBytes{0};   // live sprite memory
+  std::atomic<uint64_t> spriteBytesPeak{0};
+  // NVS: every put is a write (and a flash commit) on the real device
+  std::atomic<uint64_t> nvsReads{0};
+  std::atomic<uint64_t> nvsWrites{0};
+  std::atomic<uint64_t> nvsWriteBytes{0};
+  std::atomic<uint64_t> nvsErases{0};
+  // LittleFS
+  std::atomic<uint64_t> fsReadBytes{0};
+  std::atomic<uint64_t> fsWriteBytes{0};
+  // HTTP
+  std::atomic<uint64_t> httpRequests{0};
+  std::atomic<uint64_t> httpBytesOut{0};
+  // input
+  std::atomic<uint64_t> touchesInjected{0};
+};
+extern Counters counters;
+void resetCounters();
+String countersJson();
+
+// Timestamped probes for the benchmark (src/bench.cpp): every panel draw and
+// NVS write while probing is on
+enum ProbeKind : uint8_t { PROBE_PANEL, PROBE_NVS };
+struct Probe {
+  int64_t us;      // esp_timer_get_time()
+  ProbeKind kind;
+  char ns[16];     // NVS namespace
+};
+void setProbing(bool on);
+void probe(ProbeKind kind, const char *ns = nullptr);
+std::vector<Probe> takeProbes();
+
+// Command line options (see README.md)
+struct Options {
+  int port = 8080;
+  const char *script = nullptr;
+  const char *nvsFile = nullptr;
+  const char *rtcFile = nullptr;
+  const char *outFile = nullptr;
+  const char *fsDir = "build/littlefs"; // LittleFS root
+  bool quiet = false;
+  bool psram = false;
+  bool serialStdin = false;
+  bool touchWake = false;
+  uint32_t wifiDelayMs = 300;      // station "connect" time
+  uint32_t spriteBudget = 96 * 1024; // sprite RAM before createSprite() fails
+};
+extern Options options;
+
+// Simulated finger, in raw panel coordinates (TOUCH_MIN..TOUCH_MAX)
+void touchDown(int rawX, int rawY);
+void touchUp();
+bool fingerDown();
+void fingerPosition(int &rawX, int &rawY);
+
+// Task identity for threads the firmware did not create (httpd)
+TaskHandle_t adoptThread(const char *name);
+
+// NVS and RTC persistence across simulated deep sleeps and restarts
+void loadNvs();
+void saveNvs();
+void loadRtc();
+void saveRtc();
+
+// Saves state, writes counters and ends the process (deep sleep, restart, quit)
+[[noreturn]] void shutdown(const char *why, int code);
+
+} // namespace sim
@@ -0,0 +1,10 @@
+// GPIO register stand-in for the host simulator.
+#pragma once
+#include <stdint.h>
+
+typedef struct {
+  struct {
+    uint32_t int_ena;
+  } pin[40];
+} gpio_dev_t;
+extern volatile gpio_dev_t GPIO;
@@ -0,0 +1,564 @@
+// Touch-trace benchmark: replays traces (../traces/*.trace) against the
+// simulated firmware and times every stage of a press, from the finger
+// going down to a host client seeing it, the way api.py would:
+//
+//   event   press recorded in the event ring (touch pipeline + uiTask)
+//   frame   first panel write after the touch (drawButtons)
+//   stream  press event received on GET /stream (api.py's push path)
+//   poll    press visible in a GET /state.bin poll (api.py's polling path)
+//   nvs     button states committed to NVS (deferred saveStates)
+//
+// Every stage is measured from the touch, so they are cumulative. Taps that
+// produce no press are "lost", extra presses are "doubled". Results go to a
+// JSON file (--out) for comparing releases.
+//
+// A trace with a "wake" line boots the firmware as a touch wake from deep
+// sleep instead, the finger already down, and checks the wake tap's press.
+#define SIM_HOST_CLOCK
+#include "Arduino.h"
+#include "firmware.h"
+#include "sim.h"
+#include <algorithm>
+#include <dirent.h>
+#include <fstream>
+#include <map>
+#include <mutex>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+namespace {
+
+const int64_t WATCH_PERIOD_US = 20; // event ring polling: the resolution of the event stage
+
+int pollMs = 200; // api.py's default --interval
+bool verbose = false;
+
+// --- Traces ---
+struct Step {
+  int button;      // 1-based; 0 = just wait
+  int holdMs;
+  int gapMs;       // after the lift
+  bool consumed;   // the tap is expected to produce no press (it wakes the deck)
+};
+
+struct Trace {
+  std::string name;
+  int repeat = 1;
+  unsigned long infoTimeoutMs = 0; // 0 = the firmware's own
+  std::vector<Step> steps;
+  int wakeX = 0, wakeY = 0, wakeButton = 0; // wakeButton 0 = a normal trace
+};
+
+// name <id> | repeat <n> | info-timeout <ms> | tap <button> <hold> <gap> [consumed] | wait <ms>
+// | wake <x> <y> <button>
+bool loadTrace(const std::string &path, Trace &t) {
+  std::ifstream f(path);
+  if (!f) return false;
+  size_t slash = path.find_last_of('/');
+  t.name = path.substr(slash == std::string::npos ? 0 : slash + 1);
+  t.name = t.name.substr(0, t.name.find('.'));
+  std::string line;
+  for (int n = 1; std::getline(f, line); n++) {
+    std::istringstream in(line.substr(0, line.find('#')));
+    std::string cmd, flag;
+    if (!(in >> cmd)) continue;
+    Step s = {0, 0, 0, false};
+    if (cmd == "name" && in >> t.name) continue;
+    if (cmd == "repeat" && in >> t.repeat) continue;
+    if (cmd == "info-timeout" && in >> t.infoTimeoutMs) continue;
+    if (cmd == "wake" && in >> t.wakeX >> t.wakeY >> t.wakeButton && t.wakeButton > 0) continue;
+    if (cmd == "wait" && in >> s.gapMs) {
+      t.steps.push_back(s);
+      continue;
+    }
+    if (cmd == "tap" && in >> s.button >> s.holdMs >> s.gapMs) {
+      s.consumed = (in >> flag) && flag == "consumed";
+      t.steps.push_back(s);
+      continue;
+    }
+    fprintf(stderr, "bench: %s:%d: cannot parse \"%s\"\n", path.c_str(), n, line.c_str());
+    return false;
+  }
+  if (t.wakeButton && !t.steps.empty()) {
+    fprintf(stderr, "bench: %s: a wake trace takes no taps\n", path.c_str());
+    return false;
+  }
+  return true;
+}
+
+// --- Observations ---
+// Written by the watcher and the two client threads, read after each trace
+struct Observed {
+  std::mutex m;
+  std::map<uint32_t, std::pair<fw::Event, int64_t>> events; // seq -> event, time seen in the ring
+  std::map<uint32_t, int64_t> stream;                       // seq -> time received on /stream
+  std::vector<std::pair<int64_t, uint32_t>> polls;          // time, seq reported by /state.bin
+  bool streamConnected = false;
+} observed;
+
+int64_t nowUs() { return esp_timer_get_time(); }
+
+void watchEvents() {
+  uint32_t last = fw::eventSeq();
+  for (;;) {
+    uint32_t seq = fw::eventSeq();
+    for (; last < seq; last++) {
+      fw::Event e;
+      if (!fw::readEvent(last + 1, e)) continue;
+      std::lock_guard<std::mutex> lock(observed.m);
+      observed.events[e.seq] = {e, nowUs()};
+    }
+    std::this_thread::sleep_for(std::chrono::microseconds(WATCH_PERIOD_US));
+  }
+}
+
+int connectLocal() {
+  int fd = socket(AF_INET, SOCK_STREAM, 0);
+  sockaddr_in addr = {};
+  addr.sin_family = AF_INET;
+  addr.sin_port = htons(sim::options.port);
+  addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+  if (fd >= 0 && connect(fd, (sockaddr *)&addr, sizeof(addr)) == 0) return fd;
+  if (fd >= 0) close(fd);
+  return -1;
+}
+
+bool sendRequest(int fd, const char *path) {
+  std::string req = std::string("GET ") + path + " HTTP/1.1\r\nHost: cheapdeck\r\n\r\n";
+  return send(fd, req.data(), req.size(), MSG_NOSIGNAL) == (ssize_t)req.size();
+}
+
+// Push path: parses "event: button" blocks off GET /stream
+void streamClient() {
+  for (;;) {
+    int fd = connectLocal();
+    if (fd < 0 || !sendRequest(fd, "/stream")) {
+      if (fd >= 0) close(fd);
+      delay(100);
+      continue;
+    }
+    std::string buf;
+    char chunk[2048];
+    ssize_t n;
+    bool headerSeen = false, rejected = false;
+    while ((n = recv(fd, chunk, sizeof(chunk), 0)) > 0) {
+      int64_t at = nowUs();
+      buf.append(chunk, n);
+      if (!headerSeen && buf.find("\r\n") != std::string::npos) {
+        // Anything but 200 (a 404 before the routes are registered, a 503
+        // at the client cap) keeps the connection alive: retry instead
+        headerSeen = true;
+        rejected = buf.compare(0, 15, "HTTP/1.1 200 OK") != 0;
+        if (rejected) break;
+        std::lock_guard<std::mutex> lock(observed.m);
+        observed.streamConnected = true;
+      }
+      size_t end;
+      while ((end = buf.find("\n\n")) != std::string::npos) {
+        std::string block = buf.substr(0, end);
+        buf.erase(0, end + 2);
+        size_t data = block.find("event: button\ndata: ");
+        unsigned seq;
+        char type[16];
+        if (data != std::string::npos &&
+            sscanf(block.c_str() + data + 20, "{\"seq\":%u,\"button\":%*d,\"type\":\"%15[a-z]\"", &seq, type) == 2) {
+          std::lock_guard<std::mutex> lock(observed.m);
+          observed.stream.emplace(seq, at);
+        }
+      }
+    }
+    close(fd);
+    {
+      std::lock_guard<std::mutex> lock(observed.m);
+      observed.streamConnected = false;
+    }
+    if (rejected) delay(100);
+  }
+}
+
+// Polling path: GET /state.bin every pollMs on one keep-alive connection
+void pollClient() {
+  struct __attribute__((packed)) Frame {
+    uint8_t version, cols, rows, pages;
+    uint64_t states;
+    uint32_t seq, ms;
+  };
+  int fd = -1;
+  std::string buf;
+  for (;;) {
+    int64_t start = nowUs();
+    if (fd < 0) fd = connectLocal();
+    if (fd >= 0 && sendRequest(fd, "/state.bin")) {
+      size_t head;
+      char chunk[512];
+      ssize_t n = 1;
+      while ((head = buf.find("\r\n\r\n")) == std::string::npos && (n = recv(fd, chunk, sizeof(chunk), 0)) > 0) buf.append(chunk, n);
+      size_t len = 0;
+      size_t cl = head == std::string::npos ? std::string::npos : buf.find("Content-Length: ");
+      if (cl != std::string::npos && cl < head) len = strtoul(buf.c_str() + cl + 16, nullptr, 10);
+      while (head != std::string::npos && buf.size() < head + 4 + len && (n = recv(fd, chunk, sizeof(chunk), 0)) > 0) buf.append(chunk, n);
+      if (n <= 0 || head == std::string::npos) {
+        close(fd);
+        fd = -1;
+        buf.clear();
+      } else {
+        Frame f;
+        if (len == sizeof(f)) {
+          memcpy(&f, buf.data() + head + 4, sizeof(f));
+          std::lock_guard<std::mutex> lock(observed.m);
+          observed.polls.push_back({nowUs(), (uint32_t)f.seq});
+        }
+        buf.erase(0, head + 4 + len);
+      }
+    }
+    int64_t left = pollMs * 1000LL - (nowUs() - start);
+    if (left > 0) std::this_thread::sleep_for(std::chrono::microseconds(left));
+  }
+}
+
+// --- Running a trace ---
+struct TapRun {
+  Step step;
+  int64_t downUs;
+};
+
+struct Stage {
+  const char *name;
+  bool required;   // every trace that produces presses must measure it
+  std::vector<int64_t> us;
+};
+
+struct Result {
+  std::string name;
+  int taps = 0, presses = 0, lost = 0, doubled = 0, wrongButton = 0, unexpected = 0, offScreen = 0;
+  uint32_t debounced = 0;
+  std::vector<Stage> stages = {{"event", true}, {"frame", true}, {"stream", true}, {"poll", true}, {"nvs", false},
+                               {"wake_frame", false}};
+  String counters;
+};
+
+void tapAt(int x, int y, int holdMs) {
+  fw::fingerAt(x, y);
+  delay(holdMs);
+  sim::touchUp();
+}
+
+// Dismisses whatever covers the deck (splash, URL overlay, info mode)
+bool showDeck() {
+  for (int i = 0; i < 50 && !fw::deckShown(); i++) {
+    tapAt(0, 0, 40);
+    delay(200);
+  }
+  delay(200);
+  return fw::deckShown();
+}
+
+int64_t firstProbeAfter(const std::vector<sim::Probe> &probes, sim::ProbeKind kind, int64_t from, int64_t until, const char *ns = nullptr) {
+  for (const sim::Probe &p : probes) {
+    if (p.kind == kind && p.us >= from && p.us < until && (!ns || strcmp(p.ns, ns) == 0)) return p.us;
+  }
+  return -1;
+}
+
+Result runTrace(const Trace &t) {
+  Result r;
+  r.name = t.name;
+  fw::setInfoModeTimeout(0);
+  if (!showDeck()) fprintf(stderr, "bench: %s: the deck did not come up\n", t.name.c_str());
+  fw::setInfoModeTimeout(t.infoTimeoutMs);
+
+  sim::resetCounters();
+  sim::takeProbes();
+  sim::setProbing(true);
+  uint32_t debounced0 = fw::debouncedPresses();
+  uint32_t seq0 = fw::eventSeq();
+
+  std::vector<TapRun> runs;
+  for (int k = 0; k < t.repeat; k++) {
+    for (const Step &s : t.steps) {
+      int x, y;
+      if (s.button && fw::buttonCentre(s.button, x, y)) {
+        runs.push_back({s, nowUs()});
+        tapAt(x, y, s.holdMs);
+      } else if (s.button) {
+        r.offScreen++;
+      }
+      delay(s.gapMs);
+    }
+  }
+  // Let the deferred NVS commit and the next poll happen
+  delay(fw::persistQuietMs() + 2 * pollMs + 500);
+  sim::setProbing(false);
+  std::vector<sim::Probe> probes = sim::takeProbes();
+  r.counters = sim::countersJson();
+  r.debounced = fw::debouncedPresses() - debounced0;
+  fw::setInfoModeTimeout(0);
+
+  std::lock_guard<std::mutex> lock(observed.m);
+  std::vector<std::pair<fw::Event, int64_t>> presses;
+  for (auto &e : observed.events) {
+    if (e.first > seq0 && e.second.first.press) presses.push_back(e.second);
+  }
+  std::sort(presses.begin(), presses.end(), [](const std::pair<fw::Event, int64_t> &a, const std::pair<fw::Event, int64_t> &b) { return a.second < b.second; });
+
+  size_t p = 0;
+  for (size_t i = 0; i < runs.size(); i++) {
+    const TapRun &tap = runs[i];
+    int64_t until = i + 1 < runs.size() ? runs[i + 1].downUs : INT64_MAX;
+    std::vector<std::pair<fw::Event, int64_t>> mine;
+    for (; p < presses.size() && presses[p].second < until; p++) {
+      if (presses[p].second >= tap.downUs) mine.push_back(presses[p]);
+    }
+    r.taps++;
+    r.presses += mine.size();
+    int64_t frame = firstProbeAfter(probes, sim::PROBE_PANEL, tap.downUs, until);
+    if (tap.step.consumed) {
+      r.unexpected += mine.size();
+      if (frame >= 0) r.stages[5].us.push_back(frame - tap.downUs);
+      continue;
+    }
+    if (mine.empty()) {
+      r.lost++;
+      continue;
+    }
+    r.doubled += mine.size() - 1;
+    const fw::Event &e = mine[0].first;
+    int64_t seen = mine[0].second;
+    if (e.button != tap.step.button) r.wrongButton++;
+
+    r.stages[0].us.push_back(seen - tap.downUs);
+    if (frame >= 0) r.stages[1].us.push_back(frame - tap.downUs);
+    auto s = observed.stream.find(e.seq);
+    if (s != observed.stream.end()) r.stages[2].us.push_back(s->second - tap.downUs);
+    for (auto &poll : observed.polls) {
+      if (poll.second >= e.seq && poll.first >= seen) {
+        r.stages[3].us.push_back(poll.first - tap.downUs);
+        break;
+      }
+    }
+    int64_t nvs = firstProbeAfter(probes, sim::PROBE_NVS, seen, INT64_MAX, "buttons");
+    if (nvs >= 0) r.stages[4].us.push_back(nvs - tap.downUs);
+  }
+  return r;
+}
+
+// The wake tap of a touch-wake boot, touched at downUs before setup() ran.
+// It lands before WiFi and the push stream, so only event, frame (the deck
+// drawn by setup()) and nvs apply.
+Result wakeResult(const Trace &t, int64_t downUs) {
+  Result r;
+  r.name = t.name;
+  r.stages[2].required = false;
+  r.stages[3].required = false;
+  delay(fw::persistQuietMs() + 500);
+  sim::setProbing(false);
+  std::vector<sim::Probe> probes = sim::takeProbes();
+  r.counters = sim::countersJson();
+  r.debounced = fw::debouncedPresses();
+
+  std::lock_guard<std::mutex> lock(observed.m);
+  std::vector<std::pair<fw::Event, int64_t>> presses;
+  for (auto &e : observed.events) {
+    if (e.second.first.press) presses.push_back(e.second);
+  }
+  r.taps = 1;
+  r.presses = presses.size();
+  if (presses.empty()) {
+    r.lost++;
+    return r;
+  }
+  r.doubled += presses.size() - 1;
+  if (presses[0].first.button != t.wakeButton) r.wrongButton++;
+  int64_t seen = presses[0].second;
+  r.stages[0].us.push_back(seen - downUs);
+  int64_t frame = firstProbeAfter(probes, sim::PROBE_PANEL, downUs, INT64_MAX);
+  if (frame >= 0) r.stages[1].us.push_back(frame - downUs);
+  int64_t nvs = firstProbeAfter(probes, sim::PROBE_NVS, seen, INT64_MAX, "buttons");
+  if (nvs >= 0) r.stages[4].us.push_back(nvs - downUs);
+  return r;
+}
+
+// Required stages left without a single sample (the path was never measured)
+int missingStages(const Result &r) {
+  int missing = 0;
+  for (const Stage &s : r.stages) {
+    if (s.required && r.presses > 0 && s.us.empty()) missing++;
+  }
+  return missing;
+}
+
+// --- Reporting ---
+// Nearest-rank percentile
+int64_t percentile(std::vector<int64_t> v, double pct) {
+  if (v.empty()) return 0;
+  std::sort(v.begin(), v.end());
+  size_t rank = (size_t)std::max(1.0, std::ceil(pct / 100.0 * v.size()));
+  return v[std::min(rank, v.size()) - 1];
+}
+
+String resultJson(const Result &r) {
+  String json = "{\"name\":\"" + String(r.name.c_str()) + "\"";
+  json += ",\"taps\":" + String(r.taps) + ",\"presses\":" + String(r.presses);
+  json += ",\"lost\":" + String(r.lost) + ",\"doubled\":" + String(r.doubled);
+  json += ",\"wrong_button\":" + String(r.wrongButton) + ",\"unexpected\":" + String(r.unexpected);
+  json += ",\"off_screen\":" + String(r.offScreen) + ",\"debounced\":" + String(r.debounced);
+  json += ",\"stages\":{";
+  for (size_t i = 0; i < r.stages.size(); i++) {
+    const Stage &s = r.stages[i];
+    char buf[160];
+    snprintf(buf, sizeof(buf), "%s\"%s\":{\"n\":%zu,\"p50_us\":%lld,\"p99_us\":%lld,\"max_us\":%lld}", i ? "," : "", s.name,
+             s.us.size(), (long long)percentile(s.us, 50), (long long)percentile(s.us, 99), (long long)percentile(s.us, 100));
+    json += buf;
+  }
+  json += "},\"counters\":" + r.counters + "}";
+  return json;
+}
+
+void printResult(const Result &r) {
+  printf("%s: %d taps, %d presses, %d lost, %d doubled, %d wrong button, %d unexpected, %u debounced\n", r.name.c_str(),
+         r.taps, r.presses, r.lost, r.doubled, r.wrongButton, r.unexpected, r.debounced);
+  for (const Stage &s : r.stages) {
+    if (s.us.empty()) {
+      if (s.required && r.presses > 0) printf("  %-10s n=0    MISSING\n", s.name);
+      continue;
+    }
+    printf("  %-10s n=%-4zu p50 %8.2f ms  p99 %8.2f ms  max %8.2f ms\n", s.name, s.us.size(), percentile(s.us, 50) / 1000.0,
+           percentile(s.us, 99) / 1000.0, percentile(s.us, 100) / 1000.0);
+  }
+}
+
+void usage(const char *argv0) {
+  fprintf(stderr,
+          "usage: %s [options] [trace files]\n"
+          "  --traces DIR      run every *.trace in DIR (traces)\n"
+          "  --out FILE        results as JSON (build/bench.json)\n"
+          "  --port N          HTTP port on 127.0.0.1 (8090)\n"
+          "  --poll-ms N       /state.bin poll interval (200, as api.py)\n"
+          "  --psram           report PSRAM (two-face colour sprites)\n"
+          "  --verbose         show the firmware's Serial output\n",
+          argv0);
+}
+
+} // namespace
+
+int main(int argc, char **argv) {
+  const char *dir = "traces";
+  const char *out = "build/bench.json";
+  std::vector<std::string> files;
+  sim::options.port = 8090;
+  for (int i = 1; i < argc; i++) {
+    std::string arg = argv[i];
+    const char *next = i + 1 < argc ? argv[i + 1] : nullptr;
+    if (arg == "--traces" && next) dir = argv[++i];
+    else if (arg == "--out" && next) out = argv[++i];
+    else if (arg == "--port" && next) sim::options.port = atoi(argv[++i]);
+    else if (arg == "--poll-ms" && next) pollMs = atoi(argv[++i]);
+    else if (arg == "--psram") sim::options.psram = true;
+    else if (arg == "--verbose") verbose = true;
+    else if (arg[0] != '-') files.push_back(arg);
+    else {
+      usage(argv[0]);
+      return 2;
+    }
+  }
+  sim::options.quiet = !verbose;
+
+  if (files.empty()) {
+    if (DIR *d = opendir(dir)) {
+      while (dirent *e = readdir(d)) {
+        std::string name = e->d_name;
+        if (name.size() > 6 && name.compare(name.size() - 6, 6, ".trace") == 0) files.push_back(std::string(dir) + "/" + name);
+      }
+      closedir(d);
+    }
+    std::sort(files.begin(), files.end());
+  }
+  std::vector<Trace> traces(files.size());
+  for (size_t i = 0; i < files.size(); i++) {
+    if (!loadTrace(files[i], traces[i])) {
+      fprintf(stderr, "bench: cannot load %s\n", files[i].c_str());
+      return 2;
+    }
+  }
+  if (traces.empty()) {
+    fprintf(stderr, "bench: no traces\n");
+    return 2;
+  }
+  // The firmware boots once, so one wake trace at most; it is reported first
+  const Trace *wake = nullptr;
+  for (const Trace &t : traces) {
+    if (!t.wakeButton) continue;
+    if (wake) {
+      fprintf(stderr, "bench: more than one wake trace (%s, %s)\n", wake->name.c_str(), t.name.c_str());
+      return 2;
+    }
+    wake = &t;
+  }
+
+  // The watcher runs from boot so it sees the wake tap's press
+  std::thread(watchEvents).detach();
+  int64_t wakeUs = 0;
+  if (wake) {
+    sim::options.touchWake = true;
+    sim::setProbing(true);
+    wakeUs = nowUs();
+    fw::fingerAt(wake->wakeX, wake->wakeY); // setup() samples the wake tap straight away
+  }
+  fw::start();
+  if (wake) {
+    delay(80);
+    sim::touchUp();
+  }
+  std::thread(streamClient).detach();
+  std::thread(pollClient).detach();
+
+  // Wait for WiFi (which posts the API URL overlay) and the push stream
+  bool ready = false;
+  for (int i = 0; i < 100 && !ready; i++) {
+    {
+      std::lock_guard<std::mutex> lock(observed.m);
+      ready = fw::online() && observed.streamConnected;
+    }
+    if (!ready) delay(50);
+  }
+  if (!ready) {
+    fprintf(stderr, "bench: %s\n", fw::online() ? "push stream never connected" : "firmware never came online");
+    fflush(stderr);
+    _Exit(2);
+  }
+  delay(300);
+
+  String json = "{\"version\":1,\"started\":" + String((long long)time(nullptr)) + ",\"poll_ms\":" + String(pollMs) +
+                ",\"psram\":" + (sim::options.psram ? "true" : "false") + ",\"traces\":[";
+  int failures = 0;
+  std::vector<const Trace *> order;
+  if (wake) order.push_back(wake);
+  for (const Trace &t : traces) {
+    if (&t != wake) order.push_back(&t);
+  }
+  for (size_t i = 0; i < order.size(); i++) {
+    Result r = order[i] == wake ? wakeResult(*wake, wakeUs) : runTrace(*order[i]);
+    printResult(r);
+    if (i) json += ",";
+    json += resultJson(r);
+    failures += r.lost + r.doubled + r.wrongButton + r.unexpected + missingStages(r);
+  }
+  json += "]}";
+
+  FILE *f = fopen(out, "w");
+  if (f) {
+    fprintf(f, "%s\n", json.c_str());
+    fclose(f);
+    printf("results: %s\n", out);
+  } else {
+    fprintf(stderr, "bench: cannot write %s\n", out);
+  }
+  fflush(stdout);
+  _Exit(failures ? 1 : 0);
+}
@@ -0,0 +1,342 @@
+// Arduino core, ESP, WiFi, touch and sleep stand-ins for the host simulator,
+// plus the counters and shutdown shared by the drivers.
+#define SIM_HOST_CLOCK
+#include "Arduino.h"
+#include "WiFi.h"
+#include "XPT2046_Touchscreen.h"
+#include "esp_sleep.h"
+#include "esp_sntp.h"
+#include "soc/gpio_struct.h"
+#include "sim.h"
+#include <chrono>
+#include <mutex>
+#include <random>
+#include <thread>
+#include <unistd.h>
+#include <poll.h>
+
+HardwareSerial Serial;
+EspClass ESP;
+WiFiClass WiFi;
+volatile gpio_dev_t GPIO;
+
+namespace sim {
+Counters counters;
+Options options;
+}
+
+// --- Serial ---
+size_t Print::printf(const char *format, ...) {
+  char buf[512];
+  va_list ap;
+  va_start(ap, format);
+  int n = vsnprintf(buf, sizeof(buf), format, ap);
+  va_end(ap);
+  if (n < 0) return 0;
+  if ((size_t)n < sizeof(buf)) return write((const uint8_t *)buf, n);
+  std::string big(n + 1, '\0');
+  va_start(ap, format);
+  vsnprintf(&big[0], big.size(), format, ap);
+  va_end(ap);
+  return write((const uint8_t *)big.data(), n);
+}
+
+String Stream::readStringUntil(char terminator) {
+  String s;
+  for (int i = 0; i < 1000; i++) {
+    int c = read();
+    if (c < 0) {
+      if (!available()) break;
+      continue;
+    }
+    if (c == terminator) break;
+    s += (char)c;
+  }
+  return s;
+}
+
+size_t HardwareSerial::write(uint8_t c) { return write(&c, 1); }
+
+size_t HardwareSerial::write(const uint8_t *b, size_t n) {
+  if (!sim::options.quiet) fwrite(b, 1, n, stderr);
+  return n;
+}
+
+int HardwareSerial::available() {
+  if (!sim::options.serialStdin) return 0;
+  pollfd p = {STDIN_FILENO, POLLIN, 0};
+  return poll(&p, 1, 0) > 0 && (p.revents & POLLIN) ? 1 : 0;
+}
+
+int HardwareSerial::read() {
+  if (!available()) return -1;
+  unsigned char c;
+  return ::read(STDIN_FILENO, &c, 1) == 1 ? c : -1;
+}
+
+// --- Timing ---
+static std::chrono::steady_clock::time_point bootTime() {
+  static const auto t = std::chrono::steady_clock::now();
+  return t;
+}
+
+unsigned long millis() {
+  return std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - bootTime()).count();
+}
+
+unsigned long micros() {
+  return (uint32_t)esp_timer_get_time();
+}
+
+int64_t esp_timer_get_time() {
+  return std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - bootTime()).count();
+}
+
+void delay(unsigned long ms) { std::this_thread::sleep_for(std::chrono::milliseconds(ms)); }
+void delayMicroseconds(unsigned int us) { std::this_thread::sleep_for(std::chrono::microseconds(us)); }
+void yield() { std::this_thread::yield(); }
+
+long map(long x, long inMin, long inMax, long outMin, long outMax) {
+  return (x - inMin) * (outMax - outMin) / (inMax - inMin) + outMin;
+}
+
+// --- Wall clock ---
+// The simulated clock is the host clock plus an offset that settimeofday() moves;
+// it starts unset (epoch 0 + uptime) like the device after a cold boot
+static std::atomic<int64_t> clockOffsetUs{0};
+static std::atomic<bool> clockSet{false};
+
+static int64_t hostUs() {
+  return std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::system_clock::now().time_since_epoch()).count();
+}
+
+int sim_gettimeofday(struct timeval *tv, void *tz) {
+  int64_t us = clockSet ? hostUs() + clockOffsetUs.load() : esp_timer_get_time();
+  tv->tv_sec = us / 1000000;
+  tv->tv_usec = us % 1000000;
+  return 0;
+}
+
+int sim_settimeofday(const struct timeval *tv, const void *tz) {
+  clockOffsetUs = (int64_t)tv->tv_sec * 1000000 + tv->tv_usec - hostUs();
+  clockSet = true;
+  return 0;
+}
+
+time_t sim_time(time_t *t) {
+  timeval tv;
+  sim_gettimeofday(&tv, nullptr);
+  if (t) *t = tv.tv_sec;
+  return tv.tv_sec;
+}
+
+static sntp_sync_time_cb_t sntpCallback = nullptr;
+
+void sntp_set_time_sync_notification_cb(sntp_sync_time_cb_t callback) { sntpCallback = callback; }
+
+// No network time in the simulator: the first "sync" takes the host clock
+void configTime(long gmtOffsetSec, int daylightOffsetSec, const char *server1, const char *server2, const char *server3) {
+  std::thread([] {
+    std::this_thread::sleep_for(std::chrono::milliseconds(50));
+    timeval tv = {(time_t)(hostUs() / 1000000), (suseconds_t)(hostUs() % 1000000)};
+    sim_settimeofday(&tv, nullptr);
+    if (sntpCallback) sntpCallback(&tv);
+  }).detach();
+}
+
+// --- GPIO / touch ---
+// The touch IRQ line (the pin with a FALLING interrupt) reads LOW while the
+// simulated finger is down; putting the finger down runs the ISR
+static std::mutex fingerMutex;
+static bool finger = false;
+static int fingerX = 0, fingerY = 0;
+static int irqPin = -1;
+static void (*irqHandler)() = nullptr;
+
+void pinMode(uint8_t pin, uint8_t mode) {}
+void digitalWrite(uint8_t pin, uint8_t value) {}
+
+int digitalRead(uint8_t pin) {
+  return (pin == irqPin || irqPin < 0) && sim::fingerDown() ? LOW : HIGH;
+}
+
+void attachInterrupt(uint8_t pin, void (*isr)(void), int mode) {
+  if (mode != FALLING) return;
+  irqPin = pin;
+  irqHandler = isr;
+}
+
+void detachInterrupt(uint8_t pin) {
+  if (pin == irqPin) irqHandler = nullptr;
+}
+
+void sim::touchDown(int rawX, int rawY) {
+  bool edge;
+  {
+    std::lock_guard<std::mutex> lock(fingerMutex);
+    edge = !finger;
+    finger = true;
+    fingerX = rawX;
+    fingerY = rawY;
+  }
+  counters.touchesInjected++;
+  if (edge && irqHandler) irqHandler();
+}
+
+void sim::touchUp() {
+  std::lock_guard<std::mutex> lock(fingerMutex);
+  finger = false;
+}
+
+bool sim::fingerDown() {
+  std::lock_guard<std::mutex> lock(fingerMutex);
+  return finger;
+}
+
+void sim::fingerPosition(int &rawX, int &rawY) {
+  std::lock_guard<std::mutex> lock(fingerMutex);
+  rawX = fingerX;
+  rawY = fingerY;
+}
+
+// One reading per call, with the few counts of jitter a real panel has
+TS_Point XPT2046_Touchscreen::getPoint() {
+  static thread_local std::minstd_rand noise(7);
+  int x, y;
+  sim::fingerPosition(x, y);
+  if (!sim::fingerDown()) return TS_Point(0, 0, 0);
+  return TS_Point(x + (int)(noise() % 9) - 4, y + (int)(noise() % 9) - 4, 600);
+}
+
+bool XPT2046_Touchscreen::touched() { return sim::fingerDown(); }
+
+// --- ESP ---
+static std::atomic<uint32_t> cpuMhz{240};
+
+void EspClass::restart() { sim::shutdown("restart", 0); }
+uint32_t EspClass::getHeapSize() { return 320 * 1024; }
+uint32_t EspClass::getFreeHeap() { return getHeapSize() - 120 * 1024 - sim::counters.spriteBytes; }
+uint32_t EspClass::getMaxAllocHeap() { return min<uint32_t>(getFreeHeap(), 110 * 1024); }
+uint32_t EspClass::getMinFreeHeap() { return getHeapSize() - 120 * 1024 - sim::counters.spriteBytesPeak; }
+
+bool psramFound() { return sim::options.psram; }
+
+uint32_t esp_random() {
+  static std::mutex m;
+  static std::mt19937 gen(std::random_device{}());
+  std::lock_guard<std::mutex> lock(m);
+  return gen();
+}
+
+bool setCpuFrequencyMhz(uint32_t mhz) {
+  cpuMhz = mhz;
+  return true;
+}
+
+uint32_t getCpuFrequencyMhz() { return cpuMhz; }
+
+// --- Sleep ---
+esp_sleep_wakeup_cause_t esp_sleep_get_wakeup_cause() {
+  return sim::options.touchWake ? ESP_SLEEP_WAKEUP_EXT0 : ESP_SLEEP_WAKEUP_UNDEFINED;
+}
+
+void esp_deep_sleep_start() { sim::shutdown("deep sleep", 0); }
+
+// --- WiFi ---
+// Station mode connects wifiDelayMs after begin(), whatever the credentials
+wl_status_t WiFiClass::begin(const char *ssid, const char *pass, int32_t channel, const uint8_t *bssid, bool connect) {
+  beginMs = millis();
+  started = true;
+  return WL_DISCONNECTED;
+}
+
+bool WiFiClass::disconnect(bool wifiOff, bool eraseAp) {
+  started = false;
+  return true;
+}
+
+wl_status_t WiFiClass::status() {
+  if (!started) return WL_DISCONNECTED;
+  return millis() - beginMs >= sim::options.wifiDelayMs ? WL_CONNECTED : WL_DISCONNECTED;
+}
+
+// --- Probes ---
+static std::atomic<bool> probing{false};
+static std::mutex probeMutex;
+static std::vector<sim::Probe> probes;
+
+void sim::setProbing(bool on) { probing = on; }
+
+void sim::probe(ProbeKind kind, const char *ns) {
+  if (!probing) return;
+  Probe p = {esp_timer_get_time(), kind, {0}};
+  if (ns) snprintf(p.ns, sizeof(p.ns), "%s", ns);
+  std::lock_guard<std::mutex> lock(probeMutex);
+  probes.push_back(p);
+}
+
+std::vector<sim::Probe> sim::takeProbes() {
+  std::lock_guard<std::mutex> lock(probeMutex);
+  std::vector<Probe> out;
+  out.swap(probes);
+  return out;
+}
+
+// --- Counters ---
+static const struct {
+  const char *name;
+  std::atomic<uint64_t> sim::Counters::*field;
+} counterFields[] = {
+  {"draw_calls", &sim::Counters::drawCalls},
+  {"panel_pixels", &sim::Counters::panelPixels},
+  {"spi_bytes", &sim::Counters::spiBytes},
+  {"full_clears", &sim::Counters::fullClears},
+  {"sprite_draw_calls", &sim::Counters::spriteDrawCalls},
+  {"sprite_pushes", &sim::Counters::spritePushes},
+  {"sprite_alloc_fails", &sim::Counters::spriteAllocFails},
+  {"sprite_bytes", &sim::Counters::spriteBytes},
+  {"sprite_bytes_peak", &sim::Counters::spriteBytesPeak},
+  {"nvs_reads", &sim::Counters::nvsReads},
+  {"nvs_writes", &sim::Counters::nvsWrites},
+  {"nvs_write_bytes", &sim::Counters::nvsWriteBytes},
+  {"nvs_erases", &sim::Counters::nvsErases},
+  {"fs_read_bytes", &sim::Counters::fsReadBytes},
+  {"fs_write_bytes", &sim::Counters::fsWriteBytes},
+  {"http_requests", &sim::Counters::httpRequests},
+  {"http_bytes_out", &sim::Counters::httpBytesOut},
+  {"touches_injected", &sim::Counters::touchesInjected},
+};
+
+String sim::countersJson() {
+  String json = "{\"uptime_ms\":" + String(millis());
+  for (auto &f : counterFields) {
+    json += ",\"" + String(f.name) + "\":" + String((unsigned long long)(counters.*f.field).load());
+  }
+  json += "}";
+  return json;
+}
+
+// Live sprite memory is state, not a count: it survives a reset
+void sim::resetCounters() {
+  for (auto &f : counterFields) {
+    if (f.field != &Counters::spriteBytes) (counters.*f.field) = 0;
+  }
+  counters.spriteBytesPeak = counters.spriteBytes.load();
+}
+
+void sim::shutdown(const char *why, int code) {
+  saveNvs();
+  saveRtc();
+  String json = countersJson();
+  if (options.outFile) {
+    FILE *f = fopen(options.outFile, "w");
+    if (f) {
+      fprintf(f, "%s\n", json.c_str());
+      fclose(f);
+    }
+  }
+  fprintf(stderr, "sim: %s, counters %s\n", why, json.c_str());
+  fflush(stdout);
+  fflush(stderr);
+  _Exit(code);
+}
@@ -0,0 +1,131 @@
+// TFT_eSPI accounting for the host simulator (see include/TFT_eSPI.h).
+#include "TFT_eSPI.h"
+#include "sim.h"
+
+// CASET + RASET (command and 4 data bytes each) and RAMWR
+static const uint32_t WINDOW_BYTES = 11;
+
+static void clip(int32_t &x, int32_t &y, int32_t &w, int32_t &h, int32_t maxW, int32_t maxH) {
+  if (x < 0) { w += x; x = 0; }
+  if (y < 0) { h += y; y = 0; }
+  if (x + w > maxW) w = maxW - x;
+  if (y + h > maxH) h = maxH - y;
+}
+
+void TFT_eSPI::emitCommand(uint32_t bytes) {
+  sim::counters.spiBytes += bytes;
+}
+
+void TFT_eSPI::emitArea(int32_t x, int32_t y, int32_t rw, int32_t rh) {
+  clip(x, y, rw, rh, w, h);
+  if (rw <= 0 || rh <= 0) return;
+  uint64_t px = (uint64_t)rw * rh;
+  sim::counters.drawCalls++;
+  sim::counters.panelPixels += px;
+  sim::counters.spiBytes += WINDOW_BYTES + 2 * px;
+  sim::probe(sim::PROBE_PANEL);
+}
+
+// The window costs a draw call; its pixels are counted as they are pushed
+void TFT_eSPI::setAddrWindow(int32_t x, int32_t y, int32_t ww, int32_t wh) {
+  sim::counters.drawCalls++;
+  sim::counters.spiBytes += WINDOW_BYTES;
+  sim::probe(sim::PROBE_PANEL);
+}
+
+void TFT_eSPI::pushPixels(const void *data, uint32_t len) {
+  sim::counters.panelPixels += len;
+  sim::counters.spiBytes += 2 * len;
+}
+
+void TFT_eSPI::fillScreen(uint32_t color) {
+  sim::counters.fullClears++;
+  emitArea(0, 0, w, h);
+}
+
+// Approximate cell of each built-in font: 1 GLCD, 2 small, 4 medium, 6/7/8 numeric
+int16_t TFT_eSPI::cellWidth(uint8_t f) {
+  switch (f) {
+    case 1: return 6;
+    case 2: return 8;
+    case 4: return 14;
+    case 6: return 24;
+    case 7: return 32;
+    case 8: return 55;
+    default: return 6;
+  }
+}
+
+int16_t TFT_eSPI::cellHeight(uint8_t f) {
+  switch (f) {
+    case 1: return 8;
+    case 2: return 16;
+    case 4: return 26;
+    case 6: return 48;
+    case 7: return 48;
+    case 8: return 75;
+    default: return 8;
+  }
+}
+
+// Built-in fonts are drawn one window per character; transparent text only
+// writes the ink, about a third of the cell
+int16_t TFT_eSPI::drawString(const char *s, int32_t x, int32_t y, uint8_t f) {
+  int16_t tw = textWidth(s, f), th = fontHeight(f);
+  int32_t pad = padding > tw ? padding : tw;
+  int col = datum % 3, row = datum / 3;
+  x -= col == 1 ? pad / 2 : (col == 2 ? pad : 0);
+  y -= row == 1 ? th / 2 : (row == 2 ? th : 0);
+  int16_t cw = cellWidth(f) * textSize;
+  for (size_t i = 0; s[i]; i++) {
+    if (textBgFill) emitArea(x + i * cw, y, cw, th);
+    else if (s[i] != ' ') emitArea(x + i * cw, y, cw, (th + 2) / 3);
+  }
+  if (textBgFill && pad > tw) emitArea(x + tw, y, pad - tw, th);
+  return tw;
+}
+
+// --- Sprites ---
+void *TFT_eSprite::createSprite(int16_t sw, int16_t sh, uint8_t frames) {
+  deleteSprite();
+  if (sw <= 0 || sh <= 0) return nullptr;
+  size_t need = depth == 1 ? (size_t)((sw + 7) / 8) * sh : (size_t)sw * sh * (depth / 8);
+  if (sim::counters.spriteBytes + need > sim::options.spriteBudget) {
+    sim::counters.spriteAllocFails++;
+    return nullptr;
+  }
+  buf = (uint8_t *)calloc(need, 1);
+  if (!buf) return nullptr;
+  bytes = need;
+  w = w0 = sw;
+  h = h0 = sh;
+  uint64_t live = sim::counters.spriteBytes += need;
+  uint64_t peak = sim::counters.spriteBytesPeak;
+  while (live > peak && !sim::counters.spriteBytesPeak.compare_exchange_weak(peak, live)) {}
+  return buf;
+}
+
+void TFT_eSprite::deleteSprite() {
+  if (!buf) return;
+  free(buf);
+  buf = nullptr;
+  sim::counters.spriteBytes -= bytes;
+  bytes = 0;
+  w = h = 0;
+}
+
+void TFT_eSprite::emitArea(int32_t x, int32_t y, int32_t rw, int32_t rh) {
+  if (!buf) return;
+  sim::counters.spriteDrawCalls++;
+}
+
+// Every depth goes out as 16-bit pixels in one window
+void TFT_eSprite::pushSprite(int32_t x, int32_t y) {
+  if (!buf) return;
+  sim::counters.spritePushes++;
+  tft->emitArea(x, y, w, h);
+}
+
+void TFT_eSprite::pushSprite(int32_t x, int32_t y, uint16_t transparent) {
+  pushSprite(x, y);
+}
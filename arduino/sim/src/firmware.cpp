@@ -0,0 +1,84 @@
+// Builds the firmware itself, against the stand-ins in ../include.
+#include "Arduino.h"
+#include "../../arduino.h"
+#include "firmware.h"
+#include "sim.h"
+
+static void loopTask(void *arg) {
+  setup();
+  for (;;) loop();
+}
+
+void fw::start() {
+  TaskHandle_t handle;
+  xTaskCreatePinnedToCore(loopTask, "loopTask", 8192, nullptr, 1, &handle, 1);
+}
+
+// The inverse of mapTouch(), rounded up so it maps back to the same pixel
+void fw::screenToRaw(int x, int y, int &rawX, int &rawY) {
+  const int w = TFT_HEIGHT, h = TFT_WIDTH;
+  rawX = TOUCH_MIN + (x * (TOUCH_MAX - TOUCH_MIN) + w - 2) / (w - 1);
+  rawY = TOUCH_MIN + (y * (TOUCH_MAX - TOUCH_MIN) + h - 2) / (h - 1);
+}
+
+void fw::fingerAt(int x, int y) {
+  int rawX, rawY;
+  screenToRaw(x, y, rawX, rawY);
+  sim::touchDown(rawX, rawY);
+}
+
+bool fw::buttonCentre(int n, int &x, int &y) {
+  DeckLock lock;
+  if (n < 1 || n > ::buttonCount || (n - 1) / slotsPerPage != currentPage) return false;
+  const Btn &b = buttons[n - 1];
+  x = b.x + b.size / 2;
+  y = b.y + b.size / 2;
+  return true;
+}
+
+bool fw::buttonState(int n) {
+  DeckLock lock;
+  return n >= 1 && n <= ::buttonCount && buttons[n - 1].state;
+}
+
+int fw::buttonCount() {
+  DeckLock lock;
+  return ::buttonCount;
+}
+
+uint32_t fw::eventSeq() {
+  return ::eventSeq.load(std::memory_order_acquire);
+}
+
+bool fw::readEvent(uint32_t seq, Event &e) {
+  ButtonEvent b;
+  if (!readButtonEvent(seq, b)) return false;
+  e = {b.seq, b.ms, b.button + 1, b.type == EVT_PRESS, b.state};
+  return true;
+}
+
+bool fw::online() {
+  return wifiPhase == NET_ONLINE;
+}
+
+bool fw::deckShown() {
+  return !overlayUntil && !infoModeActive && !screensaverActive && deckOnScreen;
+}
+
+bool fw::infoModeShown() {
+  return infoModeActive;
+}
+
+void fw::setInfoModeTimeout(unsigned long ms) {
+  static unsigned long configured = 0;
+  if (!configured) configured = INFO_MODE_TIMEOUT;
+  INFO_MODE_TIMEOUT = ms ? ms : configured;
+}
+
+unsigned long fw::persistQuietMs() {
+  return PERSIST_QUIET_MS;
+}
+
+uint32_t fw::debouncedPresses() {
+  return touchStats.debounced;
+}
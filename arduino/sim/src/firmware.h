@@ -0,0 +1,38 @@
+// The firmware as the simulator drivers see it: firmware.cpp is the only
+// translation unit that includes ../../arduino.h, these reach into it.
+#pragma once
+#include "Arduino.h"
+
+namespace fw {
+
+// A button event from the firmware's event ring
+struct Event {
+  uint32_t seq;
+  uint32_t ms;
+  int button;   // 1-based
+  bool press;   // false: release
+  bool state;
+};
+
+void start();  // runs setup() and loop() in a "loopTask" thread
+
+// Touch, in screen pixels (the firmware runs the panel in landscape)
+void screenToRaw(int x, int y, int &rawX, int &rawY);
+void fingerAt(int x, int y);
+bool buttonCentre(int n, int &x, int &y); // false unless button n (1-based) is on screen
+bool buttonState(int n);
+int buttonCount();
+
+uint32_t eventSeq();
+bool readEvent(uint32_t seq, Event &e);
+
+bool online(); // WiFi connected (the API URL overlay is posted then)
+
+// The deck is showing (no splash, URL overlay, info mode or screensaver)
+bool deckShown();
+bool infoModeShown();
+void setInfoModeTimeout(unsigned long ms); // 0 restores the configured timeout
+unsigned long persistQuietMs();
+uint32_t debouncedPresses();
+
+} // namespace fw
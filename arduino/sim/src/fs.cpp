@@ -0,0 +1,135 @@
+// LittleFS for the host simulator (see include/LittleFS.h). Paths are
+// mapped under --fs DIR; files are plain stdio streams.
+#include "LittleFS.h"
+#include "sim.h"
+#include <dirent.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+LittleFSFS LittleFS;
+
+struct File::Impl {
+  std::string path;   // from the filesystem root, e.g. "/icons/1.cdi"
+  std::string name;
+  FILE *fp = nullptr;
+  DIR *dir = nullptr;
+  ~Impl() {
+    if (fp) fclose(fp);
+    if (dir) closedir(dir);
+  }
+};
+
+static std::string hostPath(const char *path) {
+  std::string p = sim::options.fsDir;
+  if (*path != '/') p += '/';
+  return p + path;
+}
+
+static std::shared_ptr<File::Impl> openPath(const std::string &path, const char *mode) {
+  auto impl = std::make_shared<File::Impl>();
+  impl->path = path;
+  size_t slash = path.find_last_of('/');
+  impl->name = slash == std::string::npos ? path : path.substr(slash + 1);
+  std::string host = hostPath(path.c_str());
+  struct stat st;
+  if (*mode == 'r' && stat(host.c_str(), &st) == 0 && S_ISDIR(st.st_mode)) {
+    impl->dir = opendir(host.c_str());
+    return impl->dir ? impl : nullptr;
+  }
+  std::string m = mode;
+  if (m.find('b') == std::string::npos) m += 'b';
+  impl->fp = fopen(host.c_str(), m.c_str());
+  return impl->fp ? impl : nullptr;
+}
+
+size_t File::read(uint8_t *buf, size_t len) {
+  if (!impl || !impl->fp) return 0;
+  size_t n = fread(buf, 1, len, impl->fp);
+  sim::counters.fsReadBytes += n;
+  return n;
+}
+
+int File::read() {
+  uint8_t c;
+  return read(&c, 1) == 1 ? c : -1;
+}
+
+size_t File::write(const uint8_t *buf, size_t len) {
+  if (!impl || !impl->fp) return 0;
+  size_t n = fwrite(buf, 1, len, impl->fp);
+  sim::counters.fsWriteBytes += n;
+  return n;
+}
+
+bool File::seek(uint32_t pos) {
+  return impl && impl->fp && fseek(impl->fp, pos, SEEK_SET) == 0;
+}
+
+size_t File::position() const {
+  return impl && impl->fp ? ftell(impl->fp) : 0;
+}
+
+size_t File::size() const {
+  if (!impl || !impl->fp) return 0;
+  struct stat st;
+  return fstat(fileno(impl->fp), &st) == 0 ? st.st_size : 0;
+}
+
+const char *File::name() const { return impl ? impl->name.c_str() : ""; }
+const char *File::path() const { return impl ? impl->path.c_str() : ""; }
+bool File::isDirectory() const { return impl && impl->dir; }
+
+File File::openNextFile() {
+  if (!impl || !impl->dir) return File();
+  while (struct dirent *e = readdir(impl->dir)) {
+    if (e->d_name[0] == '.') continue;
+    std::string path = impl->path;
+    if (path.empty() || path.back() != '/') path += '/';
+    auto f = openPath(path + e->d_name, "r");
+    if (f) return File(f);
+  }
+  return File();
+}
+
+bool LittleFSFS::begin(bool formatOnFail, const char *basePath, uint8_t maxOpenFiles, const char *partitionLabel) {
+  std::string root = sim::options.fsDir;
+  for (size_t i = 1; i <= root.size(); i++) {
+    if (i == root.size() || root[i] == '/') ::mkdir(root.substr(0, i).c_str(), 0755);
+  }
+  struct stat st;
+  return stat(root.c_str(), &st) == 0 && S_ISDIR(st.st_mode);
+}
+
+File LittleFSFS::open(const char *path, const char *mode) {
+  return File(openPath(path, mode));
+}
+
+bool LittleFSFS::exists(const char *path) {
+  struct stat st;
+  return stat(hostPath(path).c_str(), &st) == 0;
+}
+
+bool LittleFSFS::remove(const char *path) {
+  return unlink(hostPath(path).c_str()) == 0;
+}
+
+bool LittleFSFS::rename(const char *from, const char *to) {
+  return ::rename(hostPath(from).c_str(), hostPath(to).c_str()) == 0;
+}
+
+bool LittleFSFS::mkdir(const char *path) {
+  return ::mkdir(hostPath(path).c_str(), 0755) == 0;
+}
+
+size_t LittleFSFS::usedBytes() {
+  size_t used = 0;
+  File root = open("/");
+  for (File d = root.openNextFile(); d; d = root.openNextFile()) {
+    if (!d.isDirectory()) {
+      used += d.size();
+      continue;
+    }
+    for (File f = d.openNextFile(); f; f = d.openNextFile()) used += f.size();
+  }
+  return used;
+}
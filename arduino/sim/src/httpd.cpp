@@ -0,0 +1,466 @@
+// esp_http_server for the host simulator: one server thread, select() over
+// the listening socket, the open sessions and a wake pipe for queued work.
+// Handlers, queued work and close callbacks all run on that thread, so the
+// firmware sees the same single-threaded server it gets on the device.
+#define SIM_HOST_CLOCK
+#include "esp_http_server.h"
+#include "sim.h"
+#include <algorithm>
+#include <deque>
+#include <mutex>
+#include <set>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+#include <arpa/inet.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <poll.h>
+#include <strings.h>
+#include <sys/select.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#define ESP_ERR_HTTPD_BASE 0xb000
+#define ESP_ERR_HTTPD_RESULT_TRUNC (ESP_ERR_HTTPD_BASE + 3)
+#define ESP_ERR_HTTPD_RESP_SEND (ESP_ERR_HTTPD_BASE + 7)
+
+namespace {
+
+struct Session {
+  int fd;
+  unsigned long lastActiveMs;
+  std::string in; // received, not yet consumed
+};
+
+struct Request {
+  httpd_req_t req{}; // first, so the firmware's httpd_req_t* converts back
+  Session *session;
+  std::string method, path, query;
+  std::vector<std::pair<std::string, std::string>> headers;
+  size_t bodyLeft;
+  bool keepAlive;
+  std::string status = "200 OK";
+  std::string type = "text/html";
+  std::vector<std::pair<std::string, std::string>> respHeaders;
+  bool headersSent = false;
+  bool failed = false;
+};
+
+struct Server {
+  httpd_config_t config;
+  std::vector<httpd_uri_t> routes;
+  int listenFd = -1;
+  int wake[2] = {-1, -1};
+  std::vector<Session *> sessions;
+  std::mutex m; // work and closing, the only state other threads touch
+  std::deque<std::pair<httpd_work_fn_t, void *>> work;
+  std::set<int> closing;
+};
+
+bool sendAll(int fd, const char *buf, size_t len) {
+  while (len > 0) {
+    ssize_t n = send(fd, buf, len, MSG_NOSIGNAL);
+    if (n <= 0) return false;
+    sim::counters.httpBytesOut += n;
+    buf += n;
+    len -= n;
+  }
+  return true;
+}
+
+void wakeServer(Server *s) {
+  char c = 1;
+  if (write(s->wake[1], &c, 1) < 0) {}
+}
+
+void closeSession(Server *s, Session *sess) {
+  s->sessions.erase(std::remove(s->sessions.begin(), s->sessions.end(), sess), s->sessions.end());
+  if (s->config.close_fn) s->config.close_fn(s, sess->fd);
+  else close(sess->fd);
+  delete sess;
+}
+
+const std::string *findHeader(const std::vector<std::pair<std::string, std::string>> &headers, const char *name) {
+  for (auto &h : headers) {
+    if (strcasecmp(h.first.c_str(), name) == 0) return &h.second;
+  }
+  return nullptr;
+}
+
+bool sendHeaders(Request *r, const char *extra) {
+  std::string head = "HTTP/1.1 " + r->status + "\r\nContent-Type: " + r->type + "\r\n";
+  for (auto &h : r->respHeaders) head += h.first + ": " + h.second + "\r\n";
+  head += extra;
+  head += "\r\n";
+  r->headersSent = true;
+  if (!sendAll(r->session->fd, head.data(), head.size())) r->failed = true;
+  return !r->failed;
+}
+
+void sendError(int fd, const char *status, const char *body) {
+  std::string msg = std::string("HTTP/1.1 ") + status + "\r\nContent-Type: text/html\r\nContent-Length: " +
+                    std::to_string(strlen(body)) + "\r\n\r\n" + body;
+  sendAll(fd, msg.data(), msg.size());
+}
+
+// Parses one request off the session buffer and runs its handler; false
+// once the session should be closed, or nothing complete has arrived yet
+bool serveRequest(Server *s, Session *sess, bool &closeIt) {
+  size_t end = sess->in.find("\r\n\r\n");
+  if (end == std::string::npos) {
+    if (sess->in.size() > 8192) closeIt = true; // header too long
+    return false;
+  }
+  std::string head = sess->in.substr(0, end);
+  sess->in.erase(0, end + 4);
+
+  Request *r = new Request();
+  r->session = sess;
+  size_t lineEnd = head.find("\r\n");
+  std::string line = head.substr(0, lineEnd);
+  size_t a = line.find(' '), b = line.rfind(' ');
+  if (a == std::string::npos || b == a) {
+    sendError(sess->fd, "400 Bad Request", "Bad request");
+    closeIt = true;
+    delete r;
+    return false;
+  }
+  r->method = line.substr(0, a);
+  std::string uri = line.substr(a + 1, b - a - 1);
+  bool http10 = line.compare(b + 1, std::string::npos, "HTTP/1.0") == 0;
+  size_t q = uri.find('?');
+  r->path = uri.substr(0, q);
+  if (q != std::string::npos) r->query = uri.substr(q + 1);
+
+  for (size_t p = lineEnd; p != std::string::npos && p < head.size();) {
+    size_t next = head.find("\r\n", p + 2);
+    std::string h = head.substr(p + 2, next == std::string::npos ? std::string::npos : next - p - 2);
+    size_t colon = h.find(':');
+    if (colon != std::string::npos) {
+      size_t v = h.find_first_not_of(' ', colon + 1);
+      r->headers.push_back({h.substr(0, colon), v == std::string::npos ? "" : h.substr(v)});
+    }
+    p = next;
+  }
+  const std::string *len = findHeader(r->headers, "Content-Length");
+  const std::string *conn = findHeader(r->headers, "Connection");
+  r->bodyLeft = len ? strtoul(len->c_str(), nullptr, 10) : 0;
+  r->keepAlive = conn ? strcasecmp(conn->c_str(), "close") != 0 : !http10;
+
+  int method = r->method == "GET" ? HTTP_GET : r->method == "POST" ? HTTP_POST : r->method == "PUT" ? HTTP_PUT :
+               r->method == "DELETE" ? HTTP_DELETE : r->method == "HEAD" ? HTTP_HEAD : r->method == "OPTIONS" ? HTTP_OPTIONS : -1;
+  r->req.handle = s;
+  r->req.method = method;
+  strncpy(const_cast<char *>(r->req.uri), uri.c_str(), HTTPD_MAX_URI_LEN);
+  r->req.content_len = r->bodyLeft;
+  r->req.aux = r;
+  sim::counters.httpRequests++;
+
+  bool ok = true;
+  if (r->path == "/sim/counters") {
+    // The simulator's own endpoint, ahead of the firmware's routes
+    String json = sim::countersJson();
+    std::string msg = "HTTP/1.1 200 OK\r\nContent-Type: application/json\r\nContent-Length: " +
+                      std::to_string(json.length()) + "\r\n\r\n" + json.c_str();
+    ok = sendAll(sess->fd, msg.data(), msg.size());
+  } else {
+    const httpd_uri_t *route = nullptr;
+    bool pathKnown = false;
+    for (auto &u : s->routes) {
+      if (r->path != u.uri) continue;
+      pathKnown = true;
+      if (u.method == method) route = &u;
+    }
+    if (route) {
+      r->req.user_ctx = route->user_ctx;
+      ok = route->handler(&r->req) == ESP_OK;
+    } else {
+      sendError(sess->fd, pathKnown ? "405 Method Not Allowed" : "404 Not Found",
+                pathKnown ? "Request method for this URI is not handled by server" : "Nothing matches the given URI");
+    }
+  }
+
+  // Unread body is discarded so the next request on the connection parses
+  // (unless the handler already asked for the connection to be closed)
+  {
+    std::lock_guard<std::mutex> lock(s->m);
+    if (s->closing.count(sess->fd)) r->failed = true;
+  }
+  while (r->bodyLeft > 0 && !r->failed) {
+    char buf[512];
+    int n = httpd_req_recv(&r->req, buf, std::min(sizeof(buf), r->bodyLeft));
+    if (n <= 0) r->failed = true;
+  }
+  closeIt = !ok || r->failed || !r->keepAlive;
+  delete r;
+  return !closeIt;
+}
+
+void serverLoop(Server *s) {
+  sim::adoptThread("httpd");
+  for (;;) {
+    fd_set rd;
+    FD_ZERO(&rd);
+    FD_SET(s->listenFd, &rd);
+    FD_SET(s->wake[0], &rd);
+    int maxFd = std::max(s->listenFd, s->wake[0]);
+    for (Session *sess : s->sessions) {
+      FD_SET(sess->fd, &rd);
+      maxFd = std::max(maxFd, sess->fd);
+    }
+    if (select(maxFd + 1, &rd, nullptr, nullptr, nullptr) < 0) continue;
+
+    if (FD_ISSET(s->wake[0], &rd)) {
+      char buf[64];
+      if (read(s->wake[0], buf, sizeof(buf)) < 0) {}
+    }
+
+    // Queued work and close requests, in the order they were made
+    for (;;) {
+      std::pair<httpd_work_fn_t, void *> job(nullptr, nullptr);
+      {
+        std::lock_guard<std::mutex> lock(s->m);
+        if (s->work.empty()) break;
+        job = s->work.front();
+        s->work.pop_front();
+      }
+      job.first(job.second);
+    }
+    std::set<int> closing;
+    {
+      std::lock_guard<std::mutex> lock(s->m);
+      closing.swap(s->closing);
+    }
+    for (int fd : closing) {
+      auto it = std::find_if(s->sessions.begin(), s->sessions.end(), [fd](Session *x) { return x->fd == fd; });
+      if (it != s->sessions.end()) closeSession(s, *it);
+    }
+
+    std::vector<Session *> ready;
+    for (Session *sess : s->sessions) {
+      if (FD_ISSET(sess->fd, &rd) && !closing.count(sess->fd)) ready.push_back(sess);
+    }
+    for (Session *sess : ready) {
+      char buf[2048];
+      ssize_t n = recv(sess->fd, buf, sizeof(buf), 0);
+      if (n <= 0) {
+        closeSession(s, sess);
+        continue;
+      }
+      sess->lastActiveMs = millis();
+      sess->in.append(buf, n);
+      bool closeIt = false;
+      while (serveRequest(s, sess, closeIt)) {}
+      if (closeIt) closeSession(s, sess);
+    }
+
+    if (FD_ISSET(s->listenFd, &rd)) {
+      int fd = accept(s->listenFd, nullptr, nullptr);
+      if (fd < 0) continue;
+      if ((int)s->sessions.size() >= s->config.max_open_sockets) {
+        if (!s->config.lru_purge_enable) {
+          close(fd);
+          continue;
+        }
+        Session *lru = *std::min_element(s->sessions.begin(), s->sessions.end(),
+                                         [](Session *x, Session *y) { return x->lastActiveMs < y->lastActiveMs; });
+        closeSession(s, lru);
+      }
+      Session *sess = new Session{fd, millis(), std::string()};
+      s->sessions.push_back(sess);
+      if (s->config.open_fn && s->config.open_fn(s, fd) != ESP_OK) closeSession(s, sess);
+    }
+  }
+}
+
+Request *request(httpd_req_t *r) { return (Request *)r->aux; }
+
+} // namespace
+
+httpd_config_t HTTPD_DEFAULT_CONFIG() {
+  httpd_config_t c = {};
+  c.task_priority = 5;
+  c.stack_size = 4096;
+  c.core_id = 0x7fffffff;
+  c.server_port = 80;
+  c.ctrl_port = 32768;
+  c.max_open_sockets = 7;
+  c.max_uri_handlers = 8;
+  c.max_resp_headers = 8;
+  c.backlog_conn = 5;
+  c.recv_wait_timeout = 5;
+  c.send_wait_timeout = 5;
+  return c;
+}
+
+// The simulator always listens on 127.0.0.1:--port, whatever the firmware asks for
+esp_err_t httpd_start(httpd_handle_t *handle, const httpd_config_t *config) {
+  Server *s = new Server();
+  s->config = *config;
+  s->listenFd = socket(AF_INET, SOCK_STREAM, 0);
+  int on = 1;
+  setsockopt(s->listenFd, SOL_SOCKET, SO_REUSEADDR, &on, sizeof(on));
+  sockaddr_in addr = {};
+  addr.sin_family = AF_INET;
+  addr.sin_port = htons(sim::options.port);
+  addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+  if (s->listenFd < 0 || bind(s->listenFd, (sockaddr *)&addr, sizeof(addr)) < 0 ||
+      listen(s->listenFd, config->backlog_conn) < 0 || pipe(s->wake) < 0) {
+    fprintf(stderr, "sim: cannot listen on 127.0.0.1:%d: %s\n", sim::options.port, strerror(errno));
+    if (s->listenFd >= 0) close(s->listenFd);
+    delete s;
+    return ESP_FAIL;
+  }
+  fprintf(stderr, "sim: HTTP on http://127.0.0.1:%d/\n", sim::options.port);
+  *handle = s;
+  std::thread(serverLoop, s).detach();
+  return ESP_OK;
+}
+
+esp_err_t httpd_register_uri_handler(httpd_handle_t handle, const httpd_uri_t *uri) {
+  Server *s = (Server *)handle;
+  if (s->routes.size() >= s->config.max_uri_handlers) return ESP_ERR_NO_MEM;
+  s->routes.push_back(*uri);
+  return ESP_OK;
+}
+
+int httpd_req_recv(httpd_req_t *r, char *buf, size_t len) {
+  Request *req = request(r);
+  len = std::min(len, req->bodyLeft);
+  if (len == 0) return 0;
+  std::string &in = req->session->in;
+  size_t n;
+  if (!in.empty()) {
+    n = std::min(len, in.size());
+    memcpy(buf, in.data(), n);
+    in.erase(0, n);
+  } else {
+    // Like httpd, give up after recv_wait_timeout and let the caller retry
+    pollfd p = {req->session->fd, POLLIN, 0};
+    if (poll(&p, 1, ((Server *)r->handle)->config.recv_wait_timeout * 1000) == 0) return HTTPD_SOCK_ERR_TIMEOUT;
+    ssize_t got = recv(req->session->fd, buf, len, 0);
+    if (got <= 0) return HTTPD_SOCK_ERR_FAIL;
+    n = got;
+  }
+  req->bodyLeft -= n;
+  return n;
+}
+
+size_t httpd_req_get_url_query_len(httpd_req_t *r) { return request(r)->query.size(); }
+
+esp_err_t httpd_req_get_url_query_str(httpd_req_t *r, char *buf, size_t len) {
+  const std::string &q = request(r)->query;
+  if (q.empty()) return ESP_ERR_NOT_FOUND;
+  if (len == 0) return ESP_ERR_INVALID_ARG;
+  snprintf(buf, len, "%s", q.c_str());
+  return q.size() < len ? ESP_OK : ESP_ERR_HTTPD_RESULT_TRUNC;
+}
+
+esp_err_t httpd_query_key_value(const char *qry, const char *key, char *val, size_t len) {
+  size_t keyLen = strlen(key);
+  for (const char *p = qry; p && *p;) {
+    const char *end = strchr(p, '&');
+    if (!end) end = p + strlen(p);
+    if ((size_t)(end - p) > keyLen && strncmp(p, key, keyLen) == 0 && p[keyLen] == '=') {
+      const char *v = p + keyLen + 1;
+      size_t n = end - v;
+      if (len == 0) return ESP_ERR_HTTPD_RESULT_TRUNC;
+      size_t copy = std::min(n, len - 1);
+      memcpy(val, v, copy);
+      val[copy] = 0;
+      return copy == n ? ESP_OK : ESP_ERR_HTTPD_RESULT_TRUNC;
+    }
+    p = *end ? end + 1 : nullptr;
+  }
+  return ESP_ERR_NOT_FOUND;
+}
+
+size_t httpd_req_get_hdr_value_len(httpd_req_t *r, const char *field) {
+  const std::string *v = findHeader(request(r)->headers, field);
+  return v ? v->size() : 0;
+}
+
+esp_err_t httpd_req_get_hdr_value_str(httpd_req_t *r, const char *field, char *val, size_t len) {
+  const std::string *v = findHeader(request(r)->headers, field);
+  if (!v) return ESP_ERR_NOT_FOUND;
+  if (len == 0) return ESP_ERR_INVALID_ARG;
+  snprintf(val, len, "%s", v->c_str());
+  return v->size() < len ? ESP_OK : ESP_ERR_HTTPD_RESULT_TRUNC;
+}
+
+int httpd_req_to_sockfd(httpd_req_t *r) { return request(r)->session->fd; }
+
+esp_err_t httpd_resp_set_status(httpd_req_t *r, const char *status) {
+  request(r)->status = status;
+  return ESP_OK;
+}
+
+esp_err_t httpd_resp_set_type(httpd_req_t *r, const char *type) {
+  request(r)->type = type;
+  return ESP_OK;
+}
+
+esp_err_t httpd_resp_set_hdr(httpd_req_t *r, const char *field, const char *value) {
+  Request *req = request(r);
+  if (req->respHeaders.size() >= ((Server *)r->handle)->config.max_resp_headers) return ESP_ERR_NO_MEM;
+  req->respHeaders.push_back({field, value});
+  return ESP_OK;
+}
+
+esp_err_t httpd_resp_send(httpd_req_t *r, const char *buf, ssize_t len) {
+  Request *req = request(r);
+  if (len == HTTPD_RESP_USE_STRLEN) len = buf ? strlen(buf) : 0;
+  std::string extra = "Content-Length: " + std::to_string(len) + "\r\n";
+  if (!sendHeaders(req, extra.c_str()) || (len > 0 && !sendAll(req->session->fd, buf, len))) {
+    req->failed = true;
+    return ESP_ERR_HTTPD_RESP_SEND;
+  }
+  return ESP_OK;
+}
+
+esp_err_t httpd_resp_send_chunk(httpd_req_t *r, const char *buf, ssize_t len) {
+  Request *req = request(r);
+  if (len == HTTPD_RESP_USE_STRLEN) len = buf ? strlen(buf) : 0;
+  if (!req->headersSent && !sendHeaders(req, "Transfer-Encoding: chunked\r\n")) return ESP_ERR_HTTPD_RESP_SEND;
+  char size[24];
+  snprintf(size, sizeof(size), "%zx\r\n", (size_t)(buf ? len : 0));
+  bool ok = sendAll(req->session->fd, size, strlen(size)) && (!buf || len == 0 || sendAll(req->session->fd, buf, len)) &&
+            sendAll(req->session->fd, "\r\n", 2);
+  if (!ok) req->failed = true;
+  return ok ? ESP_OK : ESP_ERR_HTTPD_RESP_SEND;
+}
+
+// Blocking unless flags has MSG_DONTWAIT; then, like httpd_default_send(),
+// a full socket buffer comes back as HTTPD_SOCK_ERR_TIMEOUT
+int httpd_socket_send(httpd_handle_t hd, int sockfd, const char *buf, size_t len, int flags) {
+  if (!(flags & MSG_DONTWAIT)) return sendAll(sockfd, buf, len) ? (int)len : HTTPD_SOCK_ERR_FAIL;
+  ssize_t n = send(sockfd, buf, len, flags | MSG_NOSIGNAL);
+  if (n < 0) return errno == EAGAIN || errno == EWOULDBLOCK ? HTTPD_SOCK_ERR_TIMEOUT : HTTPD_SOCK_ERR_FAIL;
+  sim::counters.httpBytesOut += n;
+  return (int)n;
+}
+
+esp_err_t httpd_queue_work(httpd_handle_t hd, httpd_work_fn_t work, void *arg) {
+  Server *s = (Server *)hd;
+  if (!s) return ESP_ERR_INVALID_ARG;
+  {
+    std::lock_guard<std::mutex> lock(s->m);
+    s->work.push_back({work, arg});
+  }
+  wakeServer(s);
+  return ESP_OK;
+}
+
+esp_err_t httpd_sess_trigger_close(httpd_handle_t hd, int sockfd) {
+  Server *s = (Server *)hd;
+  {
+    std::lock_guard<std::mutex> lock(s->m);
+    s->closing.insert(sockfd);
+  }
+  wakeServer(s);
+  return ESP_OK;
+}
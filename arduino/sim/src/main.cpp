@@ -0,0 +1,139 @@
+// Host simulator driver: runs the firmware (firmware.cpp) in a "loopTask"
+// thread the way arduino-esp32 does, and drives the touch panel from a script.
+#include "Arduino.h"
+#include "firmware.h"
+#include "sim.h"
+#include <atomic>
+#include <csignal>
+#include <fstream>
+#include <sstream>
+
+static std::atomic<bool> interrupted{false};
+static int expectFailures = 0;
+
+// --- Touch script ---
+static void runScriptLine(const std::string &raw, int lineNo) {
+  std::istringstream in(raw.substr(0, raw.find('#')));
+  std::string cmd;
+  if (!(in >> cmd)) return;
+  int a = 0, b = 0, hold = 60;
+
+  if (cmd == "wait" && in >> a) {
+    delay(a);
+  } else if (cmd == "down" && in >> a >> b) {
+    fw::fingerAt(a, b);
+  } else if (cmd == "move" && in >> a >> b) {
+    int rawX, rawY;
+    fw::screenToRaw(a, b, rawX, rawY);
+    if (sim::fingerDown()) sim::touchDown(rawX, rawY);
+  } else if (cmd == "up") {
+    sim::touchUp();
+  } else if (cmd == "tap" && in >> a >> b) {
+    in >> hold;
+    fw::fingerAt(a, b);
+    delay(hold);
+    sim::touchUp();
+  } else if (cmd == "press" && in >> a) {
+    in >> hold;
+    int x, y;
+    if (!fw::buttonCentre(a, x, y)) {
+      fprintf(stderr, "sim: line %d: button %d is not on screen\n", lineNo, a);
+      expectFailures++;
+      return;
+    }
+    fw::fingerAt(x, y);
+    delay(hold);
+    sim::touchUp();
+  } else if (cmd == "expect" && in >> a) {
+    std::string want;
+    in >> want;
+    bool state = fw::buttonState(a);
+    if (state != (want == "on")) {
+      fprintf(stderr, "sim: line %d: expected button %d %s, it is %s\n", lineNo, a, want.c_str(), state ? "on" : "off");
+      expectFailures++;
+    }
+  } else if (cmd == "counters") {
+    printf("%s\n", sim::countersJson().c_str());
+    fflush(stdout);
+  } else if (cmd == "reset") {
+    sim::resetCounters();
+  } else if (cmd == "quit") {
+    sim::shutdown("script done", expectFailures ? 1 : 0);
+  } else {
+    fprintf(stderr, "sim: line %d: cannot parse \"%s\"\n", lineNo, raw.c_str());
+    expectFailures++;
+  }
+}
+
+static void runScript(const char *path) {
+  std::ifstream f(path);
+  if (!f) {
+    fprintf(stderr, "sim: cannot open script %s\n", path);
+    sim::shutdown("no script", 2);
+  }
+  std::string line;
+  for (int n = 1; std::getline(f, line) && !interrupted; n++) runScriptLine(line, n);
+}
+
+// --- Entry point ---
+static void usage(const char *argv0) {
+  fprintf(stderr,
+          "usage: %s [options]\n"
+          "  --port N          HTTP port on 127.0.0.1 (8080)\n"
+          "  --script FILE     touch script, see README.md\n"
+          "  --nvs FILE        load/save NVS contents\n"
+          "  --rtc FILE        save RTC memory on deep sleep\n"
+          "  --fs DIR          LittleFS contents (build/littlefs)\n"
+          "  --wake X,Y        boot as a touch wake from deep sleep, finger at X,Y (needs --rtc)\n"
+          "  --out FILE        write counters as JSON on exit\n"
+          "  --psram           report PSRAM (two-face colour sprites)\n"
+          "  --sprite-budget N sprite memory in bytes before createSprite() fails (98304)\n"
+          "  --wifi-ms N       station connect time (300)\n"
+          "  --serial-stdin    feed stdin to Serial (serial commands)\n"
+          "  --quiet           drop the firmware's Serial output\n",
+          argv0);
+}
+
+int main(int argc, char **argv) {
+  sim::Options &o = sim::options;
+  int wakeX = -1, wakeY = -1;
+  for (int i = 1; i < argc; i++) {
+    std::string arg = argv[i];
+    const char *next = i + 1 < argc ? argv[i + 1] : nullptr;
+    if (arg == "--port" && next) o.port = atoi(argv[++i]);
+    else if (arg == "--script" && next) o.script = argv[++i];
+    else if (arg == "--nvs" && next) o.nvsFile = argv[++i];
+    else if (arg == "--rtc" && next) o.rtcFile = argv[++i];
+    else if (arg == "--fs" && next) o.fsDir = argv[++i];
+    else if (arg == "--out" && next) o.outFile = argv[++i];
+    else if (arg == "--wake" && next && sscanf(argv[++i], "%d,%d", &wakeX, &wakeY) == 2) o.touchWake = true;
+    else if (arg == "--sprite-budget" && next) o.spriteBudget = strtoul(argv[++i], nullptr, 10);
+    else if (arg == "--wifi-ms" && next) o.wifiDelayMs = strtoul(argv[++i], nullptr, 10);
+    else if (arg == "--psram") o.psram = true;
+    else if (arg == "--serial-stdin") o.serialStdin = true;
+    else if (arg == "--quiet") o.quiet = true;
+    else {
+      usage(argv[0]);
+      return 2;
+    }
+  }
+
+  sim::loadNvs();
+  if (o.touchWake) {
+    sim::loadRtc();
+    fw::fingerAt(wakeX, wakeY); // setup() samples the wake tap straight away
+  }
+  signal(SIGINT, [](int) { interrupted = true; });
+  signal(SIGTERM, [](int) { interrupted = true; });
+  signal(SIGPIPE, SIG_IGN);
+
+  fw::start();
+  if (o.touchWake) {
+    delay(80);
+    sim::touchUp();
+  }
+
+  if (o.script) runScript(o.script);
+  while (!interrupted) delay(50);
+  sim::shutdown("interrupted", expectFailures ? 1 : 0);
+}
@@ -0,0 +1,145 @@
+// NVS (Preferences) and RTC memory for the host simulator. NVS lives in
+// memory and is written to --nvs <file> on shutdown; RTC_DATA_ATTR variables
+// are saved to --rtc <file> on deep sleep and loaded again on --wake touch.
+#include "Preferences.h"
+#include "sim.h"
+#include <map>
+#include <mutex>
+#include <vector>
+
+namespace {
+std::mutex nvsMutex;
+std::map<std::string, std::map<std::string, std::vector<uint8_t>>> nvs;
+}
+
+// Linker-provided bounds of the RTC_DATA_ATTR section
+extern "C" uint8_t __start_rtc_data[], __stop_rtc_data[];
+
+bool Preferences::begin(const char *name, bool ro, const char *partition) {
+  ns = name;
+  open = true;
+  readOnly = ro;
+  return true;
+}
+
+void Preferences::end() { open = false; }
+
+bool Preferences::clear() {
+  if (!open || readOnly) return false;
+  std::lock_guard<std::mutex> lock(nvsMutex);
+  nvs.erase(ns);
+  sim::counters.nvsErases++;
+  return true;
+}
+
+bool Preferences::remove(const char *key) {
+  if (!open || readOnly) return false;
+  std::lock_guard<std::mutex> lock(nvsMutex);
+  auto it = nvs.find(ns);
+  if (it == nvs.end() || !it->second.erase(key)) return false;
+  sim::counters.nvsErases++;
+  return true;
+}
+
+bool Preferences::isKey(const char *key) {
+  std::lock_guard<std::mutex> lock(nvsMutex);
+  auto it = nvs.find(ns);
+  return open && it != nvs.end() && it->second.count(key);
+}
+
+size_t Preferences::putBytes(const char *key, const void *value, size_t len) {
+  if (!open || readOnly) return 0;
+  std::lock_guard<std::mutex> lock(nvsMutex);
+  const uint8_t *p = (const uint8_t *)value;
+  nvs[ns][key].assign(p, p + len);
+  sim::counters.nvsWrites++;
+  sim::counters.nvsWriteBytes += len;
+  sim::probe(sim::PROBE_NVS, ns.c_str());
+  return len;
+}
+
+size_t Preferences::getBytesLength(const char *key) {
+  std::lock_guard<std::mutex> lock(nvsMutex);
+  auto it = nvs.find(ns);
+  if (!open || it == nvs.end()) return 0;
+  auto kv = it->second.find(key);
+  return kv == it->second.end() ? 0 : kv->second.size();
+}
+
+size_t Preferences::getBytes(const char *key, void *buf, size_t maxLen) {
+  std::lock_guard<std::mutex> lock(nvsMutex);
+  auto it = nvs.find(ns);
+  if (!open || it == nvs.end()) return 0;
+  auto kv = it->second.find(key);
+  if (kv == it->second.end() || kv->second.size() > maxLen) return 0;
+  memcpy(buf, kv->second.data(), kv->second.size());
+  sim::counters.nvsReads++;
+  return kv->second.size();
+}
+
+void Preferences::getValue(const char *key, void *value, size_t len) {
+  if (getBytesLength(key) == len) getBytes(key, value, len);
+}
+
+String Preferences::getString(const char *key, const String &def) {
+  size_t len = getBytesLength(key);
+  if (len == 0) return def;
+  std::string s(len, '\0');
+  if (getBytes(key, &s[0], len) != len) return def;
+  s.resize(strlen(s.c_str()));
+  return String(s);
+}
+
+// One "namespace key hexbytes" line per entry
+void sim::loadNvs() {
+  if (!options.nvsFile) return;
+  FILE *f = fopen(options.nvsFile, "r");
+  if (!f) return;
+  char ns[64], key[64];
+  static char hex[16384];
+  std::lock_guard<std::mutex> lock(nvsMutex);
+  while (fscanf(f, "%63s %63s %16383s", ns, key, hex) == 3) {
+    std::vector<uint8_t> v;
+    for (size_t i = 0; hex[i] && hex[i + 1] && hex[i] != '-'; i += 2) {
+      char b[3] = {hex[i], hex[i + 1], 0};
+      v.push_back((uint8_t)strtol(b, nullptr, 16));
+    }
+    nvs[ns][key] = v;
+  }
+  fclose(f);
+}
+
+void sim::saveNvs() {
+  if (!options.nvsFile) return;
+  FILE *f = fopen(options.nvsFile, "w");
+  if (!f) return;
+  std::lock_guard<std::mutex> lock(nvsMutex);
+  for (auto &n : nvs) {
+    for (auto &kv : n.second) {
+      fprintf(f, "%s %s ", n.first.c_str(), kv.first.c_str());
+      if (kv.second.empty()) fputc('-', f);
+      for (uint8_t b : kv.second) fprintf(f, "%02x", b);
+      fputc('\n', f);
+    }
+  }
+  fclose(f);
+}
+
+// The section layout only matches the binary that wrote it; a size mismatch is ignored
+void sim::loadRtc() {
+  if (!options.rtcFile) return;
+  FILE *f = fopen(options.rtcFile, "rb");
+  if (!f) return;
+  size_t size = __stop_rtc_data - __start_rtc_data;
+  std::vector<uint8_t> data(size + 1);
+  if (fread(data.data(), 1, data.size(), f) == size) memcpy(__start_rtc_data, data.data(), size);
+  fclose(f);
+}
+
+void sim::saveRtc() {
+  if (!options.rtcFile) return;
+  FILE *f = fopen(options.rtcFile, "wb");
+  if (!f) return;
+  fwrite(__start_rtc_data, 1, __stop_rtc_data - __start_rtc_data, f);
+  fclose(f);
+}
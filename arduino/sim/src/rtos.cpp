@@ -0,0 +1,126 @@
+// FreeRTOS stand-in for the host simulator: tasks are threads, notifications
+// a counter under a condition variable, mutexes std mutexes. Priorities and
+// core pinning are recorded only.
+#include "Arduino.h"
+#include "sim.h"
+#include <chrono>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+
+namespace {
+
+struct Task {
+  const char *name;
+  uint32_t stack;
+  UBaseType_t prio;
+  BaseType_t core;
+  std::mutex m;
+  std::condition_variable cv;
+  uint32_t notify = 0;
+};
+
+struct TaskExit {}; // thrown by vTaskDelete(nullptr) to unwind the calling thread
+
+thread_local Task *currentTask = nullptr;
+
+Task *taskForThread() {
+  if (!currentTask) currentTask = new Task{"thread", 0, 0, -1};
+  return currentTask;
+}
+
+struct Semaphore {
+  bool recursive;
+  std::recursive_timed_mutex m;
+};
+
+bool takeTimed(std::recursive_timed_mutex &m, TickType_t ticks) {
+  if (ticks == portMAX_DELAY) {
+    m.lock();
+    return true;
+  }
+  return m.try_lock_for(std::chrono::milliseconds(ticks));
+}
+
+} // namespace
+
+BaseType_t xTaskCreatePinnedToCore(void (*fn)(void *), const char *name, uint32_t stack, void *arg,
+                                   UBaseType_t prio, TaskHandle_t *handle, BaseType_t core) {
+  Task *t = new Task{name, stack, prio, core};
+  if (handle) *handle = t; // before the task runs, as the firmware expects
+  std::thread([t, fn, arg] {
+    currentTask = t;
+    try {
+      fn(arg);
+    } catch (const TaskExit &) {
+    }
+  }).detach();
+  return pdPASS;
+}
+
+void vTaskDelete(TaskHandle_t task) {
+  if (task == nullptr || task == currentTask) throw TaskExit();
+}
+
+void vTaskDelay(TickType_t ticks) {
+  std::this_thread::sleep_for(std::chrono::milliseconds(ticks));
+}
+
+TickType_t xTaskGetTickCount() { return millis(); }
+
+TaskHandle_t xTaskGetCurrentTaskHandle() { return taskForThread(); }
+
+// Host stacks are not measured; report the headroom a healthy task would have
+UBaseType_t uxTaskGetStackHighWaterMark(TaskHandle_t task) {
+  Task *t = task ? (Task *)task : taskForThread();
+  return t->stack ? t->stack / 2 : 4096;
+}
+
+BaseType_t xTaskNotifyGive(TaskHandle_t task) {
+  Task *t = (Task *)task;
+  {
+    std::lock_guard<std::mutex> lock(t->m);
+    t->notify++;
+  }
+  t->cv.notify_one();
+  return pdPASS;
+}
+
+void vTaskNotifyGiveFromISR(TaskHandle_t task, BaseType_t *woken) {
+  xTaskNotifyGive(task);
+  if (woken) *woken = pdTRUE;
+}
+
+uint32_t ulTaskNotifyTake(BaseType_t clear, TickType_t ticks) {
+  Task *t = taskForThread();
+  std::unique_lock<std::mutex> lock(t->m);
+  auto ready = [t] { return t->notify > 0; };
+  if (ticks == portMAX_DELAY) t->cv.wait(lock, ready);
+  else t->cv.wait_for(lock, std::chrono::milliseconds(ticks), ready);
+  uint32_t n = t->notify;
+  if (n) t->notify = clear ? 0 : n - 1;
+  return n;
+}
+
+SemaphoreHandle_t xSemaphoreCreateMutex() { return new Semaphore{false}; }
+SemaphoreHandle_t xSemaphoreCreateRecursiveMutex() { return new Semaphore{true}; }
+
+// Plain FreeRTOS mutexes are not recursive; the firmware never relies on
+// taking one twice, so both kinds share the recursive implementation
+BaseType_t xSemaphoreTake(SemaphoreHandle_t sem, TickType_t ticks) {
+  return takeTimed(((Semaphore *)sem)->m, ticks) ? pdTRUE : pdFALSE;
+}
+
+BaseType_t xSemaphoreGive(SemaphoreHandle_t sem) {
+  ((Semaphore *)sem)->m.unlock();
+  return pdTRUE;
+}
+
+BaseType_t xSemaphoreTakeRecursive(SemaphoreHandle_t sem, TickType_t ticks) { return xSemaphoreTake(sem, ticks); }
+BaseType_t xSemaphoreGiveRecursive(SemaphoreHandle_t sem) { return xSemaphoreGive(sem); }
+
+TaskHandle_t sim::adoptThread(const char *name) {
+  Task *t = taskForThread();
+  t->name = name;
+  return t;
+}
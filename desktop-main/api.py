@@ -4,6 +4,7 @@ import argparse
 import logging
 import json
 import os
+import struct
 import threading
 import psutil
 from datetime import datetime
@@ -69,8 +70,12 @@ HTML_PAGE = """
             <select id="layout" onchange="updateButtonInputs(); updateColorInputs()">
                 <option value="0">2x2 (4 buttons)</option>
                 <option value="1">3x2 (6 buttons)</option>
+                <option value="-1">Custom grid</option>
             </select>
         </label>
+        <label>Columns: <input type="number" id="cols" min="1" max="5" value="2" onchange="updateButtonInputs(); updateColorInputs()"></label>
+        <label>Rows: <input type="number" id="rows" min="1" max="4" value="2" onchange="updateButtonInputs(); updateColorInputs()"></label>
+        <label>Pages: <input type="number" id="pages" min="1" max="4" value="1" onchange="updateButtonInputs(); updateColorInputs()"></label>
         <label>Deep Sleep Timeout (seconds): 
             <input type="number" name="timeout" id="timeout" min="10" max="3600" value="900">
         </label>
@@ -95,9 +100,25 @@ HTML_PAGE = """
 <script>
 let currentButtonNames = {};
 
-function updateButtonInputs() {
+// Grid from the layout picker; "Custom grid" uses the cols/rows/pages inputs
+function getGrid() {
     const layout = parseInt(document.getElementById("layout").value);
-    const buttonCount = layout === 0 ? 4 : 6;
+    if (layout === 0) return {cols: 2, rows: 2, pages: 1};
+    if (layout === 1) return {cols: 3, rows: 2, pages: 1};
+    return {
+        cols: parseInt(document.getElementById("cols").value) || 1,
+        rows: parseInt(document.getElementById("rows").value) || 1,
+        pages: parseInt(document.getElementById("pages").value) || 1
+    };
+}
+
+function getButtonCount() {
+    const grid = getGrid();
+    return Math.min(grid.cols * grid.rows * grid.pages, 48);
+}
+
+function updateButtonInputs() {
+    const buttonCount = getButtonCount();
     const container = document.getElementById("buttonConfigContainer");
     
     container.innerHTML = '';
@@ -109,8 +130,7 @@ function updateButtonInputs() {
 }
 
 function updateColorInputs() {
-    const layout = parseInt(document.getElementById("layout").value);
-    const buttonCount = layout === 0 ? 4 : 6;
+    const buttonCount = getButtonCount();
     const container = document.getElementById("colorInputsContainer");
     
     container.innerHTML = '';
@@ -126,8 +146,7 @@ function updateColorInputs() {
 }
 
 function updateButtonNames() {
-    const layout = parseInt(document.getElementById("layout").value);
-    const buttonCount = layout === 0 ? 4 : 6;
+    const buttonCount = getButtonCount();
     const data = {};
     
     for (let i = 1; i <= buttonCount; i++) {
@@ -158,7 +177,10 @@ fetch("/api/settings")
         document.getElementById("timeout").value = data.timeout;
         document.getElementById("background").value = "#" + data.background.padStart(6, '0');
         document.getElementById("active").value = "#" + data.active.padStart(6, '0');
-        document.getElementById("layout").value = data.layout || 0;
+        document.getElementById("layout").value = data.layout !== undefined ? data.layout : 0;
+        if (data.cols) document.getElementById("cols").value = data.cols;
+        if (data.rows) document.getElementById("rows").value = data.rows;
+        if (data.pages) document.getElementById("pages").value = data.pages;
         
         // Update color inputs based on layout
         updateColorInputs();
@@ -181,18 +203,18 @@ fetch("/api/settings")
 
 document.getElementById("settingsForm").onsubmit = function(e) {
     e.preventDefault();
-    const layout = parseInt(document.getElementById("layout").value);
-    const buttonCount = layout === 0 ? 4 : 6;
+    const grid = getGrid();
+    const buttonCount = getButtonCount();
     
     const colors = [];
-    for (let i = 0; i < 6; i++) { // always send 6 colors
+    for (let i = 0; i < Math.max(buttonCount, 6); i++) { // at least 6 colors
         const colorInput = document.getElementById("color" + i);
         if (colorInput) {
             colors.push(colorInput.value.replace("#", ""));
         } else {
             // If no input, use default color
             const defaultColors = ["4682b4", "6495ed", "48d1cc", "5f9ea0", "ff6347", "8a2be2"];
-            colors.push(defaultColors[i]);
+            colors.push(defaultColors[i % 6]);
         }
     }
     
@@ -200,14 +222,23 @@ document.getElementById("settingsForm").onsubmit = function(e) {
         timeout: parseInt(document.getElementById("timeout").value),
         background: document.getElementById("background").value.replace("#", ""),
         active: document.getElementById("active").value.replace("#", ""),
-        layout: layout,
+        cols: grid.cols,
+        rows: grid.rows,
+        pages: grid.pages,
         colors: colors
     };
+
+    // Labels ride along, so one Save is one ESP32 transaction
+    const labels = {};
+    for (let i = 1; i <= buttonCount; i++) {
+        const input = document.getElementById(`button${i}`);
+        if (input) labels[i] = input.value;
+    }
     
-    fetch("/api/settings", {
+    fetch("/api/deck", {
         method: "POST",
         headers: { "Content-Type": "application/json" },
-        body: JSON.stringify(data)
+        body: JSON.stringify({settings: data, labels: labels})
     })
     .then(r => r.text())
     .then(text => {
@@ -296,15 +327,193 @@ def send_key(key_name, hold_seconds=0.0):
     except Exception as e:
         logging.warning(f"Failed to send key {key_name}: {e}")
 
-def poll_state(url, interval=0.2, timeout=0.8, hold=0.0, trigger_on_first=False, debug=False):
+# --- Button state tracking (shared by the push stream and the poll fallback) ---
+MAX_BUTTONS = 48  # largest deck the ESP32 layout engine supports (cols * rows * pages)
+BUTTON_KEYS = tuple(str(i) for i in range(1, MAX_BUTTONS + 1))
+STREAM_RETRY_INTERVAL = 10.0  # seconds of polling before retrying the push stream
+STREAM_READ_TIMEOUT = 40.0    # ESP32 sends a heartbeat every 15 s
+last_state = None             # last known {"1": bool, ...}
+last_event_seq = None         # last push event seen, for resuming the stream
+state_etag = None             # ETag of the last /state body, for conditional GETs
+STATE_FRAME = struct.Struct("<BBBBQII")  # /state.bin: version, cols, rows, pages, states, seq, ms
+binary_poll = True            # cleared when the firmware has no /state.bin
+sync_supported = True         # cleared when the firmware has no /sync
+sync_active = False           # poll loop is running and carries the info payload
+pending_info = None           # system info waiting to ride on the next /sync
+device_clock = None           # ESP32 clock source: None (unknown), "none", "host", "sntp" or "legacy"
+device_tz_offset = None       # UTC offset the ESP32 reports using; it resets to 0 on a power cycle
+device_deck_rev = None        # ESP32 deck revision from the latest /sync or /deck reply
+info_lock = threading.Lock()
+esp_session = requests.Session()  # listener thread only: keeps one keep-alive connection to the ESP32
+
+def note_device_clock(clock):
+    """Records the clock source the ESP32 reported; "legacy" firmware needs time strings"""
+    global device_clock
+    if clock != device_clock:
+        logging.info(f"ESP32 clock: {clock}")
+    device_clock = clock
+
+def note_device_tz(data):
+    """Records the UTC offset the ESP32 reported (older firmware does not report one)"""
+    global device_tz_offset
+    device_tz_offset = data.get("tz_offset")
+
+def device_clock_from(response):
+    try:
+        data = response.json()
+    except ValueError:
+        return "legacy"  # older firmware answers /system-info with plain "OK"
+    note_device_tz(data)
+    return data.get("clock", "legacy")
+
+def local_tz_offset():
+    return int(datetime.now().astimezone().utcoffset().total_seconds())
+
+def take_pending_info():
+    global pending_info
+    with info_lock:
+        info, pending_info = pending_info, None
+    return info
+
+def fetch_state_frame(timeout=0.8):
+    """Reads /state.bin; returns (states bitmask, seq) or None when the endpoint is missing"""
+    global binary_poll
+    r = esp_session.get(f"{ESP32_URL}/state.bin", timeout=timeout)
+    if r.status_code == 404:
+        binary_poll = False
+        logging.info("ESP32 has no /state.bin, polling /events directly")
+        return None
+    r.raise_for_status()
+    version, cols, rows, pages, states, seq, ms = STATE_FRAME.unpack_from(r.content)
+    return states, seq
+
+def fire_state_changes(old_state, new_state, hold=0.0, trigger_on_first=False):
+    """Sends keys for buttons whose state differs between two snapshots"""
+    if old_state is None:
+        if trigger_on_first:
+            for k, val in new_state.items():
+                if val and KEY_MAP.get(k):
+                    send_key(KEY_MAP[k], hold)
+        return
+    for k in BUTTON_KEYS:
+        if k in new_state and old_state.get(k) != new_state.get(k):
+            keyname = KEY_MAP.get(k)
+            if keyname:
+                send_key(keyname, hold)
+
+def stream_events(hold=0.0, trigger_on_first=False):
+    """Listens on the ESP32 /stream push channel until the connection drops"""
+    global last_state, last_event_seq, device_deck_rev
+
+    headers = {"Accept": "text/event-stream"}
+    if last_event_seq is not None:
+        headers["Last-Event-ID"] = str(last_event_seq)
+
+    with esp_session.get(f"{ESP32_URL}/stream", headers=headers, stream=True,
+                      timeout=(3.0, STREAM_READ_TIMEOUT)) as r:
+        r.raise_for_status()
+        logging.info("Connected to push stream (resume from %s)", last_event_seq)
+        event, data = None, None
+        # chunk_size=1 so every event is handled as soon as its bytes arrive
+        for line in r.iter_lines(chunk_size=1, decode_unicode=True):
+            if line is None:
+                continue
+            if line.startswith("event:"):
+                event = line[6:].strip()
+            elif line.startswith("data:"):
+                data = line[5:].strip()
+            elif line == "" and event and data:
+                try:
+                    payload = json.loads(data)
+                except ValueError:
+                    logging.warning("Invalid stream payload: %s", data)
+                    event, data = None, None
+                    continue
+
+                if event == "button":
+                    handle_button_event(payload.get("seq"), payload.get("button"),
+                                        payload.get("type", "press") == "press",
+                                        payload.get("state"), hold)
+                elif event == "state":
+                    new_state = {k: parse_bool_like(v) for k, v in payload.get("state", {}).items()}
+                    # Replayed events already updated last_state; this only fires for a gap
+                    # larger than the device history (or the very first connect)
+                    fire_state_changes(last_state, new_state, hold, trigger_on_first)
+                    last_state = new_state
+                    last_event_seq = payload.get("seq", last_event_seq)
+                elif event == "deck":
+                    # Labels or settings changed on the device (maybe by another host);
+                    # a stale rev makes the next push_deck() resend instead of skipping
+                    device_deck_rev = payload.get("rev", device_deck_rev)
+                event, data = None, None
+
+def handle_button_event(seq, button, pressed, state, hold=0.0):
+    """Fires the key for one press event from the stream or the /events log"""
+    global last_event_seq
+    if last_event_seq is not None and seq <= last_event_seq:
+        return  # already handled
+    k = str(button)
+    logging.debug("Event %s: button %s %s", seq, k, "press" if pressed else "release")
+    if pressed:
+        keyname = KEY_MAP.get(k)
+        if keyname:
+            send_key(keyname, hold)
+    if last_state is not None:
+        last_state[k] = parse_bool_like(state)
+    last_event_seq = seq
+
+def resync_state(timeout=0.8, hold=0.0, trigger_on_first=False):
+    """Fetches the /state snapshot and fires keys for anything that changed"""
+    global last_state, state_etag
+    headers = {"If-None-Match": state_etag} if state_etag and last_state is not None else {}
+    r = esp_session.get(f"{ESP32_URL}/state", headers=headers, timeout=timeout)
+    if r.status_code == 304:
+        return
+    r.raise_for_status()
+    state_etag = r.headers.get("ETag")
+    data = r.json() if r.text else {}
+    if isinstance(data, dict):
+        current_state = {k: parse_bool_like(v) for k, v in data.items() if k in BUTTON_KEYS}
+        logging.debug("Polled state: %s", current_state)
+        fire_state_changes(last_state, current_state, hold, trigger_on_first)
+        last_state = current_state
+
+def sync_with_device(info, timeout=0.8):
+    """POSTs /sync with the info payload; returns the events batch, or None if /sync is missing"""
+    global sync_supported
+    r = esp_session.post(f"{ESP32_URL}/sync", json={"since": last_event_seq, "info": info}, timeout=timeout)
+    if r.status_code == 404:
+        sync_supported = False
+        logging.info("ESP32 has no /sync, sending system info separately")
+        r = esp_session.post(f"{ESP32_URL}/system-info", json=info, timeout=timeout)
+        note_device_clock(device_clock_from(r))
+        return None
+    r.raise_for_status()
+    data = r.json()
+    note_device_clock(data.get("clock", "legacy"))
+    note_device_tz(data)
+    global device_deck_rev
+    device_deck_rev = data.get("rev", device_deck_rev)
+    return data
+
+def poll_events(interval=0.2, timeout=0.8, hold=0.0, trigger_on_first=False, debug=False, duration=None):
+    """Drains /events?since=<seq> in batches; with duration set, returns after that many seconds"""
+    global sync_active
     logging.basicConfig(level=logging.DEBUG if debug else logging.INFO,
                         format='[%(asctime)s] %(levelname)s: %(message)s', datefmt='%H:%M:%S')
-    last_state = None
+    sync_active = sync_supported
+    try:
+        _poll_events(interval, timeout, hold, trigger_on_first, duration)
+    finally:
+        sync_active = False
+
+def _poll_events(interval, timeout, hold, trigger_on_first, duration):
+    global last_event_seq
     connection_errors = 0
+    deadline = time.time() + duration if duration is not None else None
     
-    while True:
+    while deadline is None or time.time() < deadline:
         start = time.time()
-        current_state = None
         
         # Check if ESP32_URL still exists
         if not ESP32_URL:
@@ -312,39 +521,72 @@ def poll_state(url, interval=0.2, timeout=0.8, hold=0.0, trigger_on_first=False,
             continue
             
         try:
-            r = requests.get(f"{ESP32_URL}/state", timeout=timeout)
-            r.raise_for_status()
-            data = r.json() if r.text else {}
-            if isinstance(data, dict):
-                current_state = {k: parse_bool_like(data.get(k, False)) for k in ("1","2","3","4","5","6")}
-                connection_errors = 0  # Reset error counter on successful connection
+            if last_event_seq is None or last_state is None:
+                # First contact: take the snapshot, then drain from the device's current seq
+                r = esp_session.get(f"{ESP32_URL}/events", timeout=timeout)
+                r.raise_for_status()
+                resync_state(timeout, hold, trigger_on_first)
+                last_event_seq = r.json().get("seq", 0)
+            else:
+                info = take_pending_info() if sync_supported else None
+                if info is not None:
+                    # Info upload and event fetch in one round trip
+                    data = sync_with_device(info, timeout)
+                    if data is None:
+                        continue
+                else:
+                    # Cheap 20-byte frame first; only fetch events when the device's seq moved
+                    frame = fetch_state_frame(timeout) if binary_poll else None
+                    if frame is not None and frame[1] == last_event_seq:
+                        connection_errors = 0
+                        time.sleep(max(0, interval - (time.time() - start)))
+                        continue
+                    r = esp_session.get(f"{ESP32_URL}/events", params={"since": last_event_seq}, timeout=timeout)
+                    r.raise_for_status()
+                    data = r.json()
+                if data.get("seq", 0) < last_event_seq:
+                    logging.info("ESP32 event counter restarted, resyncing")
+                    last_event_seq = None
+                    continue
+                # [seq, button, type, ms, state]
+                for seq, button, etype, ms, state in data.get("events", []):
+                    handle_button_event(seq, button, etype == 1, state, hold)
+                if data.get("lost", 0) > 0:
+                    logging.warning("%d button events lost, resyncing from /state", data["lost"])
+                    resync_state(timeout, hold)
+                last_event_seq = max(last_event_seq or 0, data.get("seq", 0))
+            connection_errors = 0  # Reset error counter on successful connection
         except requests.RequestException as e:
             connection_errors += 1
             if connection_errors <= 3:  # Log only first errors
                 logging.warning("HTTP error: %s", e)
-        except ValueError:
-            logging.warning("Invalid JSON from %s", ESP32_URL)
-
-        if current_state:
-            logging.debug("Polled state: %s", current_state)
-            if last_state is None and trigger_on_first:
-                for k, val in current_state.items():
-                    if val:
-                        keyname = KEY_MAP.get(k)
-                        if keyname:
-                            send_key(keyname, hold)
-            elif last_state:
-                for k in ("1","2","3","4","5","6"):
-                    if last_state.get(k) != current_state.get(k):
-                        keyname = KEY_MAP.get(k)
-                        if keyname:
-                            send_key(keyname, hold)
-            last_state = current_state
+        except (ValueError, struct.error):
+            logging.warning("Invalid response from %s", ESP32_URL)
 
         elapsed = time.time() - start
         to_sleep = max(0, interval - elapsed)
         time.sleep(to_sleep)
 
+def listen_state(interval=0.2, hold=0.0, trigger_on_first=False, debug=False, use_stream=True):
+    """Receives button events over the push stream, falling back to polling /events"""
+    logging.basicConfig(level=logging.DEBUG if debug else logging.INFO,
+                        format='[%(asctime)s] %(levelname)s: %(message)s', datefmt='%H:%M:%S')
+    while True:
+        if not ESP32_URL:
+            time.sleep(5)
+            continue
+
+        if use_stream:
+            try:
+                stream_events(hold, trigger_on_first)
+                continue  # stream closed cleanly - reconnect right away
+            except requests.RequestException as e:
+                logging.warning("Push stream unavailable (%s), polling for %.0f s", e, STREAM_RETRY_INTERVAL)
+
+        poll_events(interval=interval, hold=hold,
+                    trigger_on_first=trigger_on_first, debug=debug,
+                    duration=STREAM_RETRY_INTERVAL if use_stream else None)
+
 # --- Config management ---
 def load_config():
     """Loads configuration from JSON file"""
@@ -466,38 +708,54 @@ def auto_reconnect_esp32():
                 last_check = current_time
 
 def send_system_info_to_esp32():
-    """Sends system information to ESP32 periodically"""
+    """Sends CPU/RAM to ESP32 when they change; the ESP32 keeps its own clock"""
+    global pending_info
     last_info = {}
+    sent_tz_offset = None
+    session = requests.Session()  # reuses one connection between updates
     
     while True:
         if ESP32_URL:
             try:
-                current_time = datetime.now().strftime("%H:%M:%S")
-                current_date = datetime.now().strftime("%Y-%m-%d")
                 cpu_percent = psutil.cpu_percent(interval=1)
                 memory = psutil.virtual_memory()
                 ram_percent = memory.percent
                 
                 system_info = {
-                    "time": current_time,
-                    "date": current_date,
                     "cpu": round(cpu_percent, 1),
                     "ram": round(ram_percent, 1)
                 }
                 
+                # Clock: one epoch until the device reports it is set, then only when
+                # the offset changes here or the device lost it (power cycle)
+                tz_offset = local_tz_offset()
+                tz_stale = device_tz_offset is not None and device_tz_offset != tz_offset
+                if device_clock == "legacy":
+                    system_info["time"] = datetime.now().strftime("%H:%M:%S")
+                    system_info["date"] = datetime.now().strftime("%Y-%m-%d")
+                elif device_clock in (None, "none") or tz_offset != sent_tz_offset or tz_stale:
+                    system_info["epoch"] = int(time.time())
+                    system_info["tz_offset"] = tz_offset
+                
                 # Send only if data changed significantly
                 should_send = False
-                if not last_info:
+                if not last_info or "epoch" in system_info:
                     should_send = True
                 else:
-                    if (last_info.get("time") != system_info["time"] or
-                        last_info.get("date") != system_info["date"] or
+                    if (last_info.get("time") != system_info.get("time") or
+                        last_info.get("date") != system_info.get("date") or
                         abs(last_info.get("cpu", 0) - system_info["cpu"]) > 0.5 or
                         abs(last_info.get("ram", 0) - system_info["ram"]) > 0.5):
                         should_send = True
                 
-                if should_send:
-                    response = requests.post(f"{ESP32_URL}/system-info", 
+                if should_send and sync_active and sync_supported:
+                    # The poll loop is running: hand the payload to its next /sync
+                    with info_lock:
+                        pending_info = system_info
+                    last_info = system_info.copy()
+                    sent_tz_offset = system_info.get("tz_offset", sent_tz_offset)
+                elif should_send:
+                    response = session.post(f"{ESP32_URL}/system-info", 
                                            headers={"Content-Type": "application/json"},
                                            json=system_info, 
                                            timeout=2.0)
@@ -505,6 +763,8 @@ def send_system_info_to_esp32():
                     if response.status_code == 200:
                         logging.debug(f"System info sent: {system_info}")
                         last_info = system_info.copy()
+                        sent_tz_offset = system_info.get("tz_offset", sent_tz_offset)
+                        note_device_clock(device_clock_from(response))
                     else:
                         logging.warning(f"Failed to send system info: {response.status_code}")
                         
@@ -540,7 +800,7 @@ def post_keymap():
         logging.info(f"Received keymap data: {data}")
         
         # Update KEY_MAP
-        for k in ["1", "2", "3", "4", "5", "6"]:
+        for k in BUTTON_KEYS:
             if k in data:
                 old_key = KEY_MAP.get(k, "")
                 KEY_MAP[k] = data[k]
@@ -564,8 +824,7 @@ def config():
         logging.error(f"Failed to parse JSON: {e}")
         return jsonify({"error": "invalid json"}), 400
 
-    # Extend support to 6 buttons
-    for k in ["1", "2", "3", "4", "5", "6"]:
+    for k in BUTTON_KEYS:
         if k in data:
             old_name = BUTTON_NAMES.get(k, f"Button {k}")
             BUTTON_NAMES[k] = data[k]
@@ -577,7 +836,7 @@ def config():
 
         try:
             # Send data in format {"1":"name", "2":"name", ...}
-            payload = {k: v for k, v in data.items() if k in ["1", "2", "3", "4", "5", "6"]}
+            payload = {k: v for k, v in data.items() if k in BUTTON_KEYS}
             logging.info(f"Sending to ESP32 ({ESP32_URL}/config): {payload}")
             
             r = requests.post(f"{ESP32_URL}/config", 
@@ -649,6 +908,9 @@ def get_settings():
         "background": "0a1e46",
         "active": "b4dcfa",
         "layout": 0,
+        "cols": 2,
+        "rows": 2,
+        "pages": 1,
         "colors": ["4682b4", "6495ed", "48d1cc", "5f9ea0", "ff6347", "8a2be2"],
         "info_timeout": 120,
         "info_enabled": True
@@ -684,6 +946,226 @@ def post_settings():
 
     return jsonify({"status": "ok"})
 
+# --- Deck config (POST /deck on the ESP32) ---
+deck_sent = None              # (body, rev) of our last applied /deck request
+
+def push_deck(labels=None, settings=None, timeout=3.0):
+    """Applies labels and settings in one ESP32 transaction: one redraw, one commit.
+    Skipped when the body matches the last one applied and the deck revision has not moved since."""
+    global deck_sent, device_deck_rev
+    body = {}
+    if labels:
+        body["labels"] = {k: v for k, v in labels.items() if k in BUTTON_KEYS}
+    if settings:
+        body["settings"] = settings
+    if deck_sent and deck_sent[0] == body and deck_sent[1] == device_deck_rev:
+        return {"rev": device_deck_rev, "changed": False, "skipped": True}
+    r = requests.post(f"{ESP32_URL}/deck", json=body, timeout=timeout)
+    if r.status_code == 404:
+        # Older firmware: one request per part
+        if settings:
+            requests.post(f"{ESP32_URL}/settings", json=settings, timeout=timeout).raise_for_status()
+        if body.get("labels"):
+            requests.post(f"{ESP32_URL}/config", json=body["labels"], timeout=timeout).raise_for_status()
+        return {"rev": None, "changed": True, "skipped": False}
+    r.raise_for_status()
+    result = r.json()
+    device_deck_rev = result["rev"]
+    deck_sent = (body, device_deck_rev)
+    result["skipped"] = False
+    return result
+
+@app.route("/api/deck", methods=["POST"])
+def post_deck():
+    """Labels and settings in one request: {"labels": {"1": "..."}, "settings": {...}}"""
+    try:
+        data = request.get_json(force=True)
+    except Exception as e:
+        logging.error(f"Failed to parse deck JSON: {e}")
+        return jsonify({"error": "invalid json"}), 400
+
+    labels = data.get("labels") or {}
+    for k in BUTTON_KEYS:
+        if k in labels:
+            BUTTON_NAMES[k] = labels[k]
+    if not ESP32_URL:
+        return jsonify({"error": "no device"}), 503
+    save_config(ESP32_URL, BUTTON_NAMES)
+    try:
+        result = push_deck(labels, data.get("settings"))
+        logging.info(f"Deck sent to ESP32: {result}")
+        return jsonify(result)
+    except Exception as e:
+        logging.error(f"Failed to send deck to ESP32: {e}")
+        return jsonify({"error": str(e)}), 500
+
+# --- Button icons ---
+ICON_MAGIC = b"CDI1"
+ICON_MAX_DIM = 128       # per side, as accepted by the ESP32
+ICON_MARGIN = 8          # icon is this much smaller than the tile
+
+def image_to_rgb565(image, size=None):
+    """Loads a PIL image (or path / file object) as (w, h, RGB565 pixels), fitted into size x size"""
+    from PIL import Image  # only needed for icons and patches
+    img = image if isinstance(image, Image.Image) else Image.open(image)
+    img = img.convert("RGBA")
+    if size:
+        img.thumbnail((size, size))
+    pixels = []
+    for r, g, b, a in img.getdata():
+        # transparent pixels become black; the tile color is not known here
+        r, g, b = r * a // 255, g * a // 255, b * a // 255
+        pixels.append(((r & 0xF8) << 8) | ((g & 0xFC) << 3) | (b >> 3))
+    return img.size[0], img.size[1], pixels
+
+def rle565(pixels):
+    """RLE packets as read by the ESP32: c < 0x80 -> c+1 literal pixels, c >= 0x80 -> one pixel (c & 0x7F)+1 times"""
+    out = bytearray()
+    literal = []
+
+    def flush():
+        if literal:
+            out.append(len(literal) - 1)
+            out.extend(struct.pack(f"<{len(literal)}H", *literal))
+            literal.clear()
+
+    i = 0
+    while i < len(pixels):
+        run = 1
+        while i + run < len(pixels) and run < 128 and pixels[i + run] == pixels[i]:
+            run += 1
+        if run >= 3:
+            flush()
+            out.append(0x80 | (run - 1))
+            out.extend(struct.pack("<H", pixels[i]))
+            i += run
+        else:
+            literal.append(pixels[i])
+            if len(literal) == 128:
+                flush()
+            i += 1
+    flush()
+    return bytes(out)
+
+def encode_icon(image, size):
+    """Encodes an image as a .cdi icon: header plus RLE over RGB565, see arduino.h"""
+    w, h, pixels = image_to_rgb565(image, size)
+    return ICON_MAGIC + struct.pack("<HH", w, h) + rle565(pixels)
+
+def icon_size_for_device(timeout=2.0):
+    """Largest icon that fits the current tiles, from the ESP32 layout"""
+    try:
+        s = requests.get(f"{ESP32_URL}/settings", timeout=timeout).json()
+        cols, rows, pages = s.get("cols", 2), s.get("rows", 2), s.get("pages", 1)
+        margin = 12  # setupButtonLayout() on a 320x240 panel
+        height = 240 - (22 if pages > 1 else 0)
+        tile = min((320 - margin * (cols + 1)) // cols, (height - margin * (rows + 1)) // rows)
+        return max(8, min(ICON_MAX_DIM, tile - ICON_MARGIN))
+    except Exception:
+        return 64
+
+def upload_icon(button, image, size=None, timeout=5.0):
+    """Encodes image and uploads it as the icon of button (1-based); returns the ESP32 reply"""
+    data = encode_icon(image, size or icon_size_for_device())
+    r = requests.post(f"{ESP32_URL}/icon", params={"button": button}, data=data,
+                      headers={"Content-Type": "application/octet-stream"}, timeout=timeout)
+    r.raise_for_status()
+    return r.json()
+
+# --- Live tile patches (POST /draw on the ESP32) ---
+PATCH_HEADER = struct.Struct("<BhhHH")  # button (0 = screen coordinates), x, y, w, h
+draw_session = requests.Session()       # keeps one connection open for frequent patches
+
+def encode_patch(button, w, h, pixels, x=0, y=0):
+    """One patch: w*h RGB565 pixels at x, y inside button (1-based; 0 = screen coordinates)"""
+    return PATCH_HEADER.pack(button, x, y, w, h) + rle565(pixels)
+
+def fill_patch(button, w, h, color, x=0, y=0):
+    """A solid w x h rectangle, e.g. a meter bar; color is RGB565"""
+    return encode_patch(button, w, h, [color] * (w * h), x, y)
+
+def image_patch(button, image, size=None, x=0, y=0):
+    """An image (PIL image or path) as a patch, fitted into size x size"""
+    w, h, pixels = image_to_rgb565(image, size)
+    return encode_patch(button, w, h, pixels, x, y)
+
+def draw_patches(patches, timeout=2.0):
+    """Sends patches (bytes) to the ESP32 in one request; nothing is persisted there"""
+    r = draw_session.post(f"{ESP32_URL}/draw", data=b"".join(patches),
+                          headers={"Content-Type": "application/octet-stream"}, timeout=timeout)
+    r.raise_for_status()
+    return r.json()
+
+def hex_to_rgb565(color):
+    """"rrggbb" (optionally with #) as RGB565"""
+    v = int(color.lstrip("#"), 16)
+    return ((v >> 8) & 0xF800) | ((v >> 5) & 0x07E0) | ((v >> 3) & 0x001F)
+
+@app.route("/api/draw", methods=["POST"])
+def post_draw():
+    """Draws live patches over the tiles; nothing is persisted on the ESP32.
+    JSON {"patches": [{"button", "w", "h", "color": "rrggbb", "x", "y"}, ...]} fills
+    rectangles; an image (multipart "file" or raw body) with ?button=&x=&y=&size= is
+    drawn as one patch."""
+    if not ESP32_URL:
+        return jsonify({"error": "no device"}), 503
+    try:
+        if request.is_json:
+            patches = [fill_patch(int(p["button"]), int(p["w"]), int(p["h"]), hex_to_rgb565(p["color"]),
+                                  int(p.get("x", 0)), int(p.get("y", 0)))
+                       for p in request.get_json().get("patches", [])]
+        else:
+            import io
+            src = request.files["file"].stream if "file" in request.files else io.BytesIO(request.get_data())
+            size = request.args.get("size", type=int)
+            patches = [image_patch(request.args.get("button", 0, type=int), src,
+                                   size=min(size, ICON_MAX_DIM) if size else ICON_MAX_DIM,
+                                   x=request.args.get("x", 0, type=int), y=request.args.get("y", 0, type=int))]
+    except ImportError:
+        return jsonify({"error": "Pillow is required for images"}), 500
+    except (KeyError, TypeError, ValueError, AttributeError, OSError) as e:
+        return jsonify({"error": f"invalid patch: {e}"}), 400
+    if not patches:
+        return jsonify({"error": "no patches"}), 400
+    try:
+        return jsonify(draw_patches(patches))
+    except Exception as e:
+        logging.error(f"Failed to draw patches: {e}")
+        return jsonify({"error": str(e)}), 502
+
+@app.route("/api/icon/<int:button>", methods=["POST"])
+def post_icon(button):
+    """Uploads an image (multipart "file" or raw body) as a button icon"""
+    if not ESP32_URL:
+        return jsonify({"error": "no device"}), 503
+    if not 1 <= button <= MAX_BUTTONS:
+        return jsonify({"error": "invalid button"}), 400
+    try:
+        import io
+        src = request.files["file"].stream if "file" in request.files else io.BytesIO(request.get_data())
+        size = request.args.get("size", type=int)
+        result = upload_icon(button, src, size=min(size, ICON_MAX_DIM) if size else None)
+        logging.info(f"Icon for button {button}: {result}")
+        return jsonify(result)
+    except ImportError:
+        return jsonify({"error": "Pillow is required for icons"}), 500
+    except Exception as e:
+        logging.error(f"Failed to upload icon for button {button}: {e}")
+        return jsonify({"error": str(e)}), 500
+
+@app.route("/api/icon/<int:button>", methods=["DELETE"])
+def delete_icon(button):
+    """Removes a button icon; the button shows its label again"""
+    if not ESP32_URL:
+        return jsonify({"error": "no device"}), 503
+    try:
+        r = requests.delete(f"{ESP32_URL}/icon", params={"button": button}, timeout=3.0)
+        r.raise_for_status()
+        return jsonify({"status": "ok"})
+    except Exception as e:
+        logging.error(f"Failed to delete icon for button {button}: {e}")
+        return jsonify({"error": str(e)}), 500
+
 def run_flask():
     app.run(host="0.0.0.0", port=22778, debug=False)
 
@@ -699,6 +1181,7 @@ if __name__ == "__main__":
     parser.add_argument("--poll-interval", type=float, default=0.2)
     parser.add_argument("--hold", type=float, default=0.0)
     parser.add_argument("--trigger-on-first", action="store_true")
+    parser.add_argument("--no-stream", action="store_true", help="Poll /events instead of using the push stream")
     parser.add_argument("--debug", action="store_true")
 
     args = parser.parse_args()
@@ -733,20 +1216,14 @@ if __name__ == "__main__":
     # Start system info sender thread (tylko jeśli ESP32_URL jest dostępne)
     threading.Thread(target=send_system_info_to_esp32, daemon=True).start()
 
-    # Start polling thread (tylko jeśli ESP32_URL jest dostępne)
-    def poll_thread():
-        while True:
-            if ESP32_URL:
-                poll_state(
-                    url=f"{ESP32_URL}/state",
-                    interval=args.poll_interval,
-                    hold=args.hold,
-                    trigger_on_first=args.trigger_on_first,
-                    debug=args.debug
-                )
-            else:
-                time.sleep(5)
-    threading.Thread(target=poll_thread, daemon=True).start()
+    # Start state listener thread (push stream, polling as fallback; waits for ESP32_URL)
+    threading.Thread(target=lambda: listen_state(
+        interval=args.poll_interval,
+        hold=args.hold,
+        trigger_on_first=args.trigger_on_first,
+        debug=args.debug,
+        use_stream=not args.no_stream
+    ), daemon=True).start()
 
     # Uruchom Flask zawsze, nawet jeśli ESP32_URL jest None
     run_flask()
\ No newline at end of file
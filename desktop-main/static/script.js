@@ -255,11 +255,18 @@ document.getElementById("settingsForm").onsubmit = function(e) {
         info_timeout: parseInt(document.getElementById("info_timeout").value) || 120,
         info_enabled: document.getElementById("info_enabled").checked
     };
+
+    // Labels ride along, so one Save is one ESP32 transaction
+    const labels = {};
+    for (let i = 1; i <= (layout === 0 ? 4 : 6); i++) {
+        const input = document.getElementById(`button${i}`);
+        if (input) labels[i] = input.value;
+    }
     
-    fetch("http://localhost:22778/api/settings", {
+    fetch("http://localhost:22778/api/deck", {
         method: "POST",
         headers: { "Content-Type": "application/json" },
-        body: JSON.stringify(data)
+        body: JSON.stringify({settings: data, labels: labels})
     })
     .then(r => r.text())
     .then(text => {